@@ -1,13 +1,36 @@
 ﻿#include "NavData/Contour/NNContourGeneration.h"
 
+// UE Includes
+#include "Async/ParallelFor.h"
+
 // NN Includes
 #include "NavData/NNAreaGenerator.h"
 #include "NavData/Voxelization/OpenHeightFieldGenerator.h"
 
 #define DEBUG_CONTOUR_GENERATION 0
 
+namespace NNContourGenerationHelpers
+{
+	/** Regions traced by each task. The task reuses its scratch buffers between them */
+	constexpr int32 RegionsPerTask = 8;
+}
+
+void FNNContourScratch::Reset()
+{
+	Vertices.Reset();
+	VerticesRegions.Reset();
+	MandatoryIndexes.Reset();
+	SimplifiedIndexes.Reset();
+	SegmentStack.Reset();
+}
+
 void FNNContourGeneration::CalculateContour(FNNOpenHeightField& OpenHeightField, TArray<FNNContour>& OutContours)
 {
+	const int32 RegionsNum = OpenHeightField.Regions.Num();
+	// The flagged span with the lowest X of each region. Its edge towards -X belongs to the outer contour of the region
+	TArray<const FNNOpenSpan*> RegionStartSpans;
+	RegionStartSpans.Init(nullptr, RegionsNum);
+
 	for (FNNOpenHeightFieldIterator It (OpenHeightField); It; ++It)
 	{
 		FNNOpenSpan* CurrentSpan = It.Get();
@@ -35,63 +58,76 @@ void FNNContourGeneration::CalculateContour(FNNOpenHeightField& OpenHeightField,
 #if DEBUG_CONTOUR_GENERATION
 		AreaGeneratorData.AddDebugText(CurrentSpan->GetOpenSpanWorldPosition(OpenHeightField), FString::FromInt(CurrentSpan->NeighbourFlags));
 #endif
+		if (CurrentSpan->NeighbourFlags != 0 && RegionStartSpans.IsValidIndex(CurrentSpan->RegionID))
+		{
+			const FNNOpenSpan*& StartSpan = RegionStartSpans[CurrentSpan->RegionID];
+			if (!StartSpan || CurrentSpan->X < StartSpan->X)
+			{
+				StartSpan = CurrentSpan;
+			}
+		}
 	}
 
-	TArray<FVector> Vertices;
-	TArray<int32> VerticesRegions;
-	TArray<FVector> SimplifiedVertices;
-	TArray<int32> SimplifiedVerticesIndexes;
-
-	for (FNNOpenHeightFieldIterator It (OpenHeightField); It; ++It)
+	// Each region only reads the flags and writes its own slot so they can be traced concurrently
+	TArray<FNNContour> RegionContours;
+	RegionContours.SetNum(RegionsNum);
+	const int32 TasksNum = FMath::DivideAndRoundUp(RegionsNum, NNContourGenerationHelpers::RegionsPerTask);
+	ParallelFor(TasksNum, [this, RegionsNum, &RegionStartSpans, &RegionContours](int32 TaskIndex)
 	{
-		FNNOpenSpan* CurrentSpan = It.Get();
-		// Span already processed
-		if (!CurrentSpan || CurrentSpan->RegionID == INDEX_NONE || CurrentSpan->NeighbourFlags == 0)
+		FNNContourScratch Scratch;
+		const int32 FirstRegion = TaskIndex * NNContourGenerationHelpers::RegionsPerTask;
+		const int32 LastRegion = FMath::Min(FirstRegion + NNContourGenerationHelpers::RegionsPerTask, RegionsNum);
+		for (int32 RegionID = FirstRegion; RegionID < LastRegion; ++RegionID)
 		{
-			continue;
+			if (const FNNOpenSpan* StartSpan = RegionStartSpans[RegionID])
+			{
+				BuildContour(*StartSpan, Scratch, RegionContours[RegionID]);
+				Scratch.Reset();
+			}
 		}
+	});
 
-		// Locate the direction which points to another region
-		int32 StartDirection = 0;
-		while ((CurrentSpan->NeighbourFlags & (1 << StartDirection)) == 0)
+	OutContours.Reserve(OutContours.Num() + RegionsNum);
+	for (FNNContour& Contour : RegionContours)
+	{
+		if (Contour.SimplifiedVertexes.Num() > 2)
 		{
-			++StartDirection;
+			OutContours.Add(MoveTemp(Contour));
 		}
+	}
+}
 
-		BuildRawContour(CurrentSpan, StartDirection, Vertices, VerticesRegions);
-		GenerateSimplifiedContour(Vertices, VerticesRegions, SimplifiedVertices, SimplifiedVerticesIndexes);
-		MatchNullRegionEdges(Vertices, VerticesRegions, SimplifiedVertices, SimplifiedVerticesIndexes);
-		NullRegionMaxEdge(Vertices, VerticesRegions, SimplifiedVertices, SimplifiedVerticesIndexes);
+void FNNContourGeneration::BuildContour(const FNNOpenSpan& StartSpan, FNNContourScratch& Scratch, FNNContour& OutContour) const
+{
+	// Locate the direction which points to another region
+	int32 StartDirection = 0;
+	while ((StartSpan.NeighbourFlags & (1 << StartDirection)) == 0)
+	{
+		++StartDirection;
+	}
 
-		if (SimplifiedVertices.Num() > 2)
-		{
-			OutContours.Emplace(CurrentSpan->RegionID, Vertices, SimplifiedVertices);
-		}
+	BuildRawContour(&StartSpan, StartDirection, Scratch.Vertices, Scratch.VerticesRegions);
+	GenerateSimplifiedContour(Scratch.Vertices, Scratch.VerticesRegions, Scratch.MandatoryIndexes);
+	SubdivideNullRegionEdges(Scratch.Vertices, Scratch.VerticesRegions, Scratch.MandatoryIndexes, Scratch.SegmentStack, Scratch.SimplifiedIndexes);
 
-		Vertices.Reset();
-		VerticesRegions.Reset();
-		SimplifiedVertices.Reset();
-		SimplifiedVerticesIndexes.Reset();
+	if (Scratch.SimplifiedIndexes.Num() <= 2)
+	{
+		return;
 	}
-	
-	for (const FNNRegion& Region : OpenHeightField.Regions)
+
+	OutContour.RegionID = StartSpan.RegionID;
+	OutContour.AreaID = StartSpan.AreaID;
+	OutContour.RawVertexes = Scratch.Vertices;
+	OutContour.SimplifiedVertexes.Reserve(Scratch.SimplifiedIndexes.Num());
+	for (const int32 SourceIndex : Scratch.SimplifiedIndexes)
 	{
-		const int32 RegionID = Region.ID;
-		int32 RegionMatches = 0;
-		for (const FNNContour& Contour : OutContours)
-		{
-			if (Contour.RegionID == RegionID)
-			{
-				++RegionMatches;
-				ensureMsgf (RegionMatches <= 1, TEXT("More that one contour with the same region ID"));
-			}
-		}
+		OutContour.SimplifiedVertexes.Add(Scratch.Vertices[SourceIndex]);
 	}
 }
 
-void FNNContourGeneration::BuildRawContour(FNNOpenSpan* StartSpan, int32 StartDir, TArray<FVector>& OutContourVerts, TArray<int32>& OutVertsRegions)
+void FNNContourGeneration::BuildRawContour(const FNNOpenSpan* StartSpan, int32 StartDir, TArray<FNNContourVertex>& OutContourVerts, TArray<int32>& OutVertsRegions) const
 {
-	FNNOpenSpan* CurrentSpan = StartSpan;
+	const FNNOpenSpan* CurrentSpan = StartSpan;
 	int32 Dir = StartDir;
 
 	int32 LoopCount = 0;
@@ -124,8 +160,6 @@ void FNNContourGeneration::BuildRawContour(FNNOpenSpan* StartSpan, int32 StartDi
 			OutContourVerts.Emplace(EdgeX, EdgeY, EdgeZ);
 			OutVertsRegions.Add(RegionNeighbour);
 
-			// Remove the flag to mark it as already processed
-			CurrentSpan->NeighbourFlags &= ~(1 << Dir);
 			Dir = (Dir + 1) % 4; // Rotate clockwise
 		}
 		else
@@ -144,9 +178,8 @@ void FNNContourGeneration::BuildRawContour(FNNOpenSpan* StartSpan, int32 StartDi
 	ensureMsgf(false, TEXT("Something went wrong"));
 }
 
-void FNNContourGeneration::GenerateSimplifiedContour(const TArray<FVector>& SourceVertexes,
-	const TArray<int32>& SourceRegions, TArray<FVector>& OutSimplifiedVertexes,
-	TArray<int32>& OutSimplifiedVertexesIndexes) const
+void FNNContourGeneration::GenerateSimplifiedContour(const TArray<FNNContourVertex>& SourceVertexes,
+	const TArray<int32>& SourceRegions, TArray<int32>& OutSimplifiedIndexes) const
 {
 	bool bNoConnections = true;
 	for (const int32 Region : SourceRegions)
@@ -165,15 +198,15 @@ void FNNContourGeneration::GenerateSimplifiedContour(const TArray<FVector>& Sour
 		int32 UpperRightIndex = 0;
 		for (int32 i = 0; i < SourceVertexes.Num(); ++i)
 		{
-			const FVector& Vertex = SourceVertexes[i];
+			const FNNContourVertex& Vertex = SourceVertexes[i];
 
-			const FVector& LowerLeft = SourceVertexes[LowerLeftIndex];
+			const FNNContourVertex& LowerLeft = SourceVertexes[LowerLeftIndex];
 			if (Vertex.X < LowerLeft.X || (Vertex.X == LowerLeft.X && Vertex.Y < LowerLeft.Y))
 			{
 				LowerLeftIndex = i;
 			}
 
-			const FVector& UpperRight = SourceVertexes[UpperRightIndex];
+			const FNNContourVertex& UpperRight = SourceVertexes[UpperRightIndex];
 			// TODO (Ignacio) I don't know if I should check (Vertex.X > UpperRight.X) or (Vertex.X >= UpperRight.X)
 			if (Vertex.X > UpperRight.X || (Vertex.X == UpperRight.X && Vertex.Y > UpperRight.Y))
 			{
@@ -181,10 +214,8 @@ void FNNContourGeneration::GenerateSimplifiedContour(const TArray<FVector>& Sour
 			}
 		}
 
-		OutSimplifiedVertexes.Add(SourceVertexes[LowerLeftIndex]);
-		OutSimplifiedVertexesIndexes.Add(LowerLeftIndex);
-		OutSimplifiedVertexes.Add(SourceVertexes[UpperRightIndex]);
-		OutSimplifiedVertexesIndexes.Add(UpperRightIndex);
+		OutSimplifiedIndexes.Add(LowerLeftIndex);
+		OutSimplifiedIndexes.Add(UpperRightIndex);
 	}
 	else
 	{
@@ -196,33 +227,32 @@ void FNNContourGeneration::GenerateSimplifiedContour(const TArray<FVector>& Sour
 			const int32 NextRegion = SourceRegions[(i + 1) % SourceRegions.Num()];
 			if (CurrentRegion != NextRegion)
 			{
-				OutSimplifiedVertexes.Add(SourceVertexes[i]);
-				OutSimplifiedVertexesIndexes.Add(i);
+				OutSimplifiedIndexes.Add(i);
 			}
 		}
 	}
 
-	RemoveVerticalSegments(OutSimplifiedVertexes, OutSimplifiedVertexesIndexes);
-	RemoveIntersectionSegments(OutSimplifiedVertexes, OutSimplifiedVertexesIndexes, SourceRegions);
+	RemoveVerticalSegments(SourceVertexes, OutSimplifiedIndexes);
+	RemoveIntersectionSegments(SourceVertexes, OutSimplifiedIndexes, SourceRegions);
 }
 
-int32 FNNContourGeneration::GetCornerHeight(FNNOpenSpan& Span, int32 Direction) const
+int32 FNNContourGeneration::GetCornerHeight(const FNNOpenSpan& Span, int32 Direction) const
 {
 	int32 MaxFloor = Span.MinHeight;
-	FNNOpenSpan* DiagonalNeighbour = nullptr;
+	const FNNOpenSpan* DiagonalNeighbour = nullptr;
 
 	// Rotate clockwise
 	const int32 DirectionOffset = (Direction + 1) % 4;
 
 	// Check axis neighbour in the current direction
-	if (FNNOpenSpan* Neighbour = Span.Neighbours[Direction])
+	if (const FNNOpenSpan* Neighbour = Span.Neighbours[Direction])
 	{
 		MaxFloor = FMath::Max(MaxFloor, Neighbour->MinHeight);
 		DiagonalNeighbour = Neighbour->Neighbours[DirectionOffset];
 	}
 
 	// Check neighbour in clockwise direction
-	if (FNNOpenSpan* Neighbour = Span.Neighbours[DirectionOffset])
+	if (const FNNOpenSpan* Neighbour = Span.Neighbours[DirectionOffset])
 	{
 		MaxFloor = FMath::Max(MaxFloor, Neighbour->MinHeight);
 		if (!DiagonalNeighbour)
@@ -240,168 +270,154 @@ int32 FNNContourGeneration::GetCornerHeight(FNNOpenSpan& Span, int32 Direction)
 	return MaxFloor;
 }
 
-void FNNContourGeneration::MatchNullRegionEdges(const TArray<FVector>& SourceVertexes, const TArray<int32>& SourceRegions,
-	TArray<FVector>& SimplifiedVertexes, TArray<int32>& SimplifiedVertexIndexes) const
+void FNNContourGeneration::SubdivideNullRegionEdges(const TArray<FNNContourVertex>& SourceVertexes,
+	const TArray<int32>& SourceRegions, const TArray<int32>& MandatoryIndexes, TArray<TPair<int32, int32>>& SegmentStack,
+	TArray<int32>& OutSimplifiedIndexes) const
 {
-	if (SourceVertexes.Num() == 0)
+	const int32 SourceVertexesNum = SourceVertexes.Num();
+	const int32 MandatoryNum = MandatoryIndexes.Num();
+	if (SourceVertexesNum == 0 || MandatoryNum == 0)
 	{
 		return;
 	}
 
-	int32 IndexVertexA = 0;
+	const float DeviationThresholdSqr = ContourDeviationThreshold * ContourDeviationThreshold;
+	const float MaxEdgeLengthSqr = MaxEdgeLength * MaxEdgeLength;
 
-	while (IndexVertexA < SimplifiedVertexes.Num())
+	for (int32 i = 0; i < MandatoryNum; ++i)
 	{
-		const int32 IndexVertexB = (IndexVertexA + 1) % SimplifiedVertexes.Num();
-
-		// The begging of the segment
-		const FVector& VertexA = SimplifiedVertexes[IndexVertexA];
-		const int32 SourceVertexAIndex = SimplifiedVertexIndexes[IndexVertexA];
-
-		// The end of the segment
-		const FVector& VertexB = SimplifiedVertexes[IndexVertexB];
-		const int32 SourceVertexBIndex = SimplifiedVertexIndexes[IndexVertexB];
+		const int32 StartIndex = MandatoryIndexes[i];
+		int32 EndIndex = MandatoryIndexes[(i + 1) % MandatoryNum];
+		// Unwrap the end so the segment always moves forward through the source vertexes
+		if (EndIndex <= StartIndex)
+		{
+			EndIndex += SourceVertexesNum;
+		}
 
-		// The vertex just after the current vertex in the source vertex list
-		int32 TestVertexIndex = (SourceVertexAIndex + 1) % SourceVertexes.Num();
-		float MaxDeviation = 0.0f;
+		// Edges that connect with other regions keep only their mandatory vertexes
+		if (SourceRegions[(StartIndex + 1) % SourceVertexesNum] != INDEX_NONE)
+		{
+			OutSimplifiedIndexes.Add(StartIndex);
+			continue;
+		}
 
-		int32 VertexIndexToAdd = INDEX_NONE;
-		// The TestVertex is part of a null region edge
-		if (SourceRegions[TestVertexIndex] == INDEX_NONE)
+		// Splits the segments depth first. The end segment is pushed before the start segment so the start of each
+		// final segment is emitted in contour order
+		SegmentStack.Reset();
+		SegmentStack.Emplace(StartIndex, EndIndex);
+		while (SegmentStack.Num() > 0)
 		{
-			while (TestVertexIndex != SourceVertexBIndex)
+			const TPair<int32, int32> Segment = SegmentStack.Pop(false);
+			const int32 SegmentStart = Segment.Key;
+			const int32 SegmentEnd = Segment.Value;
+			const FVector VertexA = SourceVertexes[SegmentStart % SourceVertexesNum].ToVector();
+			const FVector VertexB = SourceVertexes[SegmentEnd % SourceVertexesNum].ToVector();
+
+			// Find the source vertex that deviates the most from the segment
+			int32 SplitIndex = INDEX_NONE;
+			float MaxDeviation = DeviationThresholdSqr;
+			for (int32 TestIndex = SegmentStart + 1; TestIndex < SegmentEnd; ++TestIndex)
 			{
-				const float Deviation = FMath::PointDistToSegmentSquared(SourceVertexes[TestVertexIndex], VertexA, VertexB);
+				const float Deviation = FMath::PointDistToSegmentSquared(SourceVertexes[TestIndex % SourceVertexesNum].ToVector(), VertexA, VertexB);
 				if (Deviation > MaxDeviation)
 				{
 					MaxDeviation = Deviation;
-					VertexIndexToAdd = TestVertexIndex;
+					SplitIndex = TestIndex;
 				}
-				TestVertexIndex = (TestVertexIndex + 1) % SourceVertexes.Num();
 			}
-		}
 
-		if (VertexIndexToAdd != INDEX_NONE && MaxDeviation > (ContourDeviationThreshold * ContourDeviationThreshold))
-		{
-			const FVector& VectorToAdd = SourceVertexes[VertexIndexToAdd];
-			SimplifiedVertexes.Insert(VectorToAdd, IndexVertexA + 1);
-			SimplifiedVertexIndexes.Insert(VertexIndexToAdd, IndexVertexA + 1);
-		}
-		else
-		{
-			++IndexVertexA;
+			// The segment follows the geometry but it might still be too long. Split it by the source vertex closer to the middle
+			if (SplitIndex == INDEX_NONE && MaxEdgeLength > 0.0f && FVector::DistSquared(VertexA, VertexB) > MaxEdgeLengthSqr)
+			{
+				const int32 MiddleIndex = SegmentStart + (SegmentEnd - SegmentStart) / 2;
+				if (MiddleIndex != SegmentStart)
+				{
+					SplitIndex = MiddleIndex;
+				}
+			}
+
+			if (SplitIndex == INDEX_NONE)
+			{
+				OutSimplifiedIndexes.Add(SegmentStart % SourceVertexesNum);
+			}
+			else
+			{
+				SegmentStack.Emplace(SplitIndex, SegmentEnd);
+				SegmentStack.Emplace(SegmentStart, SplitIndex);
+			}
 		}
 	}
 }
 
-void FNNContourGeneration::NullRegionMaxEdge(const TArray<FVector>& SourceVertexes, const TArray<int32>& SourceRegions,
-	TArray<FVector>& SimplifiedVertexes, TArray<int32>& SimplifiedVertexesIndexes) const
+void FNNContourGeneration::RemoveVerticalSegments(const TArray<FNNContourVertex>& SourceVertexes, TArray<int32>& Indexes) const
 {
-	const float MaxEdgeLengthSqr = MaxEdgeLength * MaxEdgeLength;
-	if (MaxEdgeLength <= 0 || SourceVertexes.Num() == 0)
+	if (Indexes.Num() < 2)
 	{
 		return;
 	}
 
-	const int32 SourceVertexesNum = SourceVertexes.Num();
-
-	int32 VertexAIndex = 0;
-	// Inserts vertexes into null region edges that are too long
-	// Insets the vertex that is closer to the middle of the edge
-	while (VertexAIndex < SimplifiedVertexes.Num())
+	// Compact the indexes in place keeping the first vertex of each column
+	int32 KeptNum = 1;
+	for (int32 i = 1; i < Indexes.Num(); ++i)
 	{
-		const int32 VertexBIndex = (VertexAIndex + 1) % SimplifiedVertexes.Num();
-
-		const FVector& VectorA = SimplifiedVertexes[VertexAIndex];
-		const int32 SourceVectorAIndex = SimplifiedVertexesIndexes[VertexAIndex];
-
-		const FVector& VectorB = SimplifiedVertexes[VertexBIndex];
-		const int32 SourceVectorBIndex = SimplifiedVertexesIndexes[VertexBIndex];
-
-		int32 NewVertexIndex = INDEX_NONE;
-		const int32 TestVertexIndex = (SourceVectorAIndex + 1) % SourceVertexesNum;
-		if (SourceRegions[TestVertexIndex] == INDEX_NONE)
-		{
-			if (FVector::DistSquared(VectorA, VectorB) > MaxEdgeLengthSqr)
-			{
-				// The current edge is too long and needs to be split
-				const int32 IndexDistance = SourceVectorBIndex < SourceVectorAIndex
-					                            ? SourceVectorBIndex + (SourceVertexesNum - SourceVectorAIndex)
-					                            : SourceVectorBIndex - SourceVectorAIndex;
-				NewVertexIndex = (SourceVectorAIndex + IndexDistance / 2) % SourceVertexesNum;
-			}
-		}
-
-		if (NewVertexIndex != INDEX_NONE && NewVertexIndex != SourceVectorAIndex && NewVertexIndex != SourceVectorBIndex)
+		if (!SourceVertexes[Indexes[i]].IsSameColumn(SourceVertexes[Indexes[KeptNum - 1]]))
 		{
-			SimplifiedVertexes.Insert(SourceVertexes[NewVertexIndex], VertexAIndex + 1);
-			SimplifiedVertexesIndexes.Insert(NewVertexIndex, VertexAIndex + 1);
-		}
-		else
-		{
-			++VertexAIndex;
+			Indexes[KeptNum++] = Indexes[i];
 		}
 	}
-}
+	Indexes.SetNum(KeptNum, false);
 
-void FNNContourGeneration::RemoveVerticalSegments(TArray<FVector>& Vertexes, TArray<int32>& Indexes) const
-{
-	for (int32 i = 0; i < Vertexes.Num();)
+	// The last vertex closes the contour with the first one
+	int32 LeadingVertical = 0;
+	while (LeadingVertical < Indexes.Num() - 1 && SourceVertexes[Indexes.Last()].IsSameColumn(SourceVertexes[Indexes[LeadingVertical]]))
 	{
-		const int32 NextVertexIndex = (i + 1) % Vertexes.Num();
-		const FVector& NextVertex = Vertexes[NextVertexIndex];
-		const FVector& Vertex = Vertexes[i];
-		if (Vertex.X == NextVertex.X && Vertex.Y == NextVertex.Y)
-		{
-			Vertexes.RemoveAt(NextVertexIndex);
-			Indexes.RemoveAt(NextVertexIndex);
-		}
-		else
-		{
-			++i;
-		}
-	}	
+		++LeadingVertical;
+	}
+	if (LeadingVertical > 0)
+	{
+		Indexes.RemoveAt(0, LeadingVertical, false);
+	}
 }
 
-void FNNContourGeneration::RemoveIntersectionSegments(TArray<FVector>& Vertexes, TArray<int32>& SimplifiedIndexes, const TArray<int32>& SourceRegions) const
+void FNNContourGeneration::RemoveIntersectionSegments(const TArray<FNNContourVertex>& SourceVertexes, TArray<int32>& SimplifiedIndexes, const TArray<int32>& SourceRegions) const
 {
-	for (int32 i = 0; i < Vertexes.Num(); ++i)
+	for (int32 i = 0; i < SimplifiedIndexes.Num(); ++i)
 	{
-		const int32 NextVertexIndex = (i + 1) % Vertexes.Num();
+		const int32 NextVertexIndex = (i + 1) % SimplifiedIndexes.Num();
 		if (SourceRegions[SimplifiedIndexes[NextVertexIndex]] != INDEX_NONE)
 		{
-			i += RemoveIntersectionSegments(i, NextVertexIndex, Vertexes, SimplifiedIndexes, SourceRegions);
+			i += RemoveIntersectionSegments(i, NextVertexIndex, SourceVertexes, SimplifiedIndexes, SourceRegions);
 		}
 	}
 }
 
 int32 FNNContourGeneration::RemoveIntersectionSegments(int32 StartVertexIndex, int32 EndVertexIndex,
-                                                       TArray<FVector>& Vertexes, TArray<int32>& SimplifiedIndexes, const TArray<int32>& SourceRegions) const
+                                                       const TArray<FNNContourVertex>& SourceVertexes, TArray<int32>& SimplifiedIndexes, const TArray<int32>& SourceRegions) const
 {
-	if (Vertexes.Num() < 4)
+	if (SimplifiedIndexes.Num() < 4)
 	{
 		return 0;
 	}
 
 	int32 Offset = 0;
-	int32 VertexIndex = (EndVertexIndex + 2) % Vertexes.Num();
-	int32 VertexIndexMinus = (EndVertexIndex + 1) % Vertexes.Num();
+	int32 VertexIndex = (EndVertexIndex + 2) % SimplifiedIndexes.Num();
+	int32 VertexIndexMinus = (EndVertexIndex + 1) % SimplifiedIndexes.Num();
 	while (VertexIndex != StartVertexIndex)
 	{
-		const FVector& StartVertex = Vertexes[StartVertexIndex];
-		const FVector& EndVertex = Vertexes[EndVertexIndex];
+		const FVector StartVertex = SourceVertexes[SimplifiedIndexes[StartVertexIndex]].ToVector();
+		const FVector EndVertex = SourceVertexes[SimplifiedIndexes[EndVertexIndex]].ToVector();
+		const FVector SegmentStart = SourceVertexes[SimplifiedIndexes[VertexIndexMinus]].ToVector();
+		const FVector SegmentEnd = SourceVertexes[SimplifiedIndexes[VertexIndex]].ToVector();
 		FVector IntersectionPoint;
 		const int32 VertexRegion = SourceRegions[SimplifiedIndexes[VertexIndex]];
-		const int32 NextVertexRegion = SourceRegions[SimplifiedIndexes[(VertexIndex + 1) % Vertexes.Num()]];
+		const int32 NextVertexRegion = SourceRegions[SimplifiedIndexes[(VertexIndex + 1) % SimplifiedIndexes.Num()]];
 		// Only remove the vertex if both edges it belongs connect to the null region
 		// And it belongs to a segment that intersect the segment being tested against
 		if (VertexRegion == INDEX_NONE
 			&& NextVertexRegion == INDEX_NONE
-			&& FMath::SegmentIntersection2D(StartVertex, EndVertex, Vertexes[VertexIndexMinus], Vertexes[VertexIndex], IntersectionPoint))
+			&& FMath::SegmentIntersection2D(StartVertex, EndVertex, SegmentStart, SegmentEnd, IntersectionPoint))
 		{
 			// Remove the null region segment
-			Vertexes.RemoveAt(VertexIndex);
 			SimplifiedIndexes.RemoveAt(VertexIndex);
 			if (VertexIndex < StartVertexIndex || VertexIndex < EndVertexIndex)
 			{
@@ -413,19 +429,15 @@ int32 FNNContourGeneration::RemoveIntersectionSegments(int32 StartVertexIndex, i
 			{
 				--VertexIndexMinus;
 			}
-			VertexIndex = VertexIndex % Vertexes.Num();
+			VertexIndex = VertexIndex % SimplifiedIndexes.Num();
 		}
 		else
 		{
 			// Move to the next segment
 			VertexIndexMinus = VertexIndex;
-			VertexIndex = (VertexIndex + 1) % Vertexes.Num();
+			VertexIndex = (VertexIndex + 1) % SimplifiedIndexes.Num();
 		}
 	}
 
 	return Offset;
 }
-
-
-
-
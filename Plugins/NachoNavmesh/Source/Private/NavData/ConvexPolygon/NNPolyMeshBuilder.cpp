@@ -1,16 +1,15 @@
 ﻿#include "NavData/ConvexPolygon/NNPolyMeshBuilder.h"
 
-// UE Includes
-#include "CompGeom/PolygonTriangulation.h"
-
 // NN Includes
 #include "NavData/Contour/NNContourGeneration.h"
 
 namespace NNPolyMeshBuilderVariables
 {
-	constexpr int32 MaxVertexesPerPoly = 5;
+	constexpr int32 MaxVertexesPerPoly = NNNavAreas::MaxPolygonVertexes;
 	constexpr int32 TriangulationFlag = 0x80000000;
 	constexpr int32 TriangulationDeFlag = 0x0fffffff;
+	/** Maximum height difference in cells between two contour vertexes of the same column for them to be welded */
+	constexpr int32 WeldHeightTolerance = 2;
 }
 
 namespace
@@ -25,28 +24,313 @@ namespace
 		return Index - 1 >= 0 ? Index - 1 : Num - 1;
 	}
 
+	/** Returns the same key for an edge regardless of its direction */
+	uint64 GetEdgeKey(int32 VertexA, int32 VertexB)
+	{
+		const uint64 MinVertex = FMath::Min(VertexA, VertexB);
+		const uint64 MaxVertex = FMath::Max(VertexA, VertexB);
+		return (MinVertex << 32) | MaxVertex;
+	}
+
+	/** Welds the contour vertexes into the polygon mesh through a spatial hash of their grid column.
+	 * Vertexes in the same column closer in height than the tolerance share the same index */
+	struct FVertexWelder
+	{
+		FVertexWelder(FNNPolygonMesh& InPolygonMesh, int32 MaxVertexes) : PolygonMesh(InPolygonMesh)
+		{
+			ColumnFirstVertex.Reserve(MaxVertexes);
+			NextVertex.Reserve(MaxVertexes);
+			GridVertexes.Reserve(MaxVertexes);
+		}
+
+		/** Returns the index of the vertex in the polygon mesh, adding it if no vertex could be welded */
+		int32 AddVertex(const FNNContourVertex& Vertex)
+		{
+			const uint32 ColumnKey = (static_cast<uint32>(static_cast<uint16>(Vertex.X)) << 16) | static_cast<uint16>(Vertex.Y);
+			int32* FirstVertex = ColumnFirstVertex.Find(ColumnKey);
+			if (FirstVertex)
+			{
+				for (int32 VertexIndex = *FirstVertex; VertexIndex != INDEX_NONE; VertexIndex = NextVertex[VertexIndex])
+				{
+					if (FMath::Abs(GridVertexes[VertexIndex].Z - Vertex.Z) <= NNPolyMeshBuilderVariables::WeldHeightTolerance)
+					{
+						return VertexIndex;
+					}
+				}
+			}
+
+			const int32 NewIndex = PolygonMesh.Vertexes.Add(Vertex.ToVector());
+			GridVertexes.Add(Vertex);
+			// Chain the new vertex at the start of its column
+			NextVertex.Add(FirstVertex ? *FirstVertex : INDEX_NONE);
+			ColumnFirstVertex.Add(ColumnKey, NewIndex);
+			return NewIndex;
+		}
+
+	private:
+		FNNPolygonMesh& PolygonMesh;
+		/** The last vertex added to each grid column */
+		TMap<uint32, int32> ColumnFirstVertex;
+		/** The next vertex in the same column of each vertex */
+		TArray<int32> NextVertex;
+		TArray<FNNContourVertex> GridVertexes;
+	};
+
+	/** Twice the signed 2D area of the triangle ABC. Exact for the grid coordinates of the contours */
+	int64 GetDoubleArea2D(const FNNContourVertex& A, const FNNContourVertex& B, const FNNContourVertex& C)
+	{
+		return static_cast<int64>(B.X - A.X) * (C.Y - A.Y) - static_cast<int64>(C.X - A.X) * (B.Y - A.Y);
+	}
+
+	/** Returns whether C is left of the line AB following the winding of the contours */
+	bool IsLeft(const FNNContourVertex& A, const FNNContourVertex& B, const FNNContourVertex& C)
+	{
+		return GetDoubleArea2D(A, B, C) < 0;
+	}
+
+	/** Returns whether C is left of the line AB or on it */
+	bool IsLeftOn(const FNNContourVertex& A, const FNNContourVertex& B, const FNNContourVertex& C)
+	{
+		return GetDoubleArea2D(A, B, C) <= 0;
+	}
+
+	bool IsCollinear(const FNNContourVertex& A, const FNNContourVertex& B, const FNNContourVertex& C)
+	{
+		return GetDoubleArea2D(A, B, C) == 0;
+	}
+
+	bool IsSameVertex2D(const FNNContourVertex& A, const FNNContourVertex& B)
+	{
+		return A.X == B.X && A.Y == B.Y;
+	}
+
+	/** Returns whether the segments AB and CD cross each other in a point interior to both */
+	bool IntersectsProperly(const FNNContourVertex& A, const FNNContourVertex& B, const FNNContourVertex& C, const FNNContourVertex& D)
+	{
+		if (IsCollinear(A, B, C) || IsCollinear(A, B, D) || IsCollinear(C, D, A) || IsCollinear(C, D, B))
+		{
+			return false;
+		}
+		return (IsLeft(A, B, C) != IsLeft(A, B, D)) && (IsLeft(C, D, A) != IsLeft(C, D, B));
+	}
+
+	/** Returns whether C is collinear with AB and lies between A and B */
+	bool IsBetween(const FNNContourVertex& A, const FNNContourVertex& B, const FNNContourVertex& C)
+	{
+		if (!IsCollinear(A, B, C))
+		{
+			return false;
+		}
+		if (A.X != B.X)
+		{
+			return (A.X <= C.X && C.X <= B.X) || (A.X >= C.X && C.X >= B.X);
+		}
+		return (A.Y <= C.Y && C.Y <= B.Y) || (A.Y >= C.Y && C.Y >= B.Y);
+	}
+
+	/** Returns whether the segments AB and CD touch each other */
+	bool Intersects(const FNNContourVertex& A, const FNNContourVertex& B, const FNNContourVertex& C, const FNNContourVertex& D)
+	{
+		return IntersectsProperly(A, B, C, D)
+			|| IsBetween(A, B, C) || IsBetween(A, B, D) || IsBetween(C, D, A) || IsBetween(C, D, B);
+	}
+
+	/** Returns whether the Point is left of the line following the winding of the contours. Only uses the X and Y axis */
 	bool IsPointLeftFromLine(const FVector& Point, const FVector& LineStart, const FVector& LineEnd)
 	{
-		const float CrossProduct = FVector::CrossProduct(Point, LineStart - LineEnd).Size();
-		return CrossProduct > 0;
+		const float CrossProduct = (Point.X - LineStart.X) * (LineEnd.Y - LineStart.Y) - (LineEnd.X - LineStart.X) * (Point.Y - LineStart.Y);
+		return CrossProduct < 0.0f;
 	}
+
+	/** A pair of polygons that can be merged through their shared edge */
+	struct FMergeCandidate
+	{
+		float EdgeLengthSqr = 0.0f;
+		int32 PolyA = INDEX_NONE;
+		int32 PolyB = INDEX_NONE;
+		/** The merges done by each polygon when the candidate was found. Used to discard outdated candidates */
+		int32 VersionA = 0;
+		int32 VersionB = 0;
+	};
+
+	/** Sorts the heap so the longest edge is merged first */
+	struct FMergeCandidatePredicate
+	{
+		bool operator()(const FMergeCandidate& A, const FMergeCandidate& B) const
+		{
+			return A.EdgeLengthSqr > B.EdgeLengthSqr;
+		}
+	};
 }
 
-int32 FNNPolyMeshBuilder::Triangulate(const TArray<FVector>& ContourVertexes, TArray<int32>& VertexesIndexes,
-                                      FNNPolygonMesh& PolygonMesh)
+bool FNNPolyMeshBuilder::Triangulate(const TArray<FNNContourVertex>& ContourVertexes, TArray<int32>& VertexesIndexes,
+                                     TArray<int32>& OutTriangles)
 {
+	constexpr int32 Flag = NNPolyMeshBuilderVariables::TriangulationFlag;
+	constexpr int32 DeFlag = NNPolyMeshBuilderVariables::TriangulationDeFlag;
+
 	// Loop through all vertices flagging all indices that represent a center vertex of a valid new triangle
-	for (int i = 0; i < VertexesIndexes.Num(); ++i)
+	for (int32 i = 0; i < VertexesIndexes.Num(); ++i)
 	{
 		const int32 iPlus1 = GetNextIndex(i, VertexesIndexes.Num());
 		const int32 iPlus2 = GetNextIndex(iPlus1, VertexesIndexes.Num());
-		if (IsValidPartition(i, iPlus2, ContourVertexes, VertexesIndexes))
+		if (IsDiagonal(i, iPlus2, ContourVertexes, VertexesIndexes, false))
 		{
-			// TODO
+			VertexesIndexes[iPlus1] |= Flag;
 		}
 	}
-	
-	return 0;
+
+	while (VertexesIndexes.Num() > 3)
+	{
+		// Cut the ear with the shortest diagonal
+		int32 MinIndex = FindShortestDiagonal(ContourVertexes, VertexesIndexes, false);
+		if (MinIndex == INDEX_NONE)
+		{
+			// The contour might have overlapping segments. Loosen the tests so a diagonal can still be found
+			MinIndex = FindShortestDiagonal(ContourVertexes, VertexesIndexes, true);
+			if (MinIndex == INDEX_NONE)
+			{
+				// The contour is degenerated, the simplification was probably too aggressive
+				return false;
+			}
+		}
+
+		int32 i = MinIndex;
+		int32 iPlus1 = GetNextIndex(i, VertexesIndexes.Num());
+		const int32 iPlus2 = GetNextIndex(iPlus1, VertexesIndexes.Num());
+		OutTriangles.Add(VertexesIndexes[i] & DeFlag);
+		OutTriangles.Add(VertexesIndexes[iPlus1] & DeFlag);
+		OutTriangles.Add(VertexesIndexes[iPlus2] & DeFlag);
+
+		// Remove the center vertex of the ear and update the flags of the vertexes next to it
+		VertexesIndexes.RemoveAt(iPlus1, 1, false);
+		if (iPlus1 >= VertexesIndexes.Num())
+		{
+			iPlus1 = 0;
+		}
+		i = GetPreviousIndex(iPlus1, VertexesIndexes.Num());
+
+		if (IsDiagonal(GetPreviousIndex(i, VertexesIndexes.Num()), iPlus1, ContourVertexes, VertexesIndexes, false))
+		{
+			VertexesIndexes[i] |= Flag;
+		}
+		else
+		{
+			VertexesIndexes[i] &= DeFlag;
+		}
+
+		if (IsDiagonal(i, GetNextIndex(iPlus1, VertexesIndexes.Num()), ContourVertexes, VertexesIndexes, false))
+		{
+			VertexesIndexes[iPlus1] |= Flag;
+		}
+		else
+		{
+			VertexesIndexes[iPlus1] &= DeFlag;
+		}
+	}
+
+	// Append the remaining triangle
+	OutTriangles.Add(VertexesIndexes[0] & DeFlag);
+	OutTriangles.Add(VertexesIndexes[1] & DeFlag);
+	OutTriangles.Add(VertexesIndexes[2] & DeFlag);
+	return true;
+}
+
+int32 FNNPolyMeshBuilder::FindShortestDiagonal(const TArray<FNNContourVertex>& ContourVertexes,
+                                               const TArray<int32>& VertexesIndexes, bool bLoose)
+{
+	constexpr int32 DeFlag = NNPolyMeshBuilderVariables::TriangulationDeFlag;
+	const int32 IndexesNum = VertexesIndexes.Num();
+
+	int64 MinLength = INDEX_NONE;
+	int32 MinIndex = INDEX_NONE;
+	for (int32 i = 0; i < IndexesNum; ++i)
+	{
+		const int32 iPlus1 = GetNextIndex(i, IndexesNum);
+		const int32 iPlus2 = GetNextIndex(iPlus1, IndexesNum);
+		const bool bValidDiagonal = bLoose
+			                            ? IsDiagonal(i, iPlus2, ContourVertexes, VertexesIndexes, true)
+			                            : (VertexesIndexes[iPlus1] & NNPolyMeshBuilderVariables::TriangulationFlag) != 0;
+		if (!bValidDiagonal)
+		{
+			continue;
+		}
+
+		const FNNContourVertex& Start = ContourVertexes[VertexesIndexes[i] & DeFlag];
+		const FNNContourVertex& End = ContourVertexes[VertexesIndexes[iPlus2] & DeFlag];
+		const int64 DeltaX = End.X - Start.X;
+		const int64 DeltaY = End.Y - Start.Y;
+		const int64 Length = DeltaX * DeltaX + DeltaY * DeltaY;
+		if (MinLength < 0 || Length < MinLength)
+		{
+			MinLength = Length;
+			MinIndex = i;
+		}
+	}
+	return MinIndex;
+}
+
+bool FNNPolyMeshBuilder::IsDiagonal(int32 IndexA, int32 IndexB, const TArray<FNNContourVertex>& ContourVertexes,
+                                    const TArray<int32>& VertexesIndexes, bool bLoose)
+{
+	return LiesWithinInternalAngle(IndexA, IndexB, ContourVertexes, VertexesIndexes, bLoose)
+		&& !HasIllegalEdgeIntersection(IndexA, IndexB, ContourVertexes, VertexesIndexes, bLoose);
+}
+
+bool FNNPolyMeshBuilder::LiesWithinInternalAngle(int32 IndexA, int32 IndexB, const TArray<FNNContourVertex>& ContourVertexes,
+                                                 const TArray<int32>& VertexesIndexes, bool bLoose)
+{
+	constexpr int32 DeFlag = NNPolyMeshBuilderVariables::TriangulationDeFlag;
+	const FNNContourVertex& VertexA = ContourVertexes[VertexesIndexes[IndexA] & DeFlag];
+	const FNNContourVertex& VertexB = ContourVertexes[VertexesIndexes[IndexB] & DeFlag];
+	const FNNContourVertex& VertexAMinus = ContourVertexes[VertexesIndexes[GetPreviousIndex(IndexA, VertexesIndexes.Num())] & DeFlag];
+	const FNNContourVertex& VertexAPlus = ContourVertexes[VertexesIndexes[GetNextIndex(IndexA, VertexesIndexes.Num())] & DeFlag];
+
+	// The angle AMinus->A->APlus is convex. The diagonal must be strictly inside it
+	if (IsLeftOn(VertexAMinus, VertexA, VertexAPlus))
+	{
+		return bLoose
+			       ? IsLeftOn(VertexA, VertexB, VertexAMinus) && IsLeftOn(VertexB, VertexA, VertexAPlus)
+			       : IsLeft(VertexA, VertexB, VertexAMinus) && IsLeft(VertexB, VertexA, VertexAPlus);
+	}
+
+	// The angle is reflex. The diagonal must not be inside the external angle
+	return !(IsLeftOn(VertexA, VertexB, VertexAPlus) && IsLeftOn(VertexB, VertexA, VertexAMinus));
+}
+
+bool FNNPolyMeshBuilder::HasIllegalEdgeIntersection(int32 IndexA, int32 IndexB, const TArray<FNNContourVertex>& ContourVertexes,
+                                                    const TArray<int32>& VertexesIndexes, bool bLoose)
+{
+	constexpr int32 DeFlag = NNPolyMeshBuilderVariables::TriangulationDeFlag;
+	const FNNContourVertex& DiagonalStart = ContourVertexes[VertexesIndexes[IndexA] & DeFlag];
+	const FNNContourVertex& DiagonalEnd = ContourVertexes[VertexesIndexes[IndexB] & DeFlag];
+
+	for (int32 Edge = 0; Edge < VertexesIndexes.Num(); ++Edge)
+	{
+		const int32 EdgeNext = GetNextIndex(Edge, VertexesIndexes.Num());
+		// Skip the edges connected to the diagonal
+		if (Edge == IndexA || EdgeNext == IndexA || Edge == IndexB || EdgeNext == IndexB)
+		{
+			continue;
+		}
+
+		const FNNContourVertex& EdgeStart = ContourVertexes[VertexesIndexes[Edge] & DeFlag];
+		const FNNContourVertex& EdgeEnd = ContourVertexes[VertexesIndexes[EdgeNext] & DeFlag];
+		if (IsSameVertex2D(DiagonalStart, EdgeStart) || IsSameVertex2D(DiagonalEnd, EdgeStart)
+			|| IsSameVertex2D(DiagonalStart, EdgeEnd) || IsSameVertex2D(DiagonalEnd, EdgeEnd))
+		{
+			continue;
+		}
+
+		const bool bIntersects = bLoose
+			                         ? IntersectsProperly(DiagonalStart, DiagonalEnd, EdgeStart, EdgeEnd)
+			                         : Intersects(DiagonalStart, DiagonalEnd, EdgeStart, EdgeEnd);
+		if (bIntersects)
+		{
+			return true;
+		}
+	}
+	return false;
 }
 
 void FNNPolyMeshBuilder::GenerateConvexPolygon(const TArray<FNNContour>& Contours, FNNPolygonMesh& PolygonMesh)
@@ -72,111 +356,382 @@ void FNNPolyMeshBuilder::GenerateConvexPolygon(const TArray<FNNContour>& Contour
 	PolygonMesh.Vertexes.Reserve(SourceVertexesNum);
 	PolygonMesh.PolygonIndexes.Reserve(MaxPossiblePolygons);
 
+	// Adjacent regions share the indexes of their portal edges so BuildPolygonNeighbours can link them by edge key
+	FVertexWelder VertexWelder(PolygonMesh, SourceVertexesNum);
+
 	TArray<int32> ContourToPolyMeshIndices;
 	ContourToPolyMeshIndices.Reserve(MaxVertexesPerContour);
-
+	TArray<int32> WorkingIndices;
+	WorkingIndices.Reserve(MaxVertexesPerContour);
+	TArray<int32> Triangles;
+	Triangles.Reserve((MaxVertexesPerContour - 2) * 3);
 
 	for (const FNNContour& Contour : Contours)
 	{
 		check(Contour.SimplifiedVertexes.Num() > 2);
 
-		TArray<int32> WorkingIndices;
+		ContourToPolyMeshIndices.Reset();
+		for (const FNNContourVertex& SimplifiedVertex : Contour.SimplifiedVertexes)
+		{
+			ContourToPolyMeshIndices.Add(VertexWelder.AddVertex(SimplifiedVertex));
+		}
+
+		WorkingIndices.Reset();
 		for (int32 i = 0; i < Contour.SimplifiedVertexes.Num(); ++i)
 		{
 			WorkingIndices.Add(i);
 		}
 
-		// Triangulate(Contour.SimplifiedVertexes, WorkingIndices, PolygonMesh);
-
-		TArray<FVector3<float>> Vectors3D;
-		Vectors3D.Reserve(Contour.SimplifiedVertexes.Num());
-		for (const FVector& SimplifiedVertex : Contour.SimplifiedVertexes)
+		const int32 FirstContourPolygon = PolygonMesh.PolygonIndexes.Num();
+		Triangles.Reset();
+		if (!Triangulate(Contour.SimplifiedVertexes, WorkingIndices, Triangles))
 		{
-			Vectors3D.Add(SimplifiedVertex);
+			UE_LOG(LogNavigation, Warning, TEXT("%s the contour of the region %i could not be fully triangulated."), ANSI_TO_TCHAR(__FUNCTION__), Contour.RegionID);
 		}
-		TArray<FIndex3i> Triangles;
-		// TODO (Ignacio) This triangulation is generating some bugs because is using Ear Clipping
-		// We might need to change this in the future
-		PolygonTriangulation::TriangulateSimplePolygon(Vectors3D, Triangles);
-		for (const FIndex3i& Triangle : Triangles)
+
+		for (int32 TriangleIndex = 0; TriangleIndex < Triangles.Num(); TriangleIndex += 3)
 		{
-			const FVector& VertexA = Contour.SimplifiedVertexes[Triangle.A];
-			const FVector& VertexB = Contour.SimplifiedVertexes[Triangle.B];
-			const FVector& VertexC = Contour.SimplifiedVertexes[Triangle.C];
-			const int32 AIndex = PolygonMesh.Vertexes.AddUnique(VertexA);
-			const int32 BIndex = PolygonMesh.Vertexes.AddUnique(VertexB);
-			const int32 CIndex = PolygonMesh.Vertexes.AddUnique(VertexC);
+			const int32 AIndex = ContourToPolyMeshIndices[Triangles[TriangleIndex]];
+			const int32 BIndex = ContourToPolyMeshIndices[Triangles[TriangleIndex + 1]];
+			const int32 CIndex = ContourToPolyMeshIndices[Triangles[TriangleIndex + 2]];
+			// The welding can collapse vertexes of the same contour. Those triangles have no area
+			if (AIndex == BIndex || BIndex == CIndex || CIndex == AIndex)
+			{
+				continue;
+			}
 			FNNPolygon& Polygon = PolygonMesh.PolygonIndexes.Emplace_GetRef(NNPolyMeshBuilderVariables::MaxVertexesPerPoly);
 			Polygon.RegionID = Contour.RegionID;
+			Polygon.AreaID = Contour.AreaID;
 			Polygon.Indexes.Add(AIndex);
 			Polygon.Indexes.Add(BIndex);
 			Polygon.Indexes.Add(CIndex);
 			PolygonMesh.TriangleIndexes.Add(Polygon);
 		}
 
-		// Merge the triangles until no polygon can be found to merge
-		if (MaxVertexesPerContour > 3)
+		// Merge the triangles of the contour until no polygon can be found to merge
+		if (Contour.SimplifiedVertexes.Num() > 3)
 		{
-			while (true)
-			{
-				float LongestMergeEdge = 0.0f;
-				int32 BestPolyA = INDEX_NONE;
-				int32 PolyAVertex = INDEX_NONE;
-				int32 BestPolyB = INDEX_NONE;
-				int32 PolyBVertex = INDEX_NONE;
-				const int32 PolygonCount = PolygonMesh.PolygonIndexes.Num();
-				for (int32 PolyAIndex = 0; PolyAIndex < PolygonCount; ++PolyAIndex)
-				{
-					const FNNPolygon& PolyA = PolygonMesh.PolygonIndexes[PolyAIndex];
-					for (int32 PolyBIndex = PolyAIndex + 1; PolyBIndex < PolygonCount; ++PolyBIndex)
-					{
-						const FNNPolygon& PolyB = PolygonMesh.PolygonIndexes[PolyBIndex];
-						int32 MergeVertexA;
-						int32 MergeVertexB;
-						float MergeVertexDistance;
-						const bool bResult = GetPolyMergeInfo(PolyA, PolyB, PolygonMesh, MergeVertexA, MergeVertexB,
-						                                      MergeVertexDistance);
-						if (bResult && MergeVertexDistance > LongestMergeEdge)
-						{
-							LongestMergeEdge = MergeVertexDistance;
-							BestPolyA = PolyAIndex;
-							PolyAVertex = MergeVertexA;
-							BestPolyB = PolyBIndex;
-							PolyBVertex = MergeVertexB;
-						}
+			MergeContourPolygons(PolygonMesh, FirstContourPolygon);
+		}
+	}
 
-					}
-				}
+	BuildPolygonNeighbours(PolygonMesh);
+	BuildPolygonAreas(PolygonMesh);
+	BuildPolygonComponents(PolygonMesh);
+	BuildPolygonGrid(PolygonMesh);
+}
+
+void FNNPolyMeshBuilder::MergeContourPolygons(FNNPolygonMesh& PolygonMesh, int32 FirstPolygon)
+{
+	TArray<FNNPolygon>& Polygons = PolygonMesh.PolygonIndexes;
+	const int32 PolygonsNum = Polygons.Num() - FirstPolygon;
+	if (PolygonsNum < 2)
+	{
+		return;
+	}
 
-				if (LongestMergeEdge <= 0.0f)
+	// The two polygons of the contour that share each edge. The polygon indexes are relative to FirstPolygon
+	TMap<uint64, FIntPoint> EdgePolygons;
+	EdgePolygons.Reserve(PolygonsNum * 3);
+	for (int32 PolygonIndex = 0; PolygonIndex < PolygonsNum; ++PolygonIndex)
+	{
+		const TArray<int32>& Indexes = Polygons[FirstPolygon + PolygonIndex].Indexes;
+		for (int32 Edge = 0; Edge < Indexes.Num(); ++Edge)
+		{
+			const uint64 EdgeKey = GetEdgeKey(Indexes[Edge], Indexes[GetNextIndex(Edge, Indexes.Num())]);
+			if (FIntPoint* EdgePolygon = EdgePolygons.Find(EdgeKey))
+			{
+				// The welding can leave more than two polygons on an edge. Only the first two are kept
+				if (ensureMsgf(EdgePolygon->Y == INDEX_NONE, TEXT("Edge shared by more than two polygons of the same contour")))
 				{
-					// No valid valid merges were found
-					break;
+					EdgePolygon->Y = PolygonIndex;
 				}
+			}
+			else
+			{
+				EdgePolygons.Add(EdgeKey, FIntPoint(PolygonIndex, INDEX_NONE));
+			}
+		}
+	}
 
-				// Perform the merge
+	TArray<int32> Versions;
+	Versions.Init(0, PolygonsNum);
+	TBitArray<> RemovedPolygons(false, PolygonsNum);
+	TArray<FMergeCandidate> Candidates;
+	Candidates.Reserve(EdgePolygons.Num());
 
-				FNNPolygon& PolyA = PolygonMesh.PolygonIndexes[BestPolyA];
-				FNNPolygon& PolyB = PolygonMesh.PolygonIndexes[BestPolyB];
+	const auto AddCandidate = [&Polygons, &PolygonMesh, &Versions, &Candidates, FirstPolygon](int32 PolyA, int32 PolyB)
+	{
+		int32 MergeVertexA;
+		int32 MergeVertexB;
+		float EdgeLengthSqr;
+		if (GetPolyMergeInfo(Polygons[FirstPolygon + PolyA], Polygons[FirstPolygon + PolyB], PolygonMesh, MergeVertexA, MergeVertexB, EdgeLengthSqr)
+			&& EdgeLengthSqr > 0.0f)
+		{
+			Candidates.HeapPush(FMergeCandidate{EdgeLengthSqr, PolyA, PolyB, Versions[PolyA], Versions[PolyB]}, FMergeCandidatePredicate());
+		}
+	};
 
-				// Copy the vertexes from PolyB to PolyA
-				// PolyAStartVert == PolyBEndVert && PolyAEndVert == PolyBStartVert
-				TArray<int32> MergedPoly;
-				MergedPoly.Reserve(PolyA.Indexes.Num() + PolyB.Indexes.Num() - 2);
-				for (int32 i = 0; i < PolyA.Indexes.Num() - 1; ++i)
-				{
-					MergedPoly.Add(PolyA.Indexes[(PolyAVertex + 1 + i) % PolyA.Indexes.Num()]);
-				}
-				for (int32 i = 0; i < PolyB.Indexes.Num() - 1; ++i)
-				{
-					MergedPoly.Add(PolyB.Indexes[(PolyBVertex + 1 + i) % PolyB.Indexes.Num()]);
-				}
-				PolyA.Indexes = MoveTemp(MergedPoly);
-				PolygonMesh.PolygonIndexes.RemoveAtSwap(BestPolyB);
+	for (const TPair<uint64, FIntPoint>& EdgePolygon : EdgePolygons)
+	{
+		if (EdgePolygon.Value.Y != INDEX_NONE)
+		{
+			AddCandidate(EdgePolygon.Value.X, EdgePolygon.Value.Y);
+		}
+	}
+
+	while (Candidates.Num() > 0)
+	{
+		FMergeCandidate Candidate;
+		Candidates.HeapPop(Candidate, FMergeCandidatePredicate(), false);
+		if (RemovedPolygons[Candidate.PolyA] || RemovedPolygons[Candidate.PolyB]
+			|| Versions[Candidate.PolyA] != Candidate.VersionA || Versions[Candidate.PolyB] != Candidate.VersionB)
+		{
+			// One of the polygons changed since the candidate was found
+			continue;
+		}
+
+		FNNPolygon& PolyA = Polygons[FirstPolygon + Candidate.PolyA];
+		FNNPolygon& PolyB = Polygons[FirstPolygon + Candidate.PolyB];
+		int32 PolyAVertex;
+		int32 PolyBVertex;
+		float EdgeLengthSqr;
+		if (!GetPolyMergeInfo(PolyA, PolyB, PolygonMesh, PolyAVertex, PolyBVertex, EdgeLengthSqr))
+		{
+			continue;
+		}
+
+		// The edges of PolyB now belong to PolyA
+		for (int32 Edge = 0; Edge < PolyB.Indexes.Num(); ++Edge)
+		{
+			FIntPoint* EdgePolygon = EdgePolygons.Find(GetEdgeKey(PolyB.Indexes[Edge], PolyB.Indexes[GetNextIndex(Edge, PolyB.Indexes.Num())]));
+			if (!EdgePolygon)
+			{
+				continue;
+			}
+			if (EdgePolygon->X == Candidate.PolyB)
+			{
+				EdgePolygon->X = Candidate.PolyA;
+			}
+			else if (EdgePolygon->Y == Candidate.PolyB)
+			{
+				EdgePolygon->Y = Candidate.PolyA;
+			}
+		}
+		EdgePolygons.Remove(GetEdgeKey(PolyA.Indexes[PolyAVertex], PolyA.Indexes[GetNextIndex(PolyAVertex, PolyA.Indexes.Num())]));
+
+		// Copy the vertexes from PolyB to PolyA
+		// PolyAStartVert == PolyBEndVert && PolyAEndVert == PolyBStartVert
+		TArray<int32> MergedPoly;
+		MergedPoly.Reserve(PolyA.Indexes.Num() + PolyB.Indexes.Num() - 2);
+		for (int32 i = 0; i < PolyA.Indexes.Num() - 1; ++i)
+		{
+			MergedPoly.Add(PolyA.Indexes[(PolyAVertex + 1 + i) % PolyA.Indexes.Num()]);
+		}
+		for (int32 i = 0; i < PolyB.Indexes.Num() - 1; ++i)
+		{
+			MergedPoly.Add(PolyB.Indexes[(PolyBVertex + 1 + i) % PolyB.Indexes.Num()]);
+		}
+		PolyA.Indexes = MoveTemp(MergedPoly);
+		RemovedPolygons[Candidate.PolyB] = true;
+		++Versions[Candidate.PolyA];
+
+		// Only the candidates of the merged polygon need to be updated
+		for (int32 Edge = 0; Edge < PolyA.Indexes.Num(); ++Edge)
+		{
+			const FIntPoint* EdgePolygon = EdgePolygons.Find(GetEdgeKey(PolyA.Indexes[Edge], PolyA.Indexes[GetNextIndex(Edge, PolyA.Indexes.Num())]));
+			if (!EdgePolygon)
+			{
+				continue;
+			}
+			const int32 Neighbour = EdgePolygon->X == Candidate.PolyA ? EdgePolygon->Y : EdgePolygon->X;
+			if (Neighbour != INDEX_NONE && Neighbour != Candidate.PolyA)
+			{
+				AddCandidate(Candidate.PolyA, Neighbour);
 			}
 		}
 	}
 
+	// Compact the polygons of the contour keeping their order
+	int32 WriteIndex = FirstPolygon;
+	for (int32 PolygonIndex = 0; PolygonIndex < PolygonsNum; ++PolygonIndex)
+	{
+		if (RemovedPolygons[PolygonIndex])
+		{
+			continue;
+		}
+		if (WriteIndex != FirstPolygon + PolygonIndex)
+		{
+			Polygons[WriteIndex] = MoveTemp(Polygons[FirstPolygon + PolygonIndex]);
+		}
+		++WriteIndex;
+	}
+	Polygons.SetNum(WriteIndex, false);
+}
+
+void FNNPolyMeshBuilder::BuildPolygonComponents(FNNPolygonMesh& PolygonMesh)
+{
+	const int32 PolygonsNum = PolygonMesh.PolygonIndexes.Num();
+	TArray<int32> Parents;
+	Parents.SetNumUninitialized(PolygonsNum);
+	for (int32 i = 0; i < PolygonsNum; ++i)
+	{
+		Parents[i] = i;
+	}
+
+	const auto FindRoot = [&Parents](int32 Index)
+	{
+		while (Parents[Index] != Index)
+		{
+			Parents[Index] = Parents[Parents[Index]];
+			Index = Parents[Index];
+		}
+		return Index;
+	};
+
+	// The pathfinding graph moves through the vertexes so polygons that only share a vertex are also connected
+	TArray<int32> VertexPolygon;
+	VertexPolygon.Init(INDEX_NONE, PolygonMesh.Vertexes.Num());
+	for (int32 PolygonIndex = 0; PolygonIndex < PolygonsNum; ++PolygonIndex)
+	{
+		for (const int32 VertexIndex : PolygonMesh.PolygonIndexes[PolygonIndex].Indexes)
+		{
+			if (VertexPolygon[VertexIndex] == INDEX_NONE)
+			{
+				VertexPolygon[VertexIndex] = PolygonIndex;
+				continue;
+			}
+			const int32 RootA = FindRoot(PolygonIndex);
+			const int32 RootB = FindRoot(VertexPolygon[VertexIndex]);
+			if (RootA != RootB)
+			{
+				Parents[RootA] = RootB;
+			}
+		}
+	}
+
+	for (int32 i = 0; i < PolygonsNum; ++i)
+	{
+		PolygonMesh.PolygonIndexes[i].ComponentID = FindRoot(i);
+	}
+}
+
+void FNNPolyMeshBuilder::BuildPolygonAreas(FNNPolygonMesh& PolygonMesh)
+{
+	PolygonMesh.PolygonAreaPrefixSum.Reset(PolygonMesh.PolygonIndexes.Num());
+	float AccumulatedArea = 0.0f;
+	for (const FNNPolygon& Polygon : PolygonMesh.PolygonIndexes)
+	{
+		float DoubleArea = 0.0f;
+		const int32 VertCount = Polygon.Indexes.Num();
+		for (int32 i = 0; i < VertCount; ++i)
+		{
+			const FVector& A = PolygonMesh.Vertexes[Polygon.Indexes[i]];
+			const FVector& B = PolygonMesh.Vertexes[Polygon.Indexes[GetNextIndex(i, VertCount)]];
+			DoubleArea += A.X * B.Y - B.X * A.Y;
+		}
+		AccumulatedArea += FMath::Abs(DoubleArea) * 0.5f;
+		PolygonMesh.PolygonAreaPrefixSum.Add(AccumulatedArea);
+	}
+}
+
+void FNNPolyMeshBuilder::BuildPolygonGrid(FNNPolygonMesh& PolygonMesh)
+{
+	PolygonMesh.GridSize = FIntPoint::ZeroValue;
+	PolygonMesh.GridCellStarts.Reset();
+	PolygonMesh.GridPolygons.Reset();
+	if (PolygonMesh.PolygonIndexes.Num() == 0)
+	{
+		return;
+	}
+
+	// The vertexes are relative to the OpenHeightField origin so the grid starts at zero
+	FVector2D MaxPoint = FVector2D::ZeroVector;
+	for (const FVector& Vertex : PolygonMesh.Vertexes)
+	{
+		MaxPoint = FVector2D::Max(MaxPoint, FVector2D(Vertex));
+	}
+	const int32 CellSize = FNNPolygonMesh::GridCellSize;
+	PolygonMesh.GridSize = FIntPoint(FMath::FloorToInt(MaxPoint.X / CellSize) + 1, FMath::FloorToInt(MaxPoint.Y / CellSize) + 1);
+
+	// The grid squares overlapped by each polygon, both corners included
+	TArray<FIntRect> PolygonCells;
+	PolygonCells.Reserve(PolygonMesh.PolygonIndexes.Num());
+	for (const FNNPolygon& Polygon : PolygonMesh.PolygonIndexes)
+	{
+		FVector2D Min (TNumericLimits<float>::Max());
+		FVector2D Max (TNumericLimits<float>::Lowest());
+		for (const int32 Index : Polygon.Indexes)
+		{
+			Min = FVector2D::Min(Min, FVector2D(PolygonMesh.Vertexes[Index]));
+			Max = FVector2D::Max(Max, FVector2D(PolygonMesh.Vertexes[Index]));
+		}
+		PolygonCells.Emplace(
+			FMath::Clamp(FMath::FloorToInt(Min.X / CellSize), 0, PolygonMesh.GridSize.X - 1),
+			FMath::Clamp(FMath::FloorToInt(Min.Y / CellSize), 0, PolygonMesh.GridSize.Y - 1),
+			FMath::Clamp(FMath::FloorToInt(Max.X / CellSize), 0, PolygonMesh.GridSize.X - 1),
+			FMath::Clamp(FMath::FloorToInt(Max.Y / CellSize), 0, PolygonMesh.GridSize.Y - 1));
+	}
+
+	// Counts the polygons of each square and then writes them contiguously
+	TArray<int32>& CellStarts = PolygonMesh.GridCellStarts;
+	CellStarts.Init(0, PolygonMesh.GridSize.X * PolygonMesh.GridSize.Y + 1);
+	for (const FIntRect& Cells : PolygonCells)
+	{
+		for (int32 Y = Cells.Min.Y; Y <= Cells.Max.Y; ++Y)
+		{
+			for (int32 X = Cells.Min.X; X <= Cells.Max.X; ++X)
+			{
+				++CellStarts[X + Y * PolygonMesh.GridSize.X + 1];
+			}
+		}
+	}
+	for (int32 i = 1; i < CellStarts.Num(); ++i)
+	{
+		CellStarts[i] += CellStarts[i - 1];
+	}
+
+	TArray<int32> WriteIndexes (CellStarts);
+	PolygonMesh.GridPolygons.SetNumUninitialized(CellStarts.Last());
+	for (int32 PolygonIndex = 0; PolygonIndex < PolygonCells.Num(); ++PolygonIndex)
+	{
+		const FIntRect& Cells = PolygonCells[PolygonIndex];
+		for (int32 Y = Cells.Min.Y; Y <= Cells.Max.Y; ++Y)
+		{
+			for (int32 X = Cells.Min.X; X <= Cells.Max.X; ++X)
+			{
+				PolygonMesh.GridPolygons[WriteIndexes[X + Y * PolygonMesh.GridSize.X]++] = PolygonIndex;
+			}
+		}
+	}
+}
+
+void FNNPolyMeshBuilder::BuildPolygonNeighbours(FNNPolygonMesh& PolygonMesh)
+{
+	// The polygon and the edge index of the first polygon found for each edge
+	TMap<uint64, FIntPoint> OpenEdges;
+	OpenEdges.Reserve(PolygonMesh.Vertexes.Num() * 2);
+
+	for (int32 PolygonIndex = 0; PolygonIndex < PolygonMesh.PolygonIndexes.Num(); ++PolygonIndex)
+	{
+		FNNPolygon& Polygon = PolygonMesh.PolygonIndexes[PolygonIndex];
+		const int32 VertCount = Polygon.Indexes.Num();
+		Polygon.Neighbours.Init(INDEX_NONE, VertCount);
+		for (int32 Edge = 0; Edge < VertCount; ++Edge)
+		{
+			const uint64 EdgeKey = GetEdgeKey(Polygon.Indexes[Edge], Polygon.Indexes[GetNextIndex(Edge, VertCount)]);
+			if (const FIntPoint* OtherEdge = OpenEdges.Find(EdgeKey))
+			{
+				Polygon.Neighbours[Edge] = OtherEdge->X;
+				PolygonMesh.PolygonIndexes[OtherEdge->X].Neighbours[OtherEdge->Y] = PolygonIndex;
+				OpenEdges.Remove(EdgeKey);
+			}
+			else
+			{
+				OpenEdges.Add(EdgeKey, FIntPoint(PolygonIndex, Edge));
+			}
+		}
+	}
 }
 
 bool FNNPolyMeshBuilder::GetPolyMergeInfo(const FNNPolygon& PolyA, const FNNPolygon& PolyB,
@@ -187,6 +742,12 @@ bool FNNPolyMeshBuilder::GetPolyMergeInfo(const FNNPolygon& PolyA, const FNNPoly
 	VertexToMergeB = INDEX_NONE;
 	DistanceSqrOfEdge = 0.0f;
 
+	// Polygons from different areas can't be merged
+	if (PolyA.AreaID != PolyB.AreaID)
+	{
+		return false;
+	}
+
 	const int32 VertCountA = PolyA.Indexes.Num();
 	const int32 VertCountB = PolyB.Indexes.Num();
 
@@ -258,29 +819,3 @@ bool FNNPolyMeshBuilder::GetPolyMergeInfo(const FNNPolygon& PolyA, const FNNPoly
 	DistanceSqrOfEdge = DeltaX * DeltaX + DeltaY * DeltaY;
 	return true;
 }
-
-bool FNNPolyMeshBuilder::IsValidPartition(int32 IndexA, int32 IndexB, const TArray<FVector>& Vertexes,
-	const TArray<int32>& VertexesIndexes) const
-{
-	return LiesWithinInternalAngle(IndexA, IndexB, Vertexes, VertexesIndexes);
-		// TODO && !HasIllegalEdgeIntersection(IndexA, IndexB, Vertexes, VertexesIndexes);
-}
-
-bool FNNPolyMeshBuilder::LiesWithinInternalAngle(int32 IndexA, int32 IndexB, const TArray<FVector>& Vertexes,
-	const TArray<int32>& VertexesIndexes) const
-{
-	constexpr int32 DeFlag = NNPolyMeshBuilderVariables::TriangulationDeFlag;
-	int32 PointerVertexA = VertexesIndexes[IndexA] & DeFlag;
-	int32 PointerVertexB = VertexesIndexes[IndexB] & DeFlag;
-	int32 PointerVertexAMinus = VertexesIndexes[GetPreviousIndex(IndexA, VertexesIndexes.Num())] & DeFlag;
-	int32 PointerVertexAPlus = VertexesIndexes[GetNextIndex(IndexA, VertexesIndexes.Num())] & DeFlag;
-
-	// First we need to check which of the two angles formed by the line segment AMinus->A->APlus is internal (points
-	// towards) the polygon.
-
-	return false;
-	
-}
-
-
-
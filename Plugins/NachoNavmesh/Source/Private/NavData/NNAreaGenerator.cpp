@@ -1,7 +1,9 @@
 ﻿#include "NavData/NNAreaGenerator.h"
 
 // UE Includes
+#include "Async/ParallelFor.h"
 #include "NavigationSystem.h"
+#include "NavAreas/NavArea.h"
 
 // NN Includes
 #include "NavData/Contour/NNContourGeneration.h"
@@ -11,9 +13,73 @@
 #include "NavData/Voxelization/HeightFieldGenerator.h"
 #include "NavData/Voxelization/OpenHeightFieldGenerator.h"
 
-FVector FNNRawGeometryElement::GetGeometryPosition(int32 Index) const
+namespace NNRawGeometryHelpers
 {
-	return FVector(-GeomCoords[Index * 3], -GeomCoords[Index * 3 + 2], GeomCoords[Index * 3 + 1]);
+	/** Converts the recast vertexes to unreal coordinates, subtracting the Offset, and appends them with their triangles */
+	void AppendRecastGeometry(const float* RecastCoords, int32 VertexesNum, const int32* RecastIndices, int32 TrianglesNum,
+		const FVector& Offset, TArray<float>& VertexesX, TArray<float>& VertexesY, TArray<float>& VertexesZ, TArray<int32>& Indices)
+	{
+		const int32 FirstVertex = VertexesX.Num();
+		VertexesX.Reserve(FirstVertex + VertexesNum);
+		VertexesY.Reserve(FirstVertex + VertexesNum);
+		VertexesZ.Reserve(FirstVertex + VertexesNum);
+		for (int32 i = 0; i < VertexesNum; ++i)
+		{
+			// Recast coordinates to unreal coordinates
+			const float* Coords = RecastCoords + i * 3;
+			VertexesX.Add(-Coords[0] - Offset.X);
+			VertexesY.Add(-Coords[2] - Offset.Y);
+			VertexesZ.Add(Coords[1] - Offset.Z);
+		}
+
+		const int32 IndicesNum = TrianglesNum * 3;
+		Indices.Reserve(Indices.Num() + IndicesNum);
+		for (int32 i = 0; i < IndicesNum; ++i)
+		{
+			Indices.Add(FirstVertex + RecastIndices[i]);
+		}
+	}
+}
+
+void FNNRawGeometry::Append(const float* RecastCoords, int32 VertexesNum, const int32* RecastIndices, int32 TrianglesNum)
+{
+	NNRawGeometryHelpers::AppendRecastGeometry(RecastCoords, VertexesNum, RecastIndices, TrianglesNum, Origin,
+		VertexesX, VertexesY, VertexesZ, Indices);
+}
+
+void FNNRawGeometry::AppendInstanced(const float* RecastCoords, int32 VertexesNum, const int32* RecastIndices, int32 TrianglesNum,
+	TArray<FTransform>&& Transforms)
+{
+	// The instances are transformed while rasterizing so the mesh is kept in its local space
+	FNNInstancedGeometry& Instanced = InstancedGeometry.AddDefaulted_GetRef();
+	NNRawGeometryHelpers::AppendRecastGeometry(RecastCoords, VertexesNum, RecastIndices, TrianglesNum, FVector::ZeroVector,
+		Instanced.VertexesX, Instanced.VertexesY, Instanced.VertexesZ, Instanced.Indices);
+	Instanced.Transforms = MoveTemp(Transforms);
+}
+
+FBox FNNRawGeometry::GetRangeBounds(const FNNRawGeometryRange& Range) const
+{
+	FBox Bounds (ForceInit);
+	for (int32 i = Range.FirstTriangle * 3; i < (Range.FirstTriangle + Range.TrianglesNum) * 3; ++i)
+	{
+		Bounds += GetVertex(Indices[i]);
+	}
+
+	// The bounds of each instanced mesh are calculated once in its local space
+	for (int32 InstancedIndex = Range.FirstInstanced; InstancedIndex < Range.FirstInstanced + Range.InstancedNum; ++InstancedIndex)
+	{
+		const FNNInstancedGeometry& Instanced = InstancedGeometry[InstancedIndex];
+		FBox LocalBounds (ForceInit);
+		for (int32 i = 0; i < Instanced.GetVertexesNum(); ++i)
+		{
+			LocalBounds += Instanced.GetLocalVertex(i);
+		}
+		for (const FTransform& Transform : Instanced.Transforms)
+		{
+			Bounds += LocalBounds.TransformBy(Transform);
+		}
+	}
+	return Bounds;
 }
 
 FNNGeometryCache::FNNGeometryCache(const uint8* Memory)
@@ -23,6 +89,47 @@ FNNGeometryCache::FNNGeometryCache(const uint8* Memory)
 	Indices = (int32*)(Memory + sizeof(FNNGeometryCache) + (sizeof(float) * Header.NumVerts * 3));
 }
 
+bool FNNAreaModifier::IsInside(const FVector& Location) const
+{
+	if (!Bounds.IsInsideOrOn(Location))
+	{
+		return false;
+	}
+
+	switch (ShapeType)
+	{
+	case ENavigationShapeType::Cylinder:
+		return FVector::DistSquared2D(Location, Center) <= FMath::Square(Radius);
+	case ENavigationShapeType::Convex:
+	{
+		if (Location.Z < MinZ || Location.Z > MaxZ)
+		{
+			return false;
+		}
+		// The point must be on the same side of every edge of the hull
+		float Sign = 0.0f;
+		for (int32 i = 0; i < ConvexPoints.Num(); ++i)
+		{
+			const FVector& A = ConvexPoints[i];
+			const FVector& B = ConvexPoints[(i + 1) % ConvexPoints.Num()];
+			const float Cross = (B.X - A.X) * (Location.Y - A.Y) - (B.Y - A.Y) * (Location.X - A.X);
+			if (Cross * Sign < 0.0f)
+			{
+				return false;
+			}
+			if (Cross != 0.0f)
+			{
+				Sign = Cross;
+			}
+		}
+		return true;
+	}
+	default:
+		// Boxes are fully described by its bounds
+		return true;
+	}
+}
+
 void FNNAreaGeneratorData::AddDebugPoint(const FVector& Point, float Radius)
 {
 	FBoxSphereBounds PointToDebug = FBoxSphereBounds(FSphere(Point, Radius));
@@ -47,21 +154,82 @@ void FNNAreaGeneratorData::AddDebugArrow(const FVector& Start, const FVector& En
 FNNAreaGenerator::FNNAreaGenerator(const FNNNavMeshGenerator* InParentGenerator, const FNavigationBounds& Bounds)
 	: AreaBounds(Bounds), ParentGenerator(InParentGenerator)
 {
+	// The navmesh can't be safely accessed from the worker thread so the areas are cached here
+	const ANNNavMesh* NavMesh = ParentGenerator->GetOwner().Get();
+	for (int32 AreaID = 0; AreaID < NNNavAreas::MaxAreas; ++AreaID)
+	{
+		AreaFlags[AreaID] = NNNavAreas::DefaultAreaFlags;
+		const UClass* AreaClass = NavMesh ? NavMesh->GetAreaClass(AreaID) : nullptr;
+		if (AreaClass)
+		{
+			AreaClassToID.Add(AreaClass, AreaID);
+			AreaFlags[AreaID] = AreaClass->GetDefaultObject<UNavArea>()->GetAreaFlags();
+		}
+	}
+
+	const int32 ProfilesNum = NavMesh ? NavMesh->GetAgentProfilesNum() : 0;
+	AgentProfiles.Reserve(ProfilesNum);
+	for (int32 ProfileIndex = 0; ProfileIndex < ProfilesNum; ++ProfileIndex)
+	{
+		AgentProfiles.Add(NavMesh->GetAgentProfile(ProfileIndex));
+	}
+
+	ParentGenerator->GetObstaclesInBounds(AreaBounds.AreaBox, Obstacles);
+}
+
+FNNAreaGenerator::FNNAreaGenerator(const FNNNavMeshGenerator* InParentGenerator, const FNavigationBounds& Bounds, FNNAreaGeneratorData& PreviousData)
+	: FNNAreaGenerator(InParentGenerator, Bounds)
+{
+	// The previous data keeps its navmesh so it can still be queried until this build finishes
+	AreaGeneratorData = MakeUnique<FNNAreaGeneratorData>();
+	AreaGeneratorData->CompressedHeightField = PreviousData.CompressedHeightField;
+	AreaGeneratorData->RawGeometry = MoveTemp(PreviousData.RawGeometry);
+	bReuseHeightField = true;
 }
 
 void FNNAreaGenerator::DoWork()
 {
 	check(ParentGenerator);
 
-	AreaGeneratorData = MakeUnique<FNNAreaGeneratorData>();
+	if (bReuseHeightField)
+	{
+		AreaGeneratorData->CompressedHeightField.Decompress(AreaGeneratorData->HeightField);
+	}
+	else
+	{
+		AreaGeneratorData = MakeUnique<FNNAreaGeneratorData>();
+		if (!BuildHeightField())
+		{
+			return;
+		}
+		AreaGeneratorData->CompressedHeightField.Compress(AreaGeneratorData->HeightField);
+	}
 
-	GatherGeometry(true);
+	// Each agent profile only reads the HeightField so they can be built at the same time
+	AreaGeneratorData->AgentsNavData.SetNum(AgentProfiles.Num());
+	ParallelFor(AgentProfiles.Num(), [this](int32 ProfileIndex)
+	{
+		BuildAgentNavData(ProfileIndex);
+	});
 
-	if (!ensure(AreaGeneratorData->RawGeometry.Num() > 0))
+	// Gives each polygon an unique ID
+	for (int32 ProfileIndex = 0; ProfileIndex < AgentProfiles.Num(); ++ProfileIndex)
 	{
-		return;
+		FNNPolygonMesh& PolygonMesh = AreaGeneratorData->AgentsNavData[ProfileIndex].PolygonMesh;
+		for (int32 i = 0; i < PolygonMesh.PolygonIndexes.Num(); ++i)
+		{
+			FNNPolygon& Polygon = PolygonMesh.PolygonIndexes[i];
+			Polygon.NodeRef = ParentGenerator->GeneratePolygonNodeRef(AreaBounds.UniqueID, ProfileIndex, i);
+			Polygon.Flags = AreaFlags[Polygon.AreaID];
+		}
 	}
 
+	// Only the compressed HeightField is kept for the next rebuilds
+	AreaGeneratorData->HeightField = FNNHeightField();
+}
+
+bool FNNAreaGenerator::BuildHeightField()
+{
 	const TWeakObjectPtr<ANNNavMesh> NavMesh = ParentGenerator->GetOwner();
 	const float HeightFieldHeight = NavMesh->CellHeight; // Z Axis
 	const float HeightFieldSize = NavMesh->CellSize; // X and Y Axis
@@ -69,40 +237,83 @@ void FNNAreaGenerator::DoWork()
 	const FVector& MinimumPoint = AreaBounds.AreaBox.Min;
 	const FVector& MaximumPoint = AreaBounds.AreaBox.Max;
 
-	// Create Solid HeightField
+	// The contour vertexes are stored in int16 so their corners must fit in that range
+	const FVector BoundSize = MaximumPoint - MinimumPoint;
+	const int32 MaxCells = FMath::CeilToInt(FMath::Max3(BoundSize.X / HeightFieldSize, BoundSize.Y / HeightFieldSize, BoundSize.Z / HeightFieldHeight));
+	if (!ensureMsgf(MaxCells < FNNContourVertex::MaxCoordinate, TEXT("The navigation bounds %s need %i cells in one axis and the maximum is %i. Increase the cell size or split the bounds."),
+		*AreaBounds.AreaBox.ToString(), MaxCells, FNNContourVertex::MaxCoordinate - 1))
+	{
+		return false;
+	}
+
+	GatherGeometry(true);
+
+	// Only the elements that changed since the last build are rasterized again
+	RasterizeUncachedElements();
+
+	if (!ensure(AreaGeneratorData->ElementsVoxels.Num() > 0))
+	{
+		return false;
+	}
+
+	// Create Solid HeightField from the voxels of every element. It's shared by every agent profile
 	const FHeightFieldGenerator HeightFieldGenerator (*AreaGeneratorData);
-	HeightFieldGenerator.InitializeHeightField(AreaGeneratorData->HeightField ,
-		AreaGeneratorData->RawGeometry, MinimumPoint, MaximumPoint, HeightFieldSize,
-		HeightFieldHeight, NavMesh->WalkableSlopeDegrees, NavMesh->AgentHeight, NavMesh->MaxLedgeHeight);
+	HeightFieldGenerator.InitializeHeightField(AreaGeneratorData->HeightField, MinimumPoint, MaximumPoint, HeightFieldSize, HeightFieldHeight);
+	for (const TSharedPtr<const FNNVoxelCache, ESPMode::ThreadSafe>& ElementVoxels : AreaGeneratorData->ElementsVoxels)
+	{
+		HeightFieldGenerator.MergeVoxelCache(AreaGeneratorData->HeightField, *ElementVoxels);
+	}
+
+	// The agent size filters are applied by each agent profile when building its open heightfield
+	HeightFieldGenerator.MarkAreaModifiers(AreaGeneratorData->HeightField, AreaGeneratorData->AreaModifiers);
+	return true;
+}
 
+void FNNAreaGenerator::BuildAgentNavData(int32 ProfileIndex)
+{
+	const TWeakObjectPtr<ANNNavMesh> NavMesh = ParentGenerator->GetOwner();
+	const FNNAgentProfile& Profile = AgentProfiles[ProfileIndex];
+	FNNAgentNavData& AgentNavData = AreaGeneratorData->AgentsNavData[ProfileIndex];
 
 	// Create Open HeightField
 	const FOpenHeightFieldGenerator OpenHeightFieldGenerator (*AreaGeneratorData);
-	OpenHeightFieldGenerator.GenerateOpenHeightField(AreaGeneratorData->OpenHeightField, AreaGeneratorData->HeightField, NavMesh->MaxLedgeHeight, NavMesh->AgentHeight);
+	OpenHeightFieldGenerator.GenerateOpenHeightField(AgentNavData.OpenHeightField, AreaGeneratorData->HeightField, Profile.MaxLedgeHeight, Profile.AgentHeight);
+
+	// The obstacles are carved before the erosion so the agent keeps its radius away from them
+	OpenHeightFieldGenerator.CarveObstacles(AgentNavData.OpenHeightField, Obstacles);
+
+	// Keep the agent away from the borders
+	const int32 ErodeRadius = FMath::CeilToInt(Profile.AgentRadius / NavMesh->CellSize);
+	OpenHeightFieldGenerator.ErodeWalkableArea(AgentNavData.OpenHeightField, ErodeRadius);
 
 	// Generate Regions for the Open HeightField
 	constexpr FNNRegionGenerator RegionGenerator;
-	const int32 MinTraversableSize = FMath::CeilToInt(NavMesh->AgentRadius / NavMesh->CellSize);
-	RegionGenerator.CreateRegions(AreaGeneratorData->OpenHeightField, NavMesh->MinRegionSize, MinTraversableSize);
+	// The erosion already removed the spans the agent can't stand on
+	constexpr int32 MinTraversableSize = 0;
+	switch (NavMesh->PartitionMode)
+	{
+	case ENNPartitionMode::Monotone:
+		RegionGenerator.CreateMonotoneRegions(AgentNavData.OpenHeightField, NavMesh->MinRegionSize, MinTraversableSize);
+		break;
+	case ENNPartitionMode::Layers:
+		RegionGenerator.CreateLayerRegions(AgentNavData.OpenHeightField, NavMesh->MinRegionSize, MinTraversableSize);
+		break;
+	default:
+		RegionGenerator.CreateRegions(AgentNavData.OpenHeightField, NavMesh->MinRegionSize, MinTraversableSize);
+		break;
+	}
 
 	// Generate Contour
 	FNNContourGeneration ContourGeneration (*AreaGeneratorData, NavMesh->ContourDeviationThreshold, NavMesh->MaxEdgeLength);
-	ContourGeneration.CalculateContour(AreaGeneratorData->OpenHeightField, AreaGeneratorData->Contours);
+	ContourGeneration.CalculateContour(AgentNavData.OpenHeightField, AgentNavData.Contours);
 
 	// Triangulate Contour
 	FNNPolyMeshBuilder MeshBuilder;
-	MeshBuilder.GenerateConvexPolygon(AreaGeneratorData->Contours, AreaGeneratorData->PolygonMesh);
+	MeshBuilder.GenerateConvexPolygon(AgentNavData.Contours, AgentNavData.PolygonMesh);
 
 	// Pathfinding graph
-	const FNNPathfinding Pathfinding (*AreaGeneratorData, AreaGeneratorData->OpenHeightField);
-	Pathfinding.CreateGraph(AreaGeneratorData->PolygonMesh, AreaGeneratorData->PathfindingGraph);
-
-	// Gives each polygon an unique ID
-	for (int32 i = 0; i < AreaGeneratorData->PolygonMesh.PolygonIndexes.Num(); ++i)
-	{
-		FNNPolygon& Polygon = AreaGeneratorData->PolygonMesh.PolygonIndexes[i];
-		Polygon.NodeRef = ParentGenerator->GeneratePolygonNodeRef(AreaBounds.UniqueID, i);
-	}
+	const FNNPathfinding Pathfinding (*AreaGeneratorData, AgentNavData.OpenHeightField);
+	Pathfinding.CreateGraph(AgentNavData.PolygonMesh, AgentNavData.PathfindingGraph);
 }
 
 void FNNAreaGenerator::GatherGeometry(bool bGeometryChanged)
@@ -117,6 +328,14 @@ void FNNAreaGenerator::GatherGeometry(bool bGeometryChanged)
 		return;
 	}
 	const FNavDataConfig& OwnerNavDataConfig = ParentGenerator->GetOwner()->GetConfig();
+	AreaGeneratorData->RawGeometry.Origin = AreaBounds.AreaBox.Min;
+
+	// Any change in these settings invalidates the voxels of every element
+	const ANNNavMesh* NavMesh = ParentGenerator->GetOwner().Get();
+	VoxelSettingsHash = FCrc::MemCrc32(&AreaBounds.AreaBox, sizeof(FBox));
+	VoxelSettingsHash = HashCombine(VoxelSettingsHash, GetTypeHash(NavMesh->CellSize));
+	VoxelSettingsHash = HashCombine(VoxelSettingsHash, GetTypeHash(NavMesh->CellHeight));
+	VoxelSettingsHash = HashCombine(VoxelSettingsHash, GetTypeHash(NavMesh->WalkableSlopeDegrees));
 
 	NavigationOctree->FindElementsWithBoundsTest(ParentGenerator->GrowBoundingBox(AreaBounds.AreaBox, /*bIncludeAgentHeight*/ false), [&OwnerNavDataConfig, &NavigationOctree, this, NavSys, bGeometryChanged](const FNavigationOctreeElement& Element)
 	{
@@ -143,26 +362,132 @@ void FNNAreaGenerator::GatherNavigationDataGeometry(
 	const FCompositeNavModifier ModifierInstance = ElementData->GetModifierForAgent(&OwnerNavDataConfig);
 
 	const bool bExportGeometry = bGeometryChanged && ElementData->HasGeometry();
-	if (bExportGeometry)
+	const FNavigationRelevantData& DataRef = ElementData.Get();
+	if (bExportGeometry && DataRef.IsCollisionDataValid() && DataRef.CollisionData.Num() > 0)
 	{
-		// TODO (ignacio) Support for vocel cache?
+		// Gather per instance transforms. Only the instances that overlap the tile are kept
+		TArray<FTransform> PerInstanceTransform;
+		const bool bInstanced = DataRef.NavDataPerInstanceTransformDelegate.IsBound();
+		if (bInstanced)
+		{
+			DataRef.NavDataPerInstanceTransformDelegate.Execute(ParentGenerator->GrowBoundingBox(AreaBounds.AreaBox, /*bIncludeAgentHeight*/ false), PerInstanceTransform);
+		}
 
-		const FNavigationRelevantData& DataRef = ElementData.Get();
-		if (DataRef.IsCollisionDataValid())
+		if (!bInstanced || PerInstanceTransform.Num() > 0)
 		{
-			AppendGeometry(DataRef, ModifierInstance, DataRef.NavDataPerInstanceTransformDelegate);
+			// Elements without owner or with more than one relevant data can't be identified between builds
+			FObjectKey ElementKey (DataRef.GetOwner());
+			if (ElementKey == FObjectKey() || TileVoxelCache.Contains(ElementKey)
+				|| UncachedElements.ContainsByPredicate([&ElementKey](const FNNUncachedElement& Element) { return Element.ElementKey == ElementKey; }))
+			{
+				ElementKey = FObjectKey();
+			}
+
+			const uint32 GeometryHash = CalculateGeometryHash(DataRef, PerInstanceTransform);
+			TSharedPtr<const FNNVoxelCache, ESPMode::ThreadSafe> CachedVoxels = ElementKey != FObjectKey()
+				? ParentGenerator->FindVoxelCache(AreaBounds.UniqueID, ElementKey, GeometryHash)
+				: nullptr;
+			if (CachedVoxels.IsValid())
+			{
+				FNNVoxelCacheEntry& Entry = TileVoxelCache.Add(ElementKey);
+				Entry.GeometryHash = GeometryHash;
+				Entry.Voxels = CachedVoxels;
+				AreaGeneratorData->ElementsVoxels.Add(MoveTemp(CachedVoxels));
+			}
+			else
+			{
+				const FNNRawGeometry& RawGeometry = AreaGeneratorData->RawGeometry;
+				FNNUncachedElement& UncachedElement = UncachedElements.AddDefaulted_GetRef();
+				UncachedElement.ElementKey = ElementKey;
+				UncachedElement.GeometryHash = GeometryHash;
+				UncachedElement.Range.FirstTriangle = RawGeometry.GetTrianglesNum();
+				UncachedElement.Range.FirstInstanced = RawGeometry.InstancedGeometry.Num();
+
+				AppendGeometry(DataRef, ModifierInstance, MoveTemp(PerInstanceTransform));
+
+				UncachedElement.Range.TrianglesNum = RawGeometry.GetTrianglesNum() - UncachedElement.Range.FirstTriangle;
+				UncachedElement.Range.InstancedNum = RawGeometry.InstancedGeometry.Num() - UncachedElement.Range.FirstInstanced;
+			}
 		}
 	}
 
-	// TODO (ignacio) Here we should take into account modifiers
-	// if (ModifierInstance.IsEmpty() == false)
-	// {
-	// 	AppendModifier(ModifierInstance, ElementData->NavDataPerInstanceTransformDelegate);
-	// }
+	if (!ModifierInstance.IsEmpty())
+	{
+		if (DataRef.NavDataPerInstanceTransformDelegate.IsBound())
+		{
+			// Every instance overlapping the tile gets its own copy of the areas
+			TArray<FTransform> PerInstanceTransform;
+			DataRef.NavDataPerInstanceTransformDelegate.Execute(ParentGenerator->GrowBoundingBox(AreaBounds.AreaBox, /*bIncludeAgentHeight*/ false), PerInstanceTransform);
+			for (const FTransform& LocalToWorld : PerInstanceTransform)
+			{
+				AppendModifier(ModifierInstance, LocalToWorld);
+			}
+		}
+		else
+		{
+			AppendModifier(ModifierInstance, FTransform::Identity);
+		}
+	}
+}
+
+void FNNAreaGenerator::AppendModifier(const FCompositeNavModifier& Modifier, const FTransform& LocalToWorld)
+{
+	const FBox& TileBounds = AreaBounds.AreaBox;
+	const bool bIdentity = LocalToWorld.Equals(FTransform::Identity);
+	for (const FAreaNavModifier& Area : Modifier.GetAreas())
+	{
+		const uint8* AreaID = AreaClassToID.Find(Area.GetAreaClass());
+		const FBox AreaBox = bIdentity ? Area.GetBounds() : Area.GetBounds().TransformBy(LocalToWorld);
+		if (!AreaID || !AreaBox.Intersect(TileBounds))
+		{
+			continue;
+		}
+
+		FNNAreaModifier AreaModifier;
+		AreaModifier.ShapeType = Area.GetShapeType();
+		// Rotated boxes are approximated by their world bounds
+		AreaModifier.Bounds = AreaBox;
+		AreaModifier.AreaID = *AreaID;
+		switch (AreaModifier.ShapeType)
+		{
+		case ENavigationShapeType::Cylinder:
+		{
+			FCylinderNavAreaData CylinderData;
+			Area.GetCylinder(CylinderData);
+			const FVector Scale = LocalToWorld.GetScale3D().GetAbs();
+			AreaModifier.Center = LocalToWorld.TransformPosition(CylinderData.Origin);
+			AreaModifier.Radius = CylinderData.Radius * FMath::Max(Scale.X, Scale.Y);
+			break;
+		}
+		case ENavigationShapeType::Box:
+			break;
+		case ENavigationShapeType::Convex:
+		{
+			FConvexNavAreaData ConvexData;
+			Area.GetConvex(ConvexData);
+			AreaModifier.ConvexPoints = MoveTemp(ConvexData.Points);
+			AreaModifier.MinZ = ConvexData.MinZ;
+			AreaModifier.MaxZ = ConvexData.MaxZ;
+			if (!bIdentity)
+			{
+				for (FVector& Point : AreaModifier.ConvexPoints)
+				{
+					Point = LocalToWorld.TransformPosition(Point);
+				}
+				AreaModifier.MinZ = AreaBox.Min.Z;
+				AreaModifier.MaxZ = AreaBox.Max.Z;
+			}
+			break;
+		}
+		default:
+			continue;
+		}
+		AreaGeneratorData->AreaModifiers.Add(MoveTemp(AreaModifier));
+	}
 }
 
 void FNNAreaGenerator::AppendGeometry(const FNavigationRelevantData& DataRef, const FCompositeNavModifier& InModifier,
-	const FNavDataPerInstanceTransformDelegate& InTransformsDelegate)
+	TArray<FTransform>&& PerInstanceTransform)
 {
 	const TNavStatArray<uint8>& RawCollisionCache = DataRef.CollisionData;
 	if (RawCollisionCache.Num() == 0)
@@ -170,34 +495,105 @@ void FNNAreaGenerator::AppendGeometry(const FNavigationRelevantData& DataRef, co
 		return;
 	}
 
-	FNNRawGeometryElement GeometryElement;
-
 	// TODO (ignacio) we might want to set rasterization flags here
 
 	const FNNGeometryCache CollisionCache(RawCollisionCache.GetData());
 
-	// Gather per instance transforms
-	// if (InTransformsDelegate.IsBound())
-	// {
-	// 	InTransformsDelegate.Execute(TileBBExpandedForAgent, GeometryElement.PerInstanceTransform);
-	// 	if (GeometryElement.PerInstanceTransform.Num() == 0)
-	// 	{
-	// 		return;
-	// 	}
-	// }
+	if (CollisionCache.Header.NumFaces == 0)
+	{
+		return;
+	}
 
-	const int32 NumCoords = CollisionCache.Header.NumVerts * 3;
-	const int32 NumIndices = CollisionCache.Header.NumFaces * 3;
-	if (NumIndices > 0)
+	// The collision of instanced meshes is in the mesh local space
+	if (PerInstanceTransform.Num() > 0)
 	{
-		UE_LOG(LogNavigationDataBuild, VeryVerbose, TEXT("%s adding %i vertices from %s."), ANSI_TO_TCHAR(__FUNCTION__), CollisionCache.Header.NumVerts, *GetFullNameSafe(DataRef.GetOwner()));
+		UE_LOG(LogNavigationDataBuild, VeryVerbose, TEXT("%s adding %i vertices with %i instances from %s."), ANSI_TO_TCHAR(__FUNCTION__), CollisionCache.Header.NumVerts, PerInstanceTransform.Num(), *GetFullNameSafe(DataRef.GetOwner()));
 
-		GeometryElement.GeomCoords.SetNumUninitialized(NumCoords);
-		GeometryElement.GeomIndices.SetNumUninitialized(NumIndices);
+		// The mesh is stored once no matter how many instances overlap the tile
+		AreaGeneratorData->RawGeometry.AppendInstanced(CollisionCache.Verts, CollisionCache.Header.NumVerts,
+			CollisionCache.Indices, CollisionCache.Header.NumFaces, MoveTemp(PerInstanceTransform));
+		return;
+	}
 
-		FMemory::Memcpy(GeometryElement.GeomCoords.GetData(), CollisionCache.Verts, sizeof(float) * NumCoords);
-		FMemory::Memcpy(GeometryElement.GeomIndices.GetData(), CollisionCache.Indices, sizeof(int32) * NumIndices);
+	UE_LOG(LogNavigationDataBuild, VeryVerbose, TEXT("%s adding %i vertices from %s."), ANSI_TO_TCHAR(__FUNCTION__), CollisionCache.Header.NumVerts, *GetFullNameSafe(DataRef.GetOwner()));
+
+	// Reads the cached collision directly, converting each vertex only once
+	AreaGeneratorData->RawGeometry.Append(CollisionCache.Verts, CollisionCache.Header.NumVerts,
+		CollisionCache.Indices, CollisionCache.Header.NumFaces);
+}
 
-		AreaGeneratorData->RawGeometry.Add(MoveTemp(GeometryElement));
+uint32 FNNAreaGenerator::CalculateGeometryHash(const FNavigationRelevantData& DataRef, const TArray<FTransform>& PerInstanceTransform) const
+{
+	// The collision data is in world space so it changes when the element moves
+	uint32 Hash = FCrc::MemCrc32(DataRef.CollisionData.GetData(), DataRef.CollisionData.Num());
+	Hash = FCrc::MemCrc32(PerInstanceTransform.GetData(), PerInstanceTransform.Num() * sizeof(FTransform), Hash);
+	return HashCombine(Hash, VoxelSettingsHash);
+}
+
+void FNNAreaGenerator::RasterizeUncachedElements()
+{
+	const TWeakObjectPtr<ANNNavMesh> NavMesh = ParentGenerator->GetOwner();
+	const FHeightFieldGenerator HeightFieldGenerator (*AreaGeneratorData);
+
+	// The columns of the tile HeightField
+	const FVector& TileMin = AreaBounds.AreaBox.Min;
+	const FVector& TileMax = AreaBounds.AreaBox.Max;
+	const float CellSize = NavMesh->CellSize;
+	const float CellHeight = NavMesh->CellHeight;
+	const int32 TileUnitsWidth = FMath::CeilToInt((TileMax.X - TileMin.X) / CellSize);
+	const int32 TileUnitsDepth = FMath::CeilToInt((TileMax.Y - TileMin.Y) / CellSize);
+	const int32 TileUnitsHeight = FMath::CeilToInt((TileMax.Z - TileMin.Z) / CellHeight);
+
+	// Each element is rasterized in its own HeightField so its spans can be reused by the next builds.
+	// The HeightField only covers the tile columns around the element geometry
+	TArray<TSharedPtr<const FNNVoxelCache, ESPMode::ThreadSafe>> RasterizedVoxels;
+	RasterizedVoxels.SetNum(UncachedElements.Num());
+	ParallelFor(UncachedElements.Num(), [&](int32 ElementIndex)
+	{
+		const TSharedRef<FNNVoxelCache, ESPMode::ThreadSafe> Voxels = MakeShared<FNNVoxelCache, ESPMode::ThreadSafe>();
+		RasterizedVoxels[ElementIndex] = Voxels;
+
+		const FNNRawGeometryRange& Range = UncachedElements[ElementIndex].Range;
+		const FBox ElementBounds = AreaGeneratorData->RawGeometry.GetRangeBounds(Range);
+		if (!ElementBounds.IsValid || !ElementBounds.Intersect(AreaBounds.AreaBox))
+		{
+			return;
+		}
+
+		// One more column on each side keeps the triangles that touch the border of the element bounds
+		const int32 MinX = FMath::Clamp(FMath::FloorToInt((ElementBounds.Min.X - TileMin.X) / CellSize) - 1, 0, TileUnitsWidth);
+		const int32 MinY = FMath::Clamp(FMath::FloorToInt((ElementBounds.Min.Y - TileMin.Y) / CellSize) - 1, 0, TileUnitsDepth);
+		const int32 MaxX = FMath::Clamp(FMath::CeilToInt((ElementBounds.Max.X - TileMin.X) / CellSize) + 1, MinX, TileUnitsWidth);
+		const int32 MaxY = FMath::Clamp(FMath::CeilToInt((ElementBounds.Max.Y - TileMin.Y) / CellSize) + 1, MinY, TileUnitsDepth);
+		if (MinX == MaxX || MinY == MaxY)
+		{
+			return;
+		}
+
+		// Aligned with the tile columns and with the same heights so the spans can be merged directly
+		FNNHeightField ElementHeightField (MaxX - MinX, TileUnitsHeight, MaxY - MinY);
+		ElementHeightField.CellSize = CellSize;
+		ElementHeightField.CellHeight = CellHeight;
+		ElementHeightField.MinPoint = FVector(TileMin.X + MinX * CellSize, TileMin.Y + MinY * CellSize, TileMin.Z);
+		ElementHeightField.MaxPoint = FVector(FMath::Min(TileMin.X + MaxX * CellSize, TileMax.X),
+			FMath::Min(TileMin.Y + MaxY * CellSize, TileMax.Y), TileMax.Z);
+		HeightFieldGenerator.RasterizeGeometry(ElementHeightField, AreaGeneratorData->RawGeometry, Range, NavMesh->WalkableSlopeDegrees);
+		FHeightFieldGenerator::CacheSpans(ElementHeightField, FIntPoint(MinX, MinY), TileUnitsWidth, *Voxels);
+	});
+
+	for (int32 i = 0; i < UncachedElements.Num(); ++i)
+	{
+		const FNNUncachedElement& UncachedElement = UncachedElements[i];
+		if (UncachedElement.ElementKey != FObjectKey())
+		{
+			FNNVoxelCacheEntry& Entry = TileVoxelCache.Add(UncachedElement.ElementKey);
+			Entry.GeometryHash = UncachedElement.GeometryHash;
+			Entry.Voxels = RasterizedVoxels[i];
+		}
+		AreaGeneratorData->ElementsVoxels.Add(MoveTemp(RasterizedVoxels[i]));
 	}
+
+	// The elements that were not gathered in this build are discarded from the cache
+	ParentGenerator->UpdateVoxelCache(AreaBounds.UniqueID, MoveTemp(TileVoxelCache));
+	UncachedElements.Reset();
 }
@@ -1,17 +1,22 @@
 ﻿#include "NavData/NNNavMesh.h"
 
 // UE Includes
-#include "AbstractNavData.h"
+#include "AI/Navigation/NavAgentInterface.h"
 #include "NavigationSystem.h"
+#include "NavAreas/NavArea.h"
+#include "NavAreas/NavArea_Null.h"
 
 // NN Includes
 #include "NavData/NNNavMeshGenerator.h"
 #include "NavData/NNNavMeshRenderingComp.h"
+#include "NavData/Pathfinding/NNQueryFilter.h"
 
 ANNNavMesh::ANNNavMesh()
 {
 	FindPathImplementation = FindPath;
-	DefaultQueryFilter->SetFilterImplementation(new FAbstractQueryFilter());
+	RaycastImplementation = NavMeshRaycast;
+	TestPathImplementation = TestPath;
+	DefaultQueryFilter->SetFilterImplementation(new FNNQueryFilter());
 }
 
 FPathFindingResult ANNNavMesh::FindPath(const FNavAgentProperties& AgentProperties, const FPathFindingQuery& Query)
@@ -22,6 +27,82 @@ FPathFindingResult ANNNavMesh::FindPath(const FNavAgentProperties& AgentProperti
 	return Result;
 }
 
+bool ANNNavMesh::TestPath(const FNavAgentProperties& AgentProperties, const FPathFindingQuery& Query, int32* NumVisitedNodes)
+{
+	const ANNNavMesh* Self = Cast<ANNNavMesh>(Query.NavData.Get());
+	const FNNNavMeshGenerator* Generator = Self ? static_cast<FNNNavMeshGenerator*>(Self->NavDataGenerator.Get()) : nullptr;
+	return Generator && Generator->TestPath(Query, NumVisitedNodes);
+}
+
+bool ANNNavMesh::NavMeshRaycast(const ANavigationData* Self, const FVector& RayStart, const FVector& RayEnd,
+	FVector& HitLocation, FSharedConstNavQueryFilter QueryFilter, const UObject* Querier)
+{
+	const ANNNavMesh* NavMesh = Cast<const ANNNavMesh>(Self);
+	if (!NavMesh)
+	{
+		HitLocation = RayStart;
+		return true;
+	}
+	FNNRaycastResult Result;
+	const bool bHit = NavMesh->RaycastWithResult(RayStart, RayEnd, Result, QueryFilter, Querier);
+	HitLocation = Result.HitLocation;
+	return bHit;
+}
+
+bool ANNNavMesh::RaycastWithResult(const FVector& RayStart, const FVector& RayEnd, FNNRaycastResult& OutResult,
+	FSharedConstNavQueryFilter QueryFilter, const UObject* Querier) const
+{
+	return RaycastWithResult(FNavLocation(RayStart), RayEnd, OutResult, QueryFilter, Querier);
+}
+
+bool ANNNavMesh::RaycastWithResult(const FNavLocation& RayStart, const FVector& RayEnd, FNNRaycastResult& OutResult,
+	FSharedConstNavQueryFilter QueryFilter, const UObject* Querier) const
+{
+	const FNNNavMeshGenerator* Generator = static_cast<FNNNavMeshGenerator*>(NavDataGenerator.Get());
+	if (!Generator)
+	{
+		OutResult.HitLocation = RayStart.Location;
+		return true;
+	}
+	return Generator->Raycast(RayStart, RayEnd, OutResult, QueryFilter, Querier);
+}
+
+ENavigationQueryResult::Type ANNNavMesh::CalcPathCost(const FVector& PathStart, const FVector& PathEnd,
+	float& OutPathCost, FSharedConstNavQueryFilter QueryFilter, const UObject* Querier) const
+{
+	const FNNNavMeshGenerator* Generator = static_cast<FNNNavMeshGenerator*>(NavDataGenerator.Get());
+	if (!Generator)
+	{
+		return ENavigationQueryResult::Error;
+	}
+	const FPathFindingQuery Query (Querier, *this, PathStart, PathEnd, QueryFilter);
+	return Generator->CalcPathLengthAndCost(Query, nullptr, &OutPathCost);
+}
+
+ENavigationQueryResult::Type ANNNavMesh::CalcPathLength(const FVector& PathStart, const FVector& PathEnd,
+	float& OutPathLength, FSharedConstNavQueryFilter QueryFilter, const UObject* Querier) const
+{
+	const FNNNavMeshGenerator* Generator = static_cast<FNNNavMeshGenerator*>(NavDataGenerator.Get());
+	if (!Generator)
+	{
+		return ENavigationQueryResult::Error;
+	}
+	const FPathFindingQuery Query (Querier, *this, PathStart, PathEnd, QueryFilter);
+	return Generator->CalcPathLengthAndCost(Query, &OutPathLength, nullptr);
+}
+
+ENavigationQueryResult::Type ANNNavMesh::CalcPathLengthAndCost(const FVector& PathStart, const FVector& PathEnd,
+	float& OutPathLength, float& OutPathCost, FSharedConstNavQueryFilter QueryFilter, const UObject* Querier) const
+{
+	const FNNNavMeshGenerator* Generator = static_cast<FNNNavMeshGenerator*>(NavDataGenerator.Get());
+	if (!Generator)
+	{
+		return ENavigationQueryResult::Error;
+	}
+	const FPathFindingQuery Query (Querier, *this, PathStart, PathEnd, QueryFilter);
+	return Generator->CalcPathLengthAndCost(Query, &OutPathLength, &OutPathCost);
+}
+
 bool ANNNavMesh::ProjectPoint(const FVector& Point, FNavLocation& OutLocation, const FVector& Extent,
 	FSharedConstNavQueryFilter Filter, const UObject* Querier) const
 {
@@ -29,16 +110,205 @@ bool ANNNavMesh::ProjectPoint(const FVector& Point, FNavLocation& OutLocation, c
 	return Generator->ProjectPoint(Point, OutLocation, Extent, Filter, Querier);
 }
 
+FNavLocation ANNNavMesh::GetRandomPoint(FSharedConstNavQueryFilter Filter, const UObject* Querier) const
+{
+	FNavLocation RandomPoint;
+	const FNNNavMeshGenerator* Generator = static_cast<FNNNavMeshGenerator*>(NavDataGenerator.Get());
+	if (Generator)
+	{
+		Generator->GetRandomPoint(RandomPoint, Filter, Querier);
+	}
+	return RandomPoint;
+}
+
+bool ANNNavMesh::GetRandomReachablePointInRadius(const FVector& Origin, float Radius, FNavLocation& OutResult,
+	FSharedConstNavQueryFilter Filter, const UObject* Querier) const
+{
+	const FNNNavMeshGenerator* Generator = static_cast<FNNNavMeshGenerator*>(NavDataGenerator.Get());
+	return Generator && Generator->GetRandomReachablePointInRadius(Origin, Radius, OutResult, Filter, Querier);
+}
+
 bool ANNNavMesh::GetPolygonFromNavLocation(const FNavLocation& NavLocation, FNNPolygon& OutPolygon) const
 {
 	const FNNNavMeshGenerator* Generator = static_cast<FNNNavMeshGenerator*>(NavDataGenerator.Get());
 	return Generator->GetPolygonFromNavLocation(NavLocation, OutPolygon);
 }
 
+bool ANNNavMesh::FindPolygonPath(const FNavLocation& Start, const FNavLocation& End, TArray<NavNodeRef>& OutPath,
+	FSharedConstNavQueryFilter Filter, int32 MaxIterations) const
+{
+	const FNNNavMeshGenerator* Generator = static_cast<FNNNavMeshGenerator*>(NavDataGenerator.Get());
+	return Generator && Generator->FindPolygonPath(Start, End, OutPath, Filter, MaxIterations);
+}
+
+bool ANNNavMesh::MoveAlongSurface(const FNavLocation& Start, const FVector& Target, FNavLocation& OutLocation,
+	TArray<NavNodeRef>& OutVisited, FSharedConstNavQueryFilter Filter) const
+{
+	const FNNNavMeshGenerator* Generator = static_cast<FNNNavMeshGenerator*>(NavDataGenerator.Get());
+	return Generator && Generator->MoveAlongSurface(Start, Target, OutLocation, OutVisited, Filter);
+}
+
+uint32 ANNNavMesh::GetPolygonBuildID(NavNodeRef NodeRef) const
+{
+	const FNNNavMeshGenerator* Generator = static_cast<FNNNavMeshGenerator*>(NavDataGenerator.Get());
+	return Generator ? Generator->GetPolygonBuildID(NodeRef) : 0;
+}
+
+int32 ANNNavMesh::AddCylinderObstacle(const FVector& Base, float Radius, float Height)
+{
+	FNNNavMeshGenerator* Generator = static_cast<FNNNavMeshGenerator*>(NavDataGenerator.Get());
+	if (!Generator)
+	{
+		return INDEX_NONE;
+	}
+
+	FNNAreaModifier Obstacle;
+	Obstacle.ShapeType = ENavigationShapeType::Cylinder;
+	Obstacle.Bounds = FBox(Base - FVector(Radius, Radius, 0.0f), Base + FVector(Radius, Radius, Height));
+	Obstacle.Center = Base;
+	Obstacle.Radius = Radius;
+	Obstacle.AreaID = NNNavAreas::NullAreaID;
+	return Generator->AddObstacle(MoveTemp(Obstacle));
+}
+
+int32 ANNNavMesh::AddBoxObstacle(const FBox& Box)
+{
+	FNNNavMeshGenerator* Generator = static_cast<FNNNavMeshGenerator*>(NavDataGenerator.Get());
+	if (!Generator)
+	{
+		return INDEX_NONE;
+	}
+
+	FNNAreaModifier Obstacle;
+	Obstacle.ShapeType = ENavigationShapeType::Box;
+	Obstacle.Bounds = Box;
+	Obstacle.AreaID = NNNavAreas::NullAreaID;
+	return Generator->AddObstacle(MoveTemp(Obstacle));
+}
+
+int32 ANNNavMesh::AddConvexObstacle(const TArray<FVector>& Points, float MinZ, float MaxZ)
+{
+	FNNNavMeshGenerator* Generator = static_cast<FNNNavMeshGenerator*>(NavDataGenerator.Get());
+	if (!Generator || Points.Num() < 3)
+	{
+		return INDEX_NONE;
+	}
+
+	FNNAreaModifier Obstacle;
+	Obstacle.ShapeType = ENavigationShapeType::Convex;
+	Obstacle.Bounds = FBox(Points);
+	Obstacle.Bounds.Min.Z = MinZ;
+	Obstacle.Bounds.Max.Z = MaxZ;
+	Obstacle.ConvexPoints = Points;
+	Obstacle.MinZ = MinZ;
+	Obstacle.MaxZ = MaxZ;
+	Obstacle.AreaID = NNNavAreas::NullAreaID;
+	return Generator->AddObstacle(MoveTemp(Obstacle));
+}
+
+bool ANNNavMesh::RemoveObstacle(int32 ObstacleID)
+{
+	FNNNavMeshGenerator* Generator = static_cast<FNNNavMeshGenerator*>(NavDataGenerator.Get());
+	return Generator && Generator->RemoveObstacle(ObstacleID);
+}
+
+FNNAgentProfile ANNNavMesh::GetAgentProfile(int32 ProfileIndex) const
+{
+	if (ProfileIndex == 0)
+	{
+		return FNNAgentProfile(AgentRadius, AgentHeight, MaxLedgeHeight);
+	}
+	return AdditionalAgentProfiles[ProfileIndex - 1];
+}
+
+int32 ANNNavMesh::GetAgentProfileIndex(const FNavAgentProperties& AgentProperties) const
+{
+	// The agents without a size use the default profile
+	if (AgentProperties.AgentRadius < 0.0f)
+	{
+		return 0;
+	}
+
+	int32 BestProfileIndex = INDEX_NONE;
+	float BestRadius = BIG_NUMBER;
+	// The agents bigger than every profile use the biggest one
+	int32 LargestProfileIndex = 0;
+	FNNAgentProfile LargestProfile = GetAgentProfile(0);
+	for (int32 i = 0; i < GetAgentProfilesNum(); ++i)
+	{
+		const FNNAgentProfile Profile = GetAgentProfile(i);
+		if (Profile.AgentRadius >= AgentProperties.AgentRadius && Profile.AgentHeight >= AgentProperties.AgentHeight && Profile.AgentRadius < BestRadius)
+		{
+			BestRadius = Profile.AgentRadius;
+			BestProfileIndex = i;
+		}
+		if (Profile.AgentRadius > LargestProfile.AgentRadius
+			|| (Profile.AgentRadius == LargestProfile.AgentRadius && Profile.AgentHeight > LargestProfile.AgentHeight))
+		{
+			LargestProfile = Profile;
+			LargestProfileIndex = i;
+		}
+	}
+	return BestProfileIndex != INDEX_NONE ? BestProfileIndex : LargestProfileIndex;
+}
+
+int32 ANNNavMesh::GetAgentProfileIndex(const UObject* Querier) const
+{
+	const INavAgentInterface* NavAgent = Cast<const INavAgentInterface>(Querier);
+	return NavAgent ? GetAgentProfileIndex(NavAgent->GetNavAgentPropertiesRef()) : 0;
+}
+
+const FNNQueryFilter& ANNNavMesh::GetQueryFilterImplementation(FSharedConstNavQueryFilter Filter) const
+{
+	const FNavigationQueryFilter& QueryFilter = Filter.IsValid() ? *Filter : *GetDefaultQueryFilter();
+	return *static_cast<const FNNQueryFilter*>(QueryFilter.GetImplementation());
+}
+
+void ANNNavMesh::OnNavAreaAdded(const UClass* NavAreaClass, int32 AgentIndex)
+{
+	Super::OnNavAreaAdded(NavAreaClass, AgentIndex);
+
+	const int32 AreaID = GetAreaID(NavAreaClass);
+	const UNavArea* DefArea = NavAreaClass ? NavAreaClass->GetDefaultObject<UNavArea>() : nullptr;
+	if (AreaID == INDEX_NONE || !DefArea)
+	{
+		return;
+	}
+
+	INavigationQueryFilterInterface* FilterImplementation = DefaultQueryFilter->GetImplementation();
+	FilterImplementation->SetAreaCost(AreaID, DefArea->DefaultCost);
+	FilterImplementation->SetFixedAreaEnteringCost(AreaID, DefArea->GetFixedAreaEnteringCost());
+}
+
+int32 ANNNavMesh::GetNewAreaID(const UClass* AreaClass) const
+{
+	if (AreaClass == UNavArea_Null::StaticClass())
+	{
+		return NNNavAreas::NullAreaID;
+	}
+	if (AreaClass == FNavigationSystem::GetDefaultWalkableArea())
+	{
+		return NNNavAreas::DefaultAreaID;
+	}
+
+	int32 FreeAreaID = Super::GetNewAreaID(AreaClass);
+	while (FreeAreaID == NNNavAreas::NullAreaID || FreeAreaID == NNNavAreas::DefaultAreaID)
+	{
+		++FreeAreaID;
+	}
+	return FreeAreaID < GetMaxSupportedAreas() ? FreeAreaID : INDEX_NONE;
+}
+
+int32 ANNNavMesh::GetMaxSupportedAreas() const
+{
+	return NNNavAreas::MaxAreas;
+}
+
 void ANNNavMesh::ConditionalConstructGenerator()
 {
 	UE_LOG(LogTemp, Warning, TEXT("%s"), ANSI_TO_TCHAR(__FUNCTION__));
-	if (!GetWorld()->IsGameWorld())
+	// Game worlds only generate the navmesh when the runtime generation is enabled
+	if (!GetWorld()->IsGameWorld() || SupportsRuntimeGeneration())
 	{
 		NavDataGenerator = MakeShareable(new FNNNavMeshGenerator(*this));
 	}
@@ -75,5 +345,31 @@ FBox ANNNavMesh::GetNavMeshBounds() const
 void ANNNavMesh::PostEditChangeChainProperty(FPropertyChangedChainEvent& PropertyChangedEvent)
 {
 	Super::PostEditChangeChainProperty(PropertyChangedEvent);
+
+	if (AdditionalAgentProfiles.Num() >= MaxAgentProfiles)
+	{
+		AdditionalAgentProfiles.SetNum(MaxAgentProfiles - 1);
+	}
+
+	// These settings don't change the voxelization so the compressed HeightFields can be reused
+	static const TArray<FName> LayerProperties = {
+		GET_MEMBER_NAME_CHECKED(ANNNavMesh, AgentHeight),
+		GET_MEMBER_NAME_CHECKED(ANNNavMesh, AgentRadius),
+		GET_MEMBER_NAME_CHECKED(ANNNavMesh, MaxLedgeHeight),
+		GET_MEMBER_NAME_CHECKED(ANNNavMesh, AdditionalAgentProfiles),
+		GET_MEMBER_NAME_CHECKED(ANNNavMesh, MinRegionSize),
+		GET_MEMBER_NAME_CHECKED(ANNNavMesh, PartitionMode),
+		GET_MEMBER_NAME_CHECKED(ANNNavMesh, ContourDeviationThreshold),
+		GET_MEMBER_NAME_CHECKED(ANNNavMesh, MaxEdgeLength),
+	};
+	FNNNavMeshGenerator* Generator = static_cast<FNNNavMeshGenerator*>(NavDataGenerator.Get());
+	const FProperty* MemberProperty = PropertyChangedEvent.PropertyChain.GetActiveMemberNode()
+		? PropertyChangedEvent.PropertyChain.GetActiveMemberNode()->GetValue()
+		: nullptr;
+	if (Generator && MemberProperty && LayerProperties.Contains(MemberProperty->GetFName()))
+	{
+		Generator->RebuildFromCompressedLayers();
+		return;
+	}
 	RebuildAll();
 }
@@ -1,23 +1,32 @@
 ﻿#include "NavData/NNNavMeshGenerator.h"
 
 // UE Includes
-#include "Algo/Transform.h"
 #include "Async/AsyncWork.h"
-#include "Collision.h"
-#include "CompGeom/PolygonTriangulation.h"
 #include "Kismet/KismetMathLibrary.h"
+#include "NavigationSystem.h"
 
 // NN Includes
 #include "NavData/Contour/NNContourGeneration.h"
 #include "NavData/NNNavMeshRenderingComp.h"
+#include "NavData/Pathfinding/NNQueryFilter.h"
 #include "NavData/Voxelization/HeightFieldGenerator.h"
 #include "NavData/Voxelization/OpenHeightFieldGenerator.h"
 
 namespace NNNavMeshGeneratorHelpers
 {
 	/** Quantity of bits used for the polygon index when generating the NavNodeRef */
-	constexpr uint8 PolygonIndexNodeRefBits = 12;
-	
+	constexpr uint8 PolygonIndexNodeRefBits = 24;
+
+	/** Quantity of bits used for the agent profile index. The bits above them store the nav bound ID */
+	constexpr uint8 ProfileIndexNodeRefBits = 8;
+	static_assert(ANNNavMesh::MaxAgentProfiles <= (1 << ProfileIndexNodeRefBits), "The agent profile index doesn't fit in the NavNodeRef");
+
+	/** Returns the navmesh of the agent profile. Nullptr when the profile was added after the data was built */
+	FNNAgentNavData* GetAgentNavData(FNNAreaGeneratorData* GeneratorData, int32 ProfileIndex)
+	{
+		return GeneratorData && GeneratorData->AgentsNavData.IsValidIndex(ProfileIndex) ? &GeneratorData->AgentsNavData[ProfileIndex] : nullptr;
+	}
+
 	FNNNavMeshDebuggingInfo::PolygonDebugInfo BuildDebugInfoFromPolygon(
 		const FNNOpenHeightField& OpenHeightField, const FNNPolygonMesh& PolygonMesh, const FNNPolygon& Polygon)
 	{
@@ -36,25 +45,14 @@ namespace NNNavMeshGeneratorHelpers
 		}
 		return FNNNavMeshDebuggingInfo::PolygonDebugInfo(Vertexes, Indexes);
 	}
-
-	void GetPolygonVertexes(const FNNPolygon& Polygon, const FNNAreaGeneratorData& GeneratorData, TArray<FVector>& OutPolygonVertexes)
-	{
-		OutPolygonVertexes.Reserve(Polygon.Indexes.Num());
-		for (const int32 Index : Polygon.Indexes)
-		{
-			if (Index == INDEX_NONE)
-			{
-				break;
-			}
-			const FVector& Vertex = GeneratorData.PolygonMesh.Vertexes[Index];
-			OutPolygonVertexes.Add(GeneratorData.OpenHeightField.TransformVectorToWorldPosition(Vertex));
-		}
-	}
 }
 
 FNNNavMeshGenerator::FNNNavMeshGenerator(ANNNavMesh& InNavMesh)
 	: NavMesh(&InNavMesh), NavBounds(InNavMesh.GetRegisteredBounds())
-{}
+{
+	const UNavigationSystemV1* NavSys = FNavigationSystem::GetCurrent<UNavigationSystemV1>(InNavMesh.GetWorld());
+	bGenerateAroundInvokers = InNavMesh.GetWorld()->IsGameWorld() && NavSys && NavSys->IsActiveTilesGenerationEnabled();
+}
 
 FNNNavMeshGenerator::~FNNNavMeshGenerator()
 {
@@ -79,26 +77,44 @@ FNNNavMeshGenerator::~FNNNavMeshGenerator()
 void FNNNavMeshGenerator::TickAsyncBuild(float DeltaSeconds)
 {
 	CheckAsyncTasks();
+	if (bGenerateAroundInvokers)
+	{
+		UpdateInvokerAreas();
+	}
 	ProcessDirtyAreas();
+	ProcessLayerDirtyAreas();
 }
 
 bool FNNNavMeshGenerator::RebuildAll()
 {
 	for (const FNavigationBounds& NavBound : NavBounds)
 	{
-		DirtyAreas.AddUnique(NavBound.UniqueID);
+		// The bounds away from the invokers are built when an invoker gets near
+		if (!bGenerateAroundInvokers || InvokerAreas.Contains(NavBound.UniqueID))
+		{
+			DirtyAreas.AddUnique(NavBound.UniqueID);
+		}
 	}
 	GeneratorsData.Reset();
 	return true;
 }
 
+void FNNNavMeshGenerator::RebuildFromCompressedLayers()
+{
+	for (const auto& GeneratorData : GeneratorsData)
+	{
+		LayerDirtyAreas.AddUnique(GeneratorData.Key);
+	}
+}
+
 void FNNNavMeshGenerator::RebuildDirtyAreas(const TArray<FNavigationDirtyArea>& NavigationDirtyAreas)
 {
 	for (const FNavigationDirtyArea& NavigationDirtyArea : NavigationDirtyAreas)
 	{
 		for (const FNavigationBounds& NavBound : NavBounds)
 		{
-			if (NavBound.AreaBox.Intersect(NavigationDirtyArea.Bounds))
+			const bool bActiveArea = !bGenerateAroundInvokers || InvokerAreas.Contains(NavBound.UniqueID);
+			if (bActiveArea && NavBound.AreaBox.Intersect(NavigationDirtyArea.Bounds))
 			{
 				DirtyAreas.Add(NavBound.UniqueID);
 			}
@@ -134,14 +150,24 @@ void FNNNavMeshGenerator::CheckAsyncTasks()
 		{
 			bRefreshRenderer = true;
 			FNNAreaGenerator& AreaGenerator = WorkingTask.Task->GetTask();
-			GeneratorsData.Add(BoundID, AreaGenerator.RetrieveGeneratorData());
+			FNNAreaGeneratorData* GeneratorData = AreaGenerator.RetrieveGeneratorData();
+			GeneratorData->BuildID = NextBuildID++;
+
+			// The obstacle updates keep the previous data until they finish
+			if (FNNAreaGeneratorData** PreviousData = GeneratorsData.Find(BoundID))
+			{
+				delete (*PreviousData);
+			}
+			GeneratorsData.Add(BoundID, GeneratorData);
 			WorkingTasks.Remove(BoundID);
 		}
 	}
 
-	if (bRefreshRenderer)
+	// Game worlds might not have a rendering component
+	UNNNavMeshRenderingComp* RenderingComp = Cast<UNNNavMeshRenderingComp>(NavMesh->RenderingComp);
+	if (bRefreshRenderer && RenderingComp)
 	{
-		Cast<UNNNavMeshRenderingComp>(NavMesh->RenderingComp)->ForceUpdate();
+		RenderingComp->ForceUpdate();
 	}
 
 	for (int32 i = CanceledTasks.Num() - 1; i >= 0; --i)
@@ -161,14 +187,35 @@ void FNNNavMeshGenerator::ProcessDirtyAreas()
 		return;
 	}
 
+	// The nearest areas to the invokers are built first
+	if (bGenerateAroundInvokers)
+	{
+		TMap<uint32, float> InvokersDistances;
+		for (const uint32 BoundsID : DirtyAreas)
+		{
+			const FNavigationBounds* DirtyArea = FindNavBound(BoundsID);
+			InvokersDistances.Add(BoundsID, DirtyArea ? GetDistanceSquaredToInvokers(DirtyArea->AreaBox) : 0.0f);
+		}
+		DirtyAreas.Sort([&InvokersDistances](uint32 Lhs, uint32 Rhs)
+		{
+			return InvokersDistances[Lhs] < InvokersDistances[Rhs];
+		});
+	}
+
 	const float TimeSeconds = NavMesh->GetWorld()->GetTimeSeconds();
 	const float StartWorkingTasks = TimeSeconds + WaitTimeToStartWorkingTask;
-	for (int32 i = DirtyAreas.Num() - 1; i >= 0; --i)
+	int32 ProcessedNum = 0;
+	for (; ProcessedNum < DirtyAreas.Num(); ++ProcessedNum)
 	{
-		const uint32 BoundsID = DirtyAreas[i];
-		FNavigationBounds DirtyAreaSearch;
-		DirtyAreaSearch.UniqueID = BoundsID;
-		const FNavigationBounds* DirtyArea = NavBounds.Find(DirtyAreaSearch);
+		const uint32 BoundsID = DirtyAreas[ProcessedNum];
+		const FNavigationBounds* DirtyArea = FindNavBound(BoundsID);
+
+		// The rest of the areas wait until a build finishes
+		const bool bOverBudget = bGenerateAroundInvokers && WorkingTasks.Num() >= NavMesh->MaxSimultaneousInvokerBuilds;
+		if (DirtyArea && bOverBudget && !WorkingTasks.Contains(BoundsID))
+		{
+			break;
+		}
 
 		// Deletes the data of this area previously calculated
 		if (FNNAreaGeneratorData** GeneratorData = GeneratorsData.Find(BoundsID))
@@ -178,7 +225,12 @@ void FNNNavMeshGenerator::ProcessDirtyAreas()
 		}
 
 		// The area might have been deleted
-		if (DirtyArea)
+		if (!DirtyArea)
+		{
+			FScopeLock Lock (&VoxelCacheLock);
+			VoxelCache.Remove(BoundsID);
+		}
+		else
 		{
 			// Cancels any task that is currently calculating the same area
 			if (const FNNWorkingAsyncTask* WorkingAsyncTask = WorkingTasks.Find(BoundsID))
@@ -195,7 +247,169 @@ void FNNNavMeshGenerator::ProcessDirtyAreas()
 			WorkingTasks.Emplace(BoundsID, MoveTemp(WorkingTask));
 		}
 	}
-	DirtyAreas.Reset();
+	DirtyAreas.RemoveAt(0, ProcessedNum);
+}
+
+void FNNNavMeshGenerator::UpdateInvokerAreas()
+{
+	const UNavigationSystemV1* NavSys = FNavigationSystem::GetCurrent<UNavigationSystemV1>(GetWorld());
+	if (!NavSys)
+	{
+		return;
+	}
+
+	bool bRemovedArea = false;
+	const TArray<FNavigationInvokerRaw>& Invokers = NavSys->GetInvokersLocations();
+	for (const FNavigationBounds& NavBound : NavBounds)
+	{
+		// The areas are built inside the minimum radius and kept until they leave the maximum radius
+		bool bInsideMinRadius = false;
+		bool bInsideMaxRadius = false;
+		for (const FNavigationInvokerRaw& Invoker : Invokers)
+		{
+			const float DistanceSquared = NavBound.AreaBox.ComputeSquaredDistanceToPoint(Invoker.Location);
+			bInsideMinRadius |= DistanceSquared <= FMath::Square(Invoker.RadiusMin);
+			bInsideMaxRadius |= DistanceSquared <= FMath::Square(Invoker.RadiusMax);
+		}
+
+		const uint32 BoundsID = NavBound.UniqueID;
+		if (bInsideMinRadius && !InvokerAreas.Contains(BoundsID))
+		{
+			InvokerAreas.Add(BoundsID);
+			DirtyAreas.AddUnique(BoundsID);
+		}
+		else if (!bInsideMaxRadius && InvokerAreas.Contains(BoundsID))
+		{
+			InvokerAreas.Remove(BoundsID);
+			RemoveAreaData(BoundsID);
+			bRemovedArea = true;
+		}
+	}
+
+	UNNNavMeshRenderingComp* RenderingComp = Cast<UNNNavMeshRenderingComp>(NavMesh->RenderingComp);
+	if (bRemovedArea && RenderingComp)
+	{
+		RenderingComp->ForceUpdate();
+	}
+}
+
+void FNNNavMeshGenerator::RemoveAreaData(uint32 NavBoundID)
+{
+	if (FNNAreaGeneratorData** GeneratorData = GeneratorsData.Find(NavBoundID))
+	{
+		delete (*GeneratorData);
+		GeneratorsData.Remove(NavBoundID);
+	}
+
+	if (const FNNWorkingAsyncTask* WorkingAsyncTask = WorkingTasks.Find(NavBoundID))
+	{
+		if (WorkingAsyncTask->bStarted)
+		{
+			CanceledTasks.Add(WorkingAsyncTask->Task);
+		}
+		else
+		{
+			delete WorkingAsyncTask->Task;
+		}
+		WorkingTasks.Remove(NavBoundID);
+	}
+
+	DirtyAreas.Remove(NavBoundID);
+	LayerDirtyAreas.Remove(NavBoundID);
+
+	FScopeLock Lock (&VoxelCacheLock);
+	VoxelCache.Remove(NavBoundID);
+}
+
+float FNNNavMeshGenerator::GetDistanceSquaredToInvokers(const FBox& Box) const
+{
+	const UNavigationSystemV1* NavSys = FNavigationSystem::GetCurrent<UNavigationSystemV1>(GetWorld());
+	float MinDistanceSquared = TNumericLimits<float>::Max();
+	if (NavSys)
+	{
+		for (const FNavigationInvokerRaw& Invoker : NavSys->GetInvokersLocations())
+		{
+			MinDistanceSquared = FMath::Min(MinDistanceSquared, Box.ComputeSquaredDistanceToPoint(Invoker.Location));
+		}
+	}
+	return MinDistanceSquared;
+}
+
+const FNavigationBounds* FNNNavMeshGenerator::FindNavBound(uint32 NavBoundID) const
+{
+	FNavigationBounds NavBoundSearch;
+	NavBoundSearch.UniqueID = NavBoundID;
+	return NavBounds.Find(NavBoundSearch);
+}
+
+void FNNNavMeshGenerator::MarkObstacleDirty(const FBox& ObstacleBounds)
+{
+	for (const FNavigationBounds& NavBound : NavBounds)
+	{
+		if (NavBound.AreaBox.Intersect(ObstacleBounds))
+		{
+			LayerDirtyAreas.AddUnique(NavBound.UniqueID);
+		}
+	}
+}
+
+void FNNNavMeshGenerator::ProcessLayerDirtyAreas()
+{
+	const float TimeSeconds = NavMesh->GetWorld()->GetTimeSeconds();
+	for (int32 i = LayerDirtyAreas.Num() - 1; i >= 0; --i)
+	{
+		const uint32 BoundsID = LayerDirtyAreas[i];
+
+		// The running task might have cached the obstacles before they changed. Waits until it finishes
+		if (WorkingTasks.Contains(BoundsID))
+		{
+			continue;
+		}
+		LayerDirtyAreas.RemoveAtSwap(i);
+
+		// Areas that were not built yet will apply the obstacles in their first build
+		FNNAreaGeneratorData** GeneratorData = GeneratorsData.Find(BoundsID);
+		const FNavigationBounds* DirtyArea = FindNavBound(BoundsID);
+		if (!GeneratorData || !DirtyArea || !(*GeneratorData)->CompressedHeightField.IsValid())
+		{
+			continue;
+		}
+
+		// Starts in the next tick without waiting like the full builds
+		FAsyncTask<FNNAreaGenerator>* Task = new FAsyncTask<FNNAreaGenerator>(this, *DirtyArea, **GeneratorData);
+		FNNWorkingAsyncTask WorkingTask = FNNWorkingAsyncTask(Task, TimeSeconds);
+		WorkingTasks.Emplace(BoundsID, MoveTemp(WorkingTask));
+	}
+}
+
+int32 FNNNavMeshGenerator::AddObstacle(FNNAreaModifier&& Obstacle)
+{
+	const int32 ObstacleID = NextObstacleID++;
+	MarkObstacleDirty(Obstacle.Bounds);
+	Obstacles.Add(ObstacleID, MoveTemp(Obstacle));
+	return ObstacleID;
+}
+
+bool FNNNavMeshGenerator::RemoveObstacle(int32 ObstacleID)
+{
+	FNNAreaModifier Obstacle;
+	if (!Obstacles.RemoveAndCopyValue(ObstacleID, Obstacle))
+	{
+		return false;
+	}
+	MarkObstacleDirty(Obstacle.Bounds);
+	return true;
+}
+
+void FNNNavMeshGenerator::GetObstaclesInBounds(const FBox& Bounds, TArray<FNNAreaModifier>& OutObstacles) const
+{
+	for (const auto& Obstacle : Obstacles)
+	{
+		if (Obstacle.Value.Bounds.Intersect(Bounds))
+		{
+			OutObstacles.Add(Obstacle.Value);
+		}
+	}
 }
 
 int32 FNNNavMeshGenerator::GetNumRunningBuildTasks() const
@@ -213,7 +427,7 @@ int32 FNNNavMeshGenerator::GetNumRunningBuildTasks() const
 
 bool FNNNavMeshGenerator::IsBuildInProgressCheckDirty() const
 {
-	return DirtyAreas.Num() > 0 || GetNumRunningBuildTasks() > 0;
+	return DirtyAreas.Num() > 0 || LayerDirtyAreas.Num() > 0 || GetNumRunningBuildTasks() > 0;
 }
 
 void FNNNavMeshGenerator::CancelBuild()
@@ -241,10 +455,32 @@ bool FNNNavMeshGenerator::GetNavBoundIDForLocation(const FVector& Start, int32&
 	return false;
 }
 
-NavNodeRef FNNNavMeshGenerator::GeneratePolygonNodeRef(int32 NavBoundID, int32 PolygonIndex)
+FNNAreaGeneratorData* FNNNavMeshGenerator::GetGeneratorDataForLocation(const FVector& Location) const
 {
-	uint64 NodeRef = NavBoundID << NNNavMeshGeneratorHelpers::PolygonIndexNodeRefBits;
-	NodeRef += PolygonIndex;
+	int32 BoundID;
+	if (!GetNavBoundIDForLocation(Location, BoundID))
+	{
+		return nullptr;
+	}
+	FNNAreaGeneratorData* const* GeneratorData = GeneratorsData.Find(BoundID);
+	return GeneratorData ? *GeneratorData : nullptr;
+}
+
+int32 FNNNavMeshGenerator::GetQueryProfileIndex(const FPathFindingQuery& Query) const
+{
+	if (Query.NavAgentProperties.AgentRadius >= 0.0f)
+	{
+		return NavMesh->GetAgentProfileIndex(Query.NavAgentProperties);
+	}
+	return NavMesh->GetAgentProfileIndex(Query.Owner.Get());
+}
+
+NavNodeRef FNNNavMeshGenerator::GeneratePolygonNodeRef(uint32 NavBoundID, int32 ProfileIndex, int32 PolygonIndex)
+{
+	using namespace NNNavMeshGeneratorHelpers;
+	uint64 NodeRef = static_cast<uint64>(NavBoundID) << (PolygonIndexNodeRefBits + ProfileIndexNodeRefBits);
+	NodeRef |= static_cast<uint64>(ProfileIndex) << PolygonIndexNodeRefBits;
+	NodeRef |= static_cast<uint64>(PolygonIndex);
 	return NodeRef;
 }
 
@@ -258,15 +494,19 @@ FPathFindingResult FNNNavMeshGenerator::FindPath(const FNavAgentProperties& Agen
 		return FPathFindingResult(ENavigationQueryResult::Invalid);
 	}
 
+	// The profile is resolved once. The start and the end are projected on its polygons
+	const int32 ProfileIndex = AgentProperties.AgentRadius >= 0.0f ? NavMesh->GetAgentProfileIndex(AgentProperties) : GetQueryProfileIndex(Query);
 	FNNAreaGeneratorData* const* GeneratorData = GeneratorsData.Find(BoundID);
-	if (!ensureMsgf(GeneratorData, TEXT("The navmesh was no yet baked in the start location")))
+	const FNNAgentNavData* AgentNavData = NNNavMeshGeneratorHelpers::GetAgentNavData(GeneratorData ? *GeneratorData : nullptr, ProfileIndex);
+	if (!ensureMsgf(AgentNavData, TEXT("The navmesh was no yet baked in the start location")))
 	{
 		return FPathFindingResult(ENavigationQueryResult::Error);
 	}
 
-	const FNNPathfinding Pathfinding(**GeneratorData, (*GeneratorData)->OpenHeightField);
-	const FNavPathSharedPtr NavigationPath = Pathfinding.FindPath((*GeneratorData)->PathfindingGraph,
-	                                                              (*GeneratorData)->PolygonMesh, AgentProperties, Query);
+	const FNNQueryFilter& Filter = NavMesh->GetQueryFilterImplementation(Query.QueryFilter);
+	const FNNPathfinding Pathfinding(**GeneratorData, AgentNavData->OpenHeightField);
+	const FNavPathSharedPtr NavigationPath = Pathfinding.FindPath(AgentNavData->PathfindingGraph, AgentNavData->PolygonMesh,
+		Query.StartLocation, Query.EndLocation, NavMesh->GetDefaultQueryExtent(), Filter);
 	if (!NavigationPath)
 	{
 		return FPathFindingResult(ENavigationQueryResult::Invalid);
@@ -276,37 +516,99 @@ FPathFindingResult FNNNavMeshGenerator::FindPath(const FNavAgentProperties& Agen
 	return Result;
 }
 
+ENavigationQueryResult::Type FNNNavMeshGenerator::CalcPathLengthAndCost(const FPathFindingQuery& Query,
+	float* OutPathLength, float* OutPathCost) const
+{
+	int32 StartBoundID;
+	if (!GetNavBoundIDForLocation(Query.StartLocation, StartBoundID))
+	{
+		return ENavigationQueryResult::Error;
+	}
+
+	// The bounds don't share their polygons so there is no path between them
+	int32 EndBoundID;
+	if (!GetNavBoundIDForLocation(Query.EndLocation, EndBoundID) || EndBoundID != StartBoundID)
+	{
+		return ENavigationQueryResult::Fail;
+	}
+
+	FNNAreaGeneratorData* const* GeneratorDataPtr = GeneratorsData.Find(StartBoundID);
+	FNNAreaGeneratorData* GeneratorData = GeneratorDataPtr ? *GeneratorDataPtr : nullptr;
+	const FNNAgentNavData* AgentNavData = NNNavMeshGeneratorHelpers::GetAgentNavData(GeneratorData, GetQueryProfileIndex(Query));
+	if (!AgentNavData)
+	{
+		return ENavigationQueryResult::Error;
+	}
+
+	const FNNQueryFilter& Filter = NavMesh->GetQueryFilterImplementation(Query.QueryFilter);
+	const FNNPathfinding Pathfinding (*GeneratorData, AgentNavData->OpenHeightField);
+	FNNPathSearch Search;
+	if (!Pathfinding.SearchPath(AgentNavData->PathfindingGraph, AgentNavData->PolygonMesh, Query.StartLocation,
+		Query.EndLocation, NavMesh->GetDefaultQueryExtent(), Filter, Search))
+	{
+		return ENavigationQueryResult::Fail;
+	}
+
+	if (OutPathLength)
+	{
+		*OutPathLength = Pathfinding.GetPathLength(AgentNavData->PathfindingGraph, Search);
+	}
+	if (OutPathCost)
+	{
+		*OutPathCost = Pathfinding.GetPathCost(AgentNavData->PathfindingGraph, AgentNavData->PolygonMesh, Filter, Search);
+	}
+	return ENavigationQueryResult::Success;
+}
+
+bool FNNNavMeshGenerator::TestPath(const FPathFindingQuery& Query, int32* NumVisitedNodes) const
+{
+	FNNAreaGeneratorData* GeneratorData = GetGeneratorDataForLocation(Query.StartLocation);
+	const FNNAgentNavData* AgentNavData = NNNavMeshGeneratorHelpers::GetAgentNavData(GeneratorData, GetQueryProfileIndex(Query));
+	if (!AgentNavData)
+	{
+		return false;
+	}
+
+	const FNNQueryFilter& Filter = NavMesh->GetQueryFilterImplementation(Query.QueryFilter);
+	const FNNPathfinding Pathfinding (*GeneratorData, AgentNavData->OpenHeightField);
+	FNNPathSearch Search;
+	const bool bFound = Pathfinding.SearchPath(AgentNavData->PathfindingGraph, AgentNavData->PolygonMesh, Query.StartLocation,
+		Query.EndLocation, NavMesh->GetDefaultQueryExtent(), Filter, Search);
+	if (NumVisitedNodes)
+	{
+		*NumVisitedNodes = Search.VisitedNodes;
+	}
+	return bFound;
+}
+
 bool FNNNavMeshGenerator::ProjectPoint(const FVector& Point, FNavLocation& OutLocation, const FVector& Extent,
 	FSharedConstNavQueryFilter Filter, const UObject* Querier) const
 {
 	const FBox BoundBox (Point - Extent, Point + Extent);
+	const FNNQueryFilter& QueryFilter = NavMesh->GetQueryFilterImplementation(Filter);
+	const int32 ProfileIndex = NavMesh->GetAgentProfileIndex(Querier);
 	const FNavigationBounds* BestBound = nullptr;
 	int32 BestPolygonIndex = INDEX_NONE;
-	float BestDistanceToPoint = BIG_NUMBER;
-	TArray<FVector> BestPolygonVertexes;
+	float BestDistanceSqr = TNumericLimits<float>::Max();
 
-	// Searches for the nearest polygon inside the Extent
+	// Searches for the nearest polygon inside the Extent. Only the polygons near the Point are visited
 	for (const FNavigationBounds& Bound : NavBounds)
 	{
 		if (Bound.AreaBox.Intersect(BoundBox))
 		{
-			if (FNNAreaGeneratorData* const* GeneratorDataPtr = GeneratorsData.Find(Bound.UniqueID))
+			FNNAreaGeneratorData* const* GeneratorDataPtr = GeneratorsData.Find(Bound.UniqueID);
+			if (const FNNAgentNavData* AgentNavData = NNNavMeshGeneratorHelpers::GetAgentNavData(GeneratorDataPtr ? *GeneratorDataPtr : nullptr, ProfileIndex))
 			{
-				FNNAreaGeneratorData* GeneratorData = *GeneratorDataPtr;
-				for (int32 j = 0; j < GeneratorData->PolygonMesh.PolygonIndexes.Num(); ++j)
+				const FNNPathfinding Pathfinding (**GeneratorDataPtr, AgentNavData->OpenHeightField);
+				FVector Location;
+				float DistanceSqr;
+				const int32 PolygonIndex = Pathfinding.FindNearestPolygon(AgentNavData->PolygonMesh, Point, Extent, QueryFilter, Location, DistanceSqr);
+				if (PolygonIndex != INDEX_NONE && DistanceSqr < BestDistanceSqr)
 				{
-					const FNNPolygon& Polygon = GeneratorData->PolygonMesh.PolygonIndexes[j];
-					TArray<FVector> PolygonVertexes;
-					NNNavMeshGeneratorHelpers::GetPolygonVertexes(Polygon, *GeneratorData, PolygonVertexes);
-					const FSeparatingAxisPointCheck PointCheck (PolygonVertexes, Point, Extent, true);
-					if (PointCheck.bHit && PointCheck.BestDist < BestDistanceToPoint)
-					{
-						BestDistanceToPoint = PointCheck.BestDist;
-						BestBound = &Bound;
-						BestPolygonIndex = j;
-						BestPolygonVertexes = MoveTemp(PolygonVertexes);
-					}
-					PolygonVertexes.Reset();
+					BestDistanceSqr = DistanceSqr;
+					BestBound = &Bound;
+					BestPolygonIndex = PolygonIndex;
+					OutLocation = FNavLocation(Location);
 				}
 			}
 		}
@@ -316,32 +618,256 @@ bool FNNNavMeshGenerator::ProjectPoint(const FVector& Point, FNavLocation& OutLo
 		return false;
 	}
 
-	// Retrieves the nearest point between the Point and the nearest polygon
-	TArray<FVector3<float>> PolygonVertexes;
-	FVector3<float> PlaneLocation;
-	FVector3<float> PlaneNormal;
-	Algo::Transform(BestPolygonVertexes, PolygonVertexes, [](const FVector& Vertex) { return Vertex; });
-	PolygonTriangulation::ComputePolygonPlane(PolygonVertexes, PlaneNormal, PlaneLocation);
-	const FPlane Plane (static_cast<FVector>(PlaneLocation), static_cast<FVector>(PlaneNormal));
-	OutLocation = FNavLocation(FVector::PointPlaneProject(Point, Plane));
-	OutLocation.NodeRef = GeneratePolygonNodeRef(BestBound->UniqueID, BestPolygonIndex);
+	OutLocation.NodeRef = GeneratePolygonNodeRef(BestBound->UniqueID, ProfileIndex, BestPolygonIndex);
 	return true;
 }
 
 bool FNNNavMeshGenerator::GetPolygonFromNavLocation(const FNavLocation& NavLocation, FNNPolygon& OutPolygon) const
 {
-	const int32 BoundId = NavLocation.NodeRef >> NNNavMeshGeneratorHelpers::PolygonIndexNodeRefBits;
-	const int32 PolygonIndex = NavLocation.NodeRef & ((1 << NNNavMeshGeneratorHelpers::PolygonIndexNodeRefBits) - 1);
+	int32 PolygonIndex;
+	int32 ProfileIndex;
+	if (const FNNAreaGeneratorData* GeneratorData = GetGeneratorDataFromNodeRef(NavLocation.NodeRef, PolygonIndex, ProfileIndex))
+	{
+		OutPolygon = GeneratorData->AgentsNavData[ProfileIndex].PolygonMesh.PolygonIndexes[PolygonIndex];
+		return true;
+	}
+	return false;
+}
+
+FNNAreaGeneratorData* FNNNavMeshGenerator::GetGeneratorDataFromNodeRef(NavNodeRef NodeRef, int32& OutPolygonIndex, int32& OutProfileIndex) const
+{
+	using namespace NNNavMeshGeneratorHelpers;
+	const uint32 BoundId = NodeRef >> (PolygonIndexNodeRefBits + ProfileIndexNodeRefBits);
+	OutProfileIndex = (NodeRef >> PolygonIndexNodeRefBits) & ((1 << ProfileIndexNodeRefBits) - 1);
+	OutPolygonIndex = NodeRef & ((1 << PolygonIndexNodeRefBits) - 1);
 	if (FNNAreaGeneratorData* const* GeneratorDataPtr = GeneratorsData.Find(BoundId))
 	{
-		FNNAreaGeneratorData* GeneratorData = *GeneratorDataPtr;
-		if (GeneratorData->PolygonMesh.PolygonIndexes.IsValidIndex(PolygonIndex))
+		const FNNAgentNavData* AgentNavData = GetAgentNavData(*GeneratorDataPtr, OutProfileIndex);
+		if (AgentNavData && AgentNavData->PolygonMesh.PolygonIndexes.IsValidIndex(OutPolygonIndex))
+		{
+			return *GeneratorDataPtr;
+		}
+	}
+	return nullptr;
+}
+
+bool FNNNavMeshGenerator::FindPolygonPath(const FNavLocation& Start, const FNavLocation& End,
+	TArray<NavNodeRef>& OutPath, FSharedConstNavQueryFilter Filter, int32 MaxIterations) const
+{
+	OutPath.Reset();
+
+	int32 StartPolygonIndex;
+	int32 EndPolygonIndex;
+	int32 ProfileIndex;
+	int32 EndProfileIndex;
+	FNNAreaGeneratorData* GeneratorData = GetGeneratorDataFromNodeRef(Start.NodeRef, StartPolygonIndex, ProfileIndex);
+	const FNNAreaGeneratorData* EndGeneratorData = GetGeneratorDataFromNodeRef(End.NodeRef, EndPolygonIndex, EndProfileIndex);
+	if (!GeneratorData || GeneratorData != EndGeneratorData || ProfileIndex != EndProfileIndex)
+	{
+		return false;
+	}
+
+	const FNNAgentNavData& AgentNavData = GeneratorData->AgentsNavData[ProfileIndex];
+	const FNNQueryFilter& QueryFilter = NavMesh->GetQueryFilterImplementation(Filter);
+	const FNNPathfinding Pathfinding (*GeneratorData, AgentNavData.OpenHeightField);
+	TArray<int32> PolygonPath;
+	const bool bReached = Pathfinding.FindPolygonPath(AgentNavData.PolygonMesh, StartPolygonIndex, EndPolygonIndex, QueryFilter, MaxIterations, PolygonPath);
+
+	OutPath.Reserve(PolygonPath.Num());
+	for (const int32 PolygonIndex : PolygonPath)
+	{
+		OutPath.Add(AgentNavData.PolygonMesh.PolygonIndexes[PolygonIndex].NodeRef);
+	}
+	return bReached;
+}
+
+bool FNNNavMeshGenerator::MoveAlongSurface(const FNavLocation& Start, const FVector& Target, FNavLocation& OutLocation,
+	TArray<NavNodeRef>& OutVisited, FSharedConstNavQueryFilter Filter) const
+{
+	OutVisited.Reset();
+
+	int32 StartPolygonIndex;
+	int32 ProfileIndex;
+	FNNAreaGeneratorData* GeneratorData = GetGeneratorDataFromNodeRef(Start.NodeRef, StartPolygonIndex, ProfileIndex);
+	if (!GeneratorData)
+	{
+		return false;
+	}
+
+	const FNNAgentNavData& AgentNavData = GeneratorData->AgentsNavData[ProfileIndex];
+	const FNNQueryFilter& QueryFilter = NavMesh->GetQueryFilterImplementation(Filter);
+	const FNNPathfinding Pathfinding (*GeneratorData, AgentNavData.OpenHeightField);
+	TArray<int32> VisitedPolygons;
+	Pathfinding.MoveAlongSurface(AgentNavData.PolygonMesh, StartPolygonIndex, Start.Location, Target, QueryFilter, OutLocation.Location, VisitedPolygons);
+
+	OutVisited.Reserve(VisitedPolygons.Num());
+	for (const int32 PolygonIndex : VisitedPolygons)
+	{
+		OutVisited.Add(AgentNavData.PolygonMesh.PolygonIndexes[PolygonIndex].NodeRef);
+	}
+	OutLocation.NodeRef = OutVisited.Last();
+	return true;
+}
+
+bool FNNNavMeshGenerator::GetRandomPoint(FNavLocation& OutLocation, FSharedConstNavQueryFilter Filter, const UObject* Querier) const
+{
+	// The navmesh of the querier's agent in each nav bound
+	const int32 ProfileIndex = NavMesh->GetAgentProfileIndex(Querier);
+	TArray<TPair<FNNAreaGeneratorData*, const FNNAgentNavData*>> AgentsNavData;
+	AgentsNavData.Reserve(GeneratorsData.Num());
+	for (const auto& GeneratorData : GeneratorsData)
+	{
+		if (const FNNAgentNavData* AgentNavData = NNNavMeshGeneratorHelpers::GetAgentNavData(GeneratorData.Value, ProfileIndex))
+		{
+			AgentsNavData.Emplace(GeneratorData.Value, AgentNavData);
+		}
+	}
+
+	float TotalArea = 0.0f;
+	for (const auto& AgentNavData : AgentsNavData)
+	{
+		TotalArea += AgentNavData.Value->PolygonMesh.GetTotalArea();
+	}
+	if (TotalArea <= 0.0f)
+	{
+		return false;
+	}
+
+	// Select the nav bound weighted by its area and then the polygon inside it
+	float RandomArea = FMath::FRand() * TotalArea;
+	const TPair<FNNAreaGeneratorData*, const FNNAgentNavData*>* SelectedData = nullptr;
+	for (const auto& AgentNavData : AgentsNavData)
+	{
+		const float Area = AgentNavData.Value->PolygonMesh.GetTotalArea();
+		if (Area <= 0.0f)
+		{
+			continue;
+		}
+		SelectedData = &AgentNavData;
+		if (RandomArea < Area)
+		{
+			break;
+		}
+		RandomArea -= Area;
+	}
+
+	int32 PolygonIndex = FNNPathfinding::SelectPolygonByArea(SelectedData->Value->PolygonMesh, RandomArea);
+	const FNNQueryFilter& QueryFilter = NavMesh->GetQueryFilterImplementation(Filter);
+	if (!QueryFilter.PassFilter(SelectedData->Value->PolygonMesh.PolygonIndexes[PolygonIndex]))
+	{
+		// Only take into account the polygons that pass the filter
+		SelectedData = nullptr;
+		PolygonIndex = INDEX_NONE;
+		float PassedArea = 0.0f;
+		for (const auto& AgentNavData : AgentsNavData)
+		{
+			const FNNPolygonMesh& PolygonMesh = AgentNavData.Value->PolygonMesh;
+			for (int32 i = 0; i < PolygonMesh.PolygonIndexes.Num(); ++i)
+			{
+				if (!QueryFilter.PassFilter(PolygonMesh.PolygonIndexes[i]))
+				{
+					continue;
+				}
+				const float PolygonArea = PolygonMesh.GetPolygonArea(i);
+				PassedArea += PolygonArea;
+				if (FMath::FRand() * PassedArea <= PolygonArea)
+				{
+					SelectedData = &AgentNavData;
+					PolygonIndex = i;
+				}
+			}
+		}
+		if (!SelectedData)
+		{
+			return false;
+		}
+	}
+
+	const FNNPolygonMesh& PolygonMesh = SelectedData->Value->PolygonMesh;
+	const FNNPathfinding Pathfinding (*SelectedData->Key, SelectedData->Value->OpenHeightField);
+	OutLocation = FNavLocation(Pathfinding.GetRandomPointInPolygon(PolygonMesh, PolygonIndex),
+		PolygonMesh.PolygonIndexes[PolygonIndex].NodeRef);
+	return true;
+}
+
+bool FNNNavMeshGenerator::GetRandomReachablePointInRadius(const FVector& Origin, float Radius,
+	FNavLocation& OutLocation, FSharedConstNavQueryFilter Filter, const UObject* Querier) const
+{
+	FNavLocation OriginLocation;
+	if (!ProjectPoint(Origin, OriginLocation, NavMesh->GetDefaultQueryExtent(), Filter, Querier))
+	{
+		return false;
+	}
+
+	int32 StartPolygonIndex;
+	int32 ProfileIndex;
+	FNNAreaGeneratorData* GeneratorData = GetGeneratorDataFromNodeRef(OriginLocation.NodeRef, StartPolygonIndex, ProfileIndex);
+	if (!GeneratorData)
+	{
+		return false;
+	}
+
+	const FNNAgentNavData& AgentNavData = GeneratorData->AgentsNavData[ProfileIndex];
+	const FNNQueryFilter& QueryFilter = NavMesh->GetQueryFilterImplementation(Filter);
+	const FNNPathfinding Pathfinding (*GeneratorData, AgentNavData.OpenHeightField);
+	const FNNPolygonMesh& PolygonMesh = AgentNavData.PolygonMesh;
+	const int32 PolygonIndex = Pathfinding.GetRandomReachablePolygon(PolygonMesh, StartPolygonIndex, OriginLocation.Location, Radius, QueryFilter);
+	if (PolygonIndex == INDEX_NONE)
+	{
+		return false;
+	}
+
+	OutLocation = FNavLocation(Pathfinding.GetRandomPointInPolygon(PolygonMesh, PolygonIndex), PolygonMesh.PolygonIndexes[PolygonIndex].NodeRef);
+	return true;
+}
+
+uint32 FNNNavMeshGenerator::GetPolygonBuildID(NavNodeRef NodeRef) const
+{
+	int32 PolygonIndex;
+	int32 ProfileIndex;
+	const FNNAreaGeneratorData* GeneratorData = GetGeneratorDataFromNodeRef(NodeRef, PolygonIndex, ProfileIndex);
+	return GeneratorData ? GeneratorData->BuildID : 0;
+}
+
+bool FNNNavMeshGenerator::Raycast(const FVector& RayStart, const FVector& RayEnd, FNNRaycastResult& OutResult,
+	FSharedConstNavQueryFilter Filter, const UObject* Querier) const
+{
+	return Raycast(FNavLocation(RayStart), RayEnd, OutResult, Filter, Querier);
+}
+
+bool FNNNavMeshGenerator::Raycast(const FNavLocation& RayStart, const FVector& RayEnd, FNNRaycastResult& OutResult,
+	FSharedConstNavQueryFilter Filter, const UObject* Querier) const
+{
+	OutResult.CorridorPolygonsNum = 0;
+	OutResult.HitTime = 0.0f;
+	OutResult.HitLocation = RayStart.Location;
+	OutResult.HitNormal = FVector::ZeroVector;
+
+	// The polygon of the start is reused when the caller already has it
+	FNavLocation StartLocation = RayStart;
+	int32 PolygonIndex;
+	int32 ProfileIndex;
+	FNNAreaGeneratorData* GeneratorData = StartLocation.HasNodeRef()
+		? GetGeneratorDataFromNodeRef(StartLocation.NodeRef, PolygonIndex, ProfileIndex)
+		: nullptr;
+	if (!GeneratorData)
+	{
+		if (!ProjectPoint(RayStart.Location, StartLocation, NavMesh->GetDefaultQueryExtent(), Filter, Querier))
+		{
+			// The ray starts outside the navmesh
+			return true;
+		}
+		GeneratorData = GetGeneratorDataFromNodeRef(StartLocation.NodeRef, PolygonIndex, ProfileIndex);
+		if (!GeneratorData)
 		{
-			OutPolygon = GeneratorData->PolygonMesh.PolygonIndexes[PolygonIndex];
 			return true;
 		}
 	}
-	return false;
+
+	const FNNAgentNavData& AgentNavData = GeneratorData->AgentsNavData[ProfileIndex];
+	const FNNQueryFilter& QueryFilter = NavMesh->GetQueryFilterImplementation(Filter);
+	const FNNPathfinding Pathfinding (*GeneratorData, AgentNavData.OpenHeightField);
+	return Pathfinding.Raycast(AgentNavData.PolygonMesh, PolygonIndex, StartLocation.Location, RayEnd, QueryFilter, OutResult);
 }
 
 FBox FNNNavMeshGenerator::GrowBoundingBox(const FBox& BBox, bool bUseAgentHeight) const
@@ -349,23 +875,50 @@ FBox FNNNavMeshGenerator::GrowBoundingBox(const FBox& BBox, bool bUseAgentHeight
 	FVector BBoxGrowOffsetMin = FVector(0.0f);
 	if (bUseAgentHeight && GetOwner().IsValid())
 	{
-		BBoxGrowOffsetMin += FVector(0.0f, 0.0f, GetOwner()->AgentHeight);
+		// Grows by the tallest agent profile
+		float MaxAgentHeight = 0.0f;
+		for (int32 i = 0; i < GetOwner()->GetAgentProfilesNum(); ++i)
+		{
+			MaxAgentHeight = FMath::Max(MaxAgentHeight, GetOwner()->GetAgentProfile(i).AgentHeight);
+		}
+		BBoxGrowOffsetMin += FVector(0.0f, 0.0f, MaxAgentHeight);
 	}
 
 	return FBox(BBox.Min - BBoxGrowth - BBoxGrowOffsetMin, BBox.Max + BBoxGrowth);
 }
 
+TSharedPtr<const FNNVoxelCache, ESPMode::ThreadSafe> FNNNavMeshGenerator::FindVoxelCache(uint32 NavBoundID, const FObjectKey& ElementKey, uint32 GeometryHash) const
+{
+	FScopeLock Lock (&VoxelCacheLock);
+	const TMap<FObjectKey, FNNVoxelCacheEntry>* TileVoxelCache = VoxelCache.Find(NavBoundID);
+	const FNNVoxelCacheEntry* Entry = TileVoxelCache ? TileVoxelCache->Find(ElementKey) : nullptr;
+	if (!Entry || Entry->GeometryHash != GeometryHash)
+	{
+		return nullptr;
+	}
+	return Entry->Voxels;
+}
+
+void FNNNavMeshGenerator::UpdateVoxelCache(uint32 NavBoundID, TMap<FObjectKey, FNNVoxelCacheEntry>&& TileVoxelCache) const
+{
+	FScopeLock Lock (&VoxelCacheLock);
+	VoxelCache.Add(NavBoundID, MoveTemp(TileVoxelCache));
+}
+
 void FNNNavMeshGenerator::GrabDebuggingInfo(FNNNavMeshDebuggingInfo& DebuggingInfo) const
 {
 	for (const auto& Result : GeneratorsData)
 	{
-		DebuggingInfo.RawGeometryToDraw = Result.Value->RawGeometry;
+		DebuggingInfo.RawGeometryToDraw.Add(Result.Value->RawGeometry);
 		DebuggingInfo.TemporaryBoxSpheres.Append(Result.Value->TemporaryBoxSpheres);
 		DebuggingInfo.TemporaryTexts.Append(Result.Value->TemporaryTexts);
 		DebuggingInfo.TemporaryLines.Append(Result.Value->TemporaryLines);
 		DebuggingInfo.TemporaryArrows.Append(Result.Value->TemporaryArrows);
 
-		const TArray<TUniquePtr<Span>>& Spans = Result.Value->HeightField.Spans;
+		// Only the compressed HeightField is kept after the build
+		FNNHeightField HeightField;
+		Result.Value->CompressedHeightField.Decompress(HeightField);
+		const TArray<TUniquePtr<Span>>& Spans = HeightField.Spans;
 
 		// TODO (ignacio) this can be moved to a function
 		FNavigationBounds DataSearch;
@@ -374,9 +927,9 @@ void FNNNavMeshGenerator::GrabDebuggingInfo(FNNNavMeshDebuggingInfo& DebuggingIn
 		const FVector BoundMinPoint = GeneratorArea->AreaBox.Min;
 
 		// Converts the HeightField Spans into FBoxes
-		const float CellSize = Result.Value->HeightField.CellSize;
-		const float CellHeight = Result.Value->HeightField.CellHeight;
-		const int32 UnitsWidth = Result.Value->HeightField.UnitsWidth;
+		const float CellSize = HeightField.CellSize;
+		const float CellHeight = HeightField.CellHeight;
+		const int32 UnitsWidth = HeightField.UnitsWidth;
 		for (int32 i = 0; i < Spans.Num(); ++i)
 		{
 			const float Y = (i / UnitsWidth) * CellSize;
@@ -399,8 +952,15 @@ void FNNNavMeshGenerator::GrabDebuggingInfo(FNNNavMeshDebuggingInfo& DebuggingIn
 			}
 		}
 
+		// The rest of the debug info is drawn for the default agent profile
+		if (Result.Value->AgentsNavData.Num() == 0)
+		{
+			continue;
+		}
+		const FNNAgentNavData& AgentNavData = Result.Value->AgentsNavData[0];
+
 		// Converts the OpenHeightField Spans into FBoxes
-		const FNNOpenHeightField& OpenHeightField = Result.Value->OpenHeightField;
+		const FNNOpenHeightField& OpenHeightField = AgentNavData.OpenHeightField;
 		if (OpenHeightField.Spans.Num() > 0)
 		{
 			const TArray<TUniquePtr<FNNOpenSpan>>& OpenSpans = OpenHeightField.Spans;
@@ -424,7 +984,7 @@ void FNNNavMeshGenerator::GrabDebuggingInfo(FNNNavMeshDebuggingInfo& DebuggingIn
 
 			FLinearColor MaxColor = FLinearColor::Red;
 			FLinearColor MinColor = FLinearColor::Green;
-			float MaxHeight = Result.Value->OpenHeightField.Bounds.Max.Z;
+			float MaxHeight = OpenHeightField.Bounds.Max.Z;
 			for (int32 i = 0; i < OpenSpans.Num(); ++i)
 			{
 				FNNOpenSpan* OpenSpan = OpenSpans[i].Get();
@@ -451,40 +1011,49 @@ void FNNNavMeshGenerator::GrabDebuggingInfo(FNNNavMeshDebuggingInfo& DebuggingIn
 
 		// Grab the Regions debugging info
 		const TArray<FNNRegion>& Regions = OpenHeightField.Regions;
-		DebuggingInfo.Regions.Reserve(Regions.Num());
-		for (const FNNRegion& Region : Regions)
+		TArray<TArray<FBox>> RegionsSpans;
+		RegionsSpans.SetNum(Regions.Num());
+		for (int32 i = 0; i < Regions.Num(); ++i)
+		{
+			RegionsSpans[i].Reserve(Regions[i].SpansCount);
+		}
+		for (FNNOpenHeightFieldIterator It (OpenHeightField); It; ++It)
 		{
-			TArray<FBox> RegionSpans;
-			RegionSpans.Reserve(Region.Spans.Num());
-			for (const FNNOpenSpan* OpenSpan : Region.Spans)
+			const FNNOpenSpan* OpenSpan = It.Get();
+			if (OpenSpan->RegionID == INDEX_NONE)
 			{
-				const float X = OpenSpan->X * OpenHeightField.CellSize;
-				const float Y = OpenSpan->Y * OpenHeightField.CellSize;
-				const float Z = OpenSpan->MinHeight * OpenHeightField.CellHeight;
-				FVector MinPoint = BoundMinPoint + FVector(X, Y, Z);
-				FVector MaxPoint = MinPoint + FVector(OpenHeightField.CellSize, OpenHeightField.CellSize, 0.0f);
-				RegionSpans.Emplace(FBox(MinPoint, MaxPoint));
+				continue;
 			}
+			const float X = OpenSpan->X * OpenHeightField.CellSize;
+			const float Y = OpenSpan->Y * OpenHeightField.CellSize;
+			const float Z = OpenSpan->MinHeight * OpenHeightField.CellHeight;
+			FVector MinPoint = BoundMinPoint + FVector(X, Y, Z);
+			FVector MaxPoint = MinPoint + FVector(OpenHeightField.CellSize, OpenHeightField.CellSize, 0.0f);
+			RegionsSpans[OpenSpan->RegionID].Emplace(FBox(MinPoint, MaxPoint));
+		}
+		DebuggingInfo.Regions.Reserve(Regions.Num());
+		for (TArray<FBox>& RegionSpans : RegionsSpans)
+		{
 			DebuggingInfo.Regions.Emplace(FNNNavMeshDebuggingInfo::RegionDebugInfo(RegionSpans));
 		}
 
 		// Grab the contour debugging info
-		const TArray<FNNContour>& Contours = Result.Value->Contours;
+		const TArray<FNNContour>& Contours = AgentNavData.Contours;
 		DebuggingInfo.Contours.Reserve(Contours.Num());
 		for (const FNNContour& Contour : Contours)
 		{
 			TArray<FVector> DebugSimplifiedVertexes;
 			DebugSimplifiedVertexes.Reserve(Contour.SimplifiedVertexes.Num());
-			for (const FVector& Vertex : Contour.SimplifiedVertexes)
+			for (const FNNContourVertex& Vertex : Contour.SimplifiedVertexes)
 			{
-				FVector WorldVertex = OpenHeightField.TransformVectorToWorldPosition(Vertex);
+				FVector WorldVertex = OpenHeightField.TransformVectorToWorldPosition(Vertex.ToVector());
 				DebugSimplifiedVertexes.Add(MoveTemp(WorldVertex));
 			}
 			TArray<FVector> DebugRawVertexes;
 			DebugRawVertexes.Reserve(Contour.RawVertexes.Num());
-			for (const FVector& RawVertex : Contour.RawVertexes)
+			for (const FNNContourVertex& RawVertex : Contour.RawVertexes)
 			{
-				FVector WorldVertex = OpenHeightField.TransformVectorToWorldPosition(RawVertex);
+				FVector WorldVertex = OpenHeightField.TransformVectorToWorldPosition(RawVertex.ToVector());
 				DebugRawVertexes.Add(MoveTemp(WorldVertex));
 			}
 
@@ -492,7 +1061,7 @@ void FNNNavMeshGenerator::GrabDebuggingInfo(FNNNavMeshDebuggingInfo& DebuggingIn
 			DebuggingInfo.Contours.Add(MoveTemp(DebugInfo));
 		}
 
-		const FNNPolygonMesh& PolygonMesh = Result.Value->PolygonMesh;
+		const FNNPolygonMesh& PolygonMesh = AgentNavData.PolygonMesh;
 		DebuggingInfo.MeshTriangulated.Reserve(PolygonMesh.PolygonIndexes.Num());
 		for (const FNNPolygon& Triangle : PolygonMesh.TriangleIndexes)
 		{
@@ -94,16 +94,15 @@ void FNNNavMeshSceneProxyData::GatherData(const ANNNavMesh* NavMesh)
 
 		if (NavMesh->bDrawPolygons)
 		{
-			for (const FNNRawGeometryElement& GeometryToDraw : DebuggingInfo.RawGeometryToDraw)
+			for (const FNNRawGeometry& GeometryToDraw : DebuggingInfo.RawGeometryToDraw)
 			{
-				const TArray<float>& Coords = GeometryToDraw.GeomCoords;
-				const int32 Geometries = GeometryToDraw.GeomCoords.Num() / 3;
-				const int32 Indices = GeometryToDraw.GeomIndices.Num() / 3;
+				const int32 Geometries = GeometryToDraw.GetVertexesNum();
+				const int32 Indices = GeometryToDraw.GetTrianglesNum();
 
 				// Gather vertices
 				for (int32 i = 0; i < Geometries; ++i)
 				{
-					FVector Position = GeometryToDraw.GetGeometryPosition(i);
+					FVector Position = GeometryToDraw.GetVertex(i);
 					FDebugPoint Point (Position, FColor::Green, 10.0f);
 					AuxPoints.Add(MoveTemp(Point));
 				}
@@ -113,9 +112,9 @@ void FNNNavMeshSceneProxyData::GatherData(const ANNNavMesh* NavMesh)
 				constexpr float PolygonThickness = 2.0f;
 				for (int32 i = 0; i < Indices; ++i)
 				{
-					FVector FirstPoint = GeometryToDraw.GetGeometryPosition(GeometryToDraw.GeomIndices[i * 3]);
-					FVector SecondPoint = GeometryToDraw.GetGeometryPosition(GeometryToDraw.GeomIndices[i * 3 + 1]);
-					FVector ThirdPoint = GeometryToDraw.GetGeometryPosition(GeometryToDraw.GeomIndices[i * 3 + 2]);
+					FVector FirstPoint = GeometryToDraw.GetVertex(GeometryToDraw.Indices[i * 3]);
+					FVector SecondPoint = GeometryToDraw.GetVertex(GeometryToDraw.Indices[i * 3 + 1]);
+					FVector ThirdPoint = GeometryToDraw.GetVertex(GeometryToDraw.Indices[i * 3 + 2]);
 					FDebugRenderSceneProxy::FDebugLine FirstLine (FirstPoint, SecondPoint, PolygonColor, PolygonThickness);
 					FDebugRenderSceneProxy::FDebugLine SecondLine (SecondPoint, ThirdPoint, PolygonColor, PolygonThickness);
 					FDebugRenderSceneProxy::FDebugLine ThirdLine (ThirdPoint, FirstPoint, PolygonColor, PolygonThickness);
@@ -123,6 +122,23 @@ void FNNNavMeshSceneProxyData::GatherData(const ANNNavMesh* NavMesh)
 					AuxLines.Add(MoveTemp(SecondLine));
 					AuxLines.Add(MoveTemp(ThirdLine));
 				}
+
+				// Gather the instanced polygons
+				for (const FNNInstancedGeometry& InstancedGeometry : GeometryToDraw.InstancedGeometry)
+				{
+					for (const FTransform& Transform : InstancedGeometry.Transforms)
+					{
+						for (int32 i = 0; i < InstancedGeometry.GetTrianglesNum(); ++i)
+						{
+							FVector FirstPoint = Transform.TransformPosition(InstancedGeometry.GetLocalVertex(InstancedGeometry.Indices[i * 3]));
+							FVector SecondPoint = Transform.TransformPosition(InstancedGeometry.GetLocalVertex(InstancedGeometry.Indices[i * 3 + 1]));
+							FVector ThirdPoint = Transform.TransformPosition(InstancedGeometry.GetLocalVertex(InstancedGeometry.Indices[i * 3 + 2]));
+							AuxLines.Emplace(FirstPoint, SecondPoint, PolygonColor, PolygonThickness);
+							AuxLines.Emplace(SecondPoint, ThirdPoint, PolygonColor, PolygonThickness);
+							AuxLines.Emplace(ThirdPoint, FirstPoint, PolygonColor, PolygonThickness);
+						}
+					}
+				}
 			}
 		}
 
@@ -0,0 +1,204 @@
+﻿#include "NavData/Pathfinding/NNPathCorridor.h"
+
+// NN Includes
+#include "NavData/NNNavMesh.h"
+
+void FNNPathCorridor::Reset(const ANNNavMesh& NavMesh, const FNavLocation& Location)
+{
+	Position = Location.Location;
+	Target = Location.Location;
+	Path.Reset();
+	Path.Emplace(Location.NodeRef, NavMesh.GetPolygonBuildID(Location.NodeRef));
+}
+
+bool FNNPathCorridor::SetTarget(const ANNNavMesh& NavMesh, const FVector& InTarget, FSharedConstNavQueryFilter Filter)
+{
+	Target = InTarget;
+	if (Path.Num() == 0)
+	{
+		return false;
+	}
+
+	FNavLocation TargetLocation;
+	if (!NavMesh.ProjectPoint(InTarget, TargetLocation, NavMesh.GetDefaultQueryExtent(), Filter, nullptr))
+	{
+		return false;
+	}
+
+	TArray<NavNodeRef> Polygons;
+	const bool bReached = NavMesh.FindPolygonPath(FNavLocation(Position, Path[0].NodeRef), TargetLocation, Polygons, Filter);
+	if (Polygons.Num() == 0)
+	{
+		return false;
+	}
+	Path.Reset();
+	AppendPolygons(NavMesh, Polygons);
+	return bReached;
+}
+
+bool FNNPathCorridor::MovePosition(const ANNNavMesh& NavMesh, const FVector& NewPosition, FSharedConstNavQueryFilter Filter)
+{
+	if (Path.Num() == 0)
+	{
+		return false;
+	}
+
+	FNavLocation Result;
+	TArray<NavNodeRef> Visited;
+	if (!NavMesh.MoveAlongSurface(FNavLocation(Position, Path[0].NodeRef), NewPosition, Result, Visited, Filter))
+	{
+		return false;
+	}
+
+	MergeCorridorStartMoved(NavMesh, Visited);
+	Position = Result.Location;
+	return true;
+}
+
+bool FNNPathCorridor::OptimizePathTopology(const ANNNavMesh& NavMesh, FSharedConstNavQueryFilter Filter, int32 MaxIterations)
+{
+	if (Path.Num() < 3)
+	{
+		return false;
+	}
+
+	TArray<NavNodeRef> Shortcut;
+	NavMesh.FindPolygonPath(FNavLocation(Position, Path[0].NodeRef), FNavLocation(Target, Path.Last().NodeRef), Shortcut, Filter, MaxIterations);
+	return MergeCorridorStartShortcut(NavMesh, Shortcut);
+}
+
+bool FNNPathCorridor::IsValid(const ANNNavMesh& NavMesh, int32 MaxLookAhead) const
+{
+	const int32 PolygonsToCheck = FMath::Min(MaxLookAhead, Path.Num());
+	for (int32 i = 0; i < PolygonsToCheck; ++i)
+	{
+		if (NavMesh.GetPolygonBuildID(Path[i].NodeRef) != Path[i].BuildID)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+bool FNNPathCorridor::Replan(const ANNNavMesh& NavMesh, FSharedConstNavQueryFilter Filter, int32 MaxIterations)
+{
+	int32 ValidPolygons = 0;
+	while (ValidPolygons < Path.Num() && NavMesh.GetPolygonBuildID(Path[ValidPolygons].NodeRef) == Path[ValidPolygons].BuildID)
+	{
+		++ValidPolygons;
+	}
+	if (ValidPolygons == Path.Num() && Path.Num() > 0)
+	{
+		// Nothing was invalidated
+		return true;
+	}
+
+	const FVector Extent = NavMesh.GetDefaultQueryExtent();
+	FNavLocation StartLocation;
+	if (ValidPolygons > 0)
+	{
+		// Search again from the last polygon that is still valid
+		StartLocation = FNavLocation(Position, Path[ValidPolygons - 1].NodeRef);
+	}
+	else if (!NavMesh.ProjectPoint(Position, StartLocation, Extent, Filter, nullptr))
+	{
+		return false;
+	}
+
+	FNavLocation TargetLocation;
+	if (!NavMesh.ProjectPoint(Target, TargetLocation, Extent, Filter, nullptr))
+	{
+		return false;
+	}
+
+	TArray<NavNodeRef> Polygons;
+	const bool bReached = NavMesh.FindPolygonPath(StartLocation, TargetLocation, Polygons, Filter, MaxIterations);
+	if (Polygons.Num() == 0)
+	{
+		return false;
+	}
+
+	// The new polygons start with the last valid one
+	Path.SetNum(FMath::Max(ValidPolygons - 1, 0));
+	AppendPolygons(NavMesh, Polygons);
+	return bReached;
+}
+
+void FNNPathCorridor::MergeCorridorStartMoved(const ANNNavMesh& NavMesh, const TArray<NavNodeRef>& Visited)
+{
+	// Find the furthest polygon shared by the corridor and the visited polygons
+	int32 FurthestPath = INDEX_NONE;
+	int32 FurthestVisited = INDEX_NONE;
+	for (int32 i = Path.Num() - 1; i >= 0 && FurthestPath == INDEX_NONE; --i)
+	{
+		for (int32 j = Visited.Num() - 1; j >= 0; --j)
+		{
+			if (Path[i].NodeRef == Visited[j])
+			{
+				FurthestPath = i;
+				FurthestVisited = j;
+				break;
+			}
+		}
+	}
+
+	if (FurthestPath == INDEX_NONE)
+	{
+		// The agent left the corridor
+		return;
+	}
+
+	// The corridor starts at the new polygon of the agent and goes back through the visited polygons until it
+	// rejoins the old corridor
+	TArray<FNNCorridorPolygon> NewPath;
+	NewPath.Reserve(Visited.Num() - FurthestVisited + Path.Num() - FurthestPath - 1);
+	for (int32 j = Visited.Num() - 1; j > FurthestVisited; --j)
+	{
+		NewPath.Emplace(Visited[j], NavMesh.GetPolygonBuildID(Visited[j]));
+	}
+	NewPath.Append(Path.GetData() + FurthestPath, Path.Num() - FurthestPath);
+	Path = MoveTemp(NewPath);
+}
+
+bool FNNPathCorridor::MergeCorridorStartShortcut(const ANNNavMesh& NavMesh, const TArray<NavNodeRef>& Shortcut)
+{
+	int32 FurthestPath = INDEX_NONE;
+	int32 FurthestShortcut = INDEX_NONE;
+	for (int32 i = Path.Num() - 1; i >= 0 && FurthestPath == INDEX_NONE; --i)
+	{
+		for (int32 j = Shortcut.Num() - 1; j >= 0; --j)
+		{
+			if (Path[i].NodeRef == Shortcut[j])
+			{
+				FurthestPath = i;
+				FurthestShortcut = j;
+				break;
+			}
+		}
+	}
+
+	// The shortcut is only useful if it skips polygons of the corridor
+	if (FurthestPath == INDEX_NONE || FurthestShortcut >= FurthestPath)
+	{
+		return false;
+	}
+
+	TArray<FNNCorridorPolygon> NewPath;
+	NewPath.Reserve(FurthestShortcut + Path.Num() - FurthestPath);
+	for (int32 j = 0; j < FurthestShortcut; ++j)
+	{
+		NewPath.Emplace(Shortcut[j], NavMesh.GetPolygonBuildID(Shortcut[j]));
+	}
+	NewPath.Append(Path.GetData() + FurthestPath, Path.Num() - FurthestPath);
+	Path = MoveTemp(NewPath);
+	return true;
+}
+
+void FNNPathCorridor::AppendPolygons(const ANNNavMesh& NavMesh, const TArray<NavNodeRef>& Polygons)
+{
+	Path.Reserve(Path.Num() + Polygons.Num());
+	for (const NavNodeRef Polygon : Polygons)
+	{
+		Path.Emplace(Polygon, NavMesh.GetPolygonBuildID(Polygon));
+	}
+}
@@ -1,6 +1,7 @@
 ﻿#include "NavData/Pathfinding/NNPathfinding.h"
 
 // UE Includes
+#include "Algo/BinarySearch.h"
 #include "Algo/ForEach.h"
 #include "NavigationPath.h"
 #include "NavigationSystem.h"
@@ -8,14 +9,104 @@
 // NN Includes
 #include "NavData/ConvexPolygon/NNPolyMeshBuilder.h"
 #include "NavData/NNAreaGenerator.h"
-#include "NavData/NNNavMesh.h"
 #include "NavData/Pathfinding/NNPriorityQueue.h"
+#include "NavData/Pathfinding/NNQueryFilter.h"
 
 #define NN_DEBUG_PATHFINDING_GRAPH 0
 
 #define PATH_START_INDEX -1
 #define PATH_GOAL_INDEX - 2
 
+namespace NNPathfindingHelpers
+{
+	/** Maximum quantity of polygons visited when moving along the surface */
+	constexpr int32 MaxMoveAlongSurfaceNodes = 48;
+
+	/** Returns the average of the polygon vertexes */
+	FVector GetPolygonCenter(const FNNPolygonMesh& PolygonMesh, const FNNPolygon& Polygon)
+	{
+		FVector Center = FVector::ZeroVector;
+		for (const int32 Index : Polygon.Indexes)
+		{
+			Center += PolygonMesh.Vertexes[Index];
+		}
+		return Center / FMath::Max(Polygon.Indexes.Num(), 1);
+	}
+
+	/** Returns whether the Point is inside the polygon in the X and Y axis. Works with both windings */
+	bool IsPointInPolygon2D(const FVector& Point, const FNNPolygonMesh& PolygonMesh, const FNNPolygon& Polygon)
+	{
+		const int32 VertCount = Polygon.Indexes.Num();
+		float Sign = 0.0f;
+		for (int32 i = 0; i < VertCount; ++i)
+		{
+			const FVector& A = PolygonMesh.Vertexes[Polygon.Indexes[i]];
+			const FVector& B = PolygonMesh.Vertexes[Polygon.Indexes[(i + 1) % VertCount]];
+			const float Cross = (B.X - A.X) * (Point.Y - A.Y) - (B.Y - A.Y) * (Point.X - A.X);
+			if (Cross * Sign < 0.0f)
+			{
+				return false;
+			}
+			if (Cross != 0.0f)
+			{
+				Sign = Cross;
+			}
+		}
+		return true;
+	}
+
+	/** Finds the point of the polygon nearest to the Point. The Point is projected vertically when it is above the
+	 * polygon. Everything is in world space. Returns false if the point is outside the QueryBox */
+	bool GetClosestPointInPolygon(const FNNPolygonMesh& PolygonMesh, const FNNPolygon& Polygon,
+		const FNNOpenHeightField& OpenHeightField, const FVector& Point, const FBox& QueryBox, FVector& OutPoint)
+	{
+		TArray<FVector, TInlineAllocator<NNNavAreas::MaxPolygonVertexes>> Vertexes;
+		FBox PolygonBox (ForceInit);
+		for (const int32 Index : Polygon.Indexes)
+		{
+			const FVector& Vertex = Vertexes.Add_GetRef(OpenHeightField.TransformVectorToWorldPosition(PolygonMesh.Vertexes[Index]));
+			PolygonBox += Vertex;
+		}
+		if (Vertexes.Num() < 3 || !PolygonBox.Intersect(QueryBox))
+		{
+			return false;
+		}
+
+		if (IsPointInPolygon2D(OpenHeightField.TransformToHeightFieldPosition(Point), PolygonMesh, Polygon))
+		{
+			// Newell's method gives the normal of the polygon plane with any winding
+			FVector Normal = FVector::ZeroVector;
+			for (int32 i = 0; i < Vertexes.Num(); ++i)
+			{
+				const FVector& A = Vertexes[i];
+				const FVector& B = Vertexes[(i + 1) % Vertexes.Num()];
+				Normal.X += (A.Y - B.Y) * (A.Z + B.Z);
+				Normal.Y += (A.Z - B.Z) * (A.X + B.X);
+				Normal.Z += (A.X - B.X) * (A.Y + B.Y);
+			}
+			OutPoint = Point;
+			OutPoint.Z = FMath::IsNearlyZero(Normal.Z)
+				? Vertexes[0].Z
+				: Vertexes[0].Z - (Normal.X * (Point.X - Vertexes[0].X) + Normal.Y * (Point.Y - Vertexes[0].Y)) / Normal.Z;
+		}
+		else
+		{
+			float BestDistanceSqr = TNumericLimits<float>::Max();
+			for (int32 i = 0; i < Vertexes.Num(); ++i)
+			{
+				const FVector EdgePoint = FMath::ClosestPointOnSegment(Point, Vertexes[i], Vertexes[(i + 1) % Vertexes.Num()]);
+				const float DistanceSqr = FVector::DistSquared(EdgePoint, Point);
+				if (DistanceSqr < BestDistanceSqr)
+				{
+					BestDistanceSqr = DistanceSqr;
+					OutPoint = EdgePoint;
+				}
+			}
+		}
+		return QueryBox.IsInsideOrOn(OutPoint);
+	}
+}
+
 void FNNPathfinding::CreateGraph(const FNNPolygonMesh& PolygonMesh, FNNGraph& OutGraph) const
 {
 	OutGraph.Nodes.Reserve(PolygonMesh.Vertexes.Num());
@@ -36,9 +127,9 @@ void FNNPathfinding::CreateGraph(const FNNPolygonMesh& PolygonMesh, FNNGraph& Ou
 			const int32 PolygonIndexNum = Polygon.Indexes.Num();
 			// Add the neighbours to the Node with the minimum cost
 			int32 PolygonIndexNeighbour = Polygon.Indexes[(PolygonIndex + 1) % PolygonIndexNum];
-			AddNodeNeighbour(Node, PolygonMesh.Vertexes[PolygonIndexNeighbour], PolygonIndexNeighbour);
+			AddNodeNeighbour(Node, PolygonMesh.Vertexes[PolygonIndexNeighbour], PolygonIndexNeighbour, i);
 			PolygonIndexNeighbour = Polygon.Indexes[(PolygonIndex + PolygonIndexNum - 1) % PolygonIndexNum];
-			AddNodeNeighbour(Node, PolygonMesh.Vertexes[PolygonIndexNeighbour], PolygonIndexNeighbour);
+			AddNodeNeighbour(Node, PolygonMesh.Vertexes[PolygonIndexNeighbour], PolygonIndexNeighbour, i);
 		}
 		OutGraph.Nodes.Add(MoveTemp(Node));
 	}
@@ -49,7 +140,7 @@ void FNNPathfinding::CreateGraph(const FNNPolygonMesh& PolygonMesh, FNNGraph& Ou
 		const FNNNode& Node = OutGraph.Nodes[i];
 		const FVector& Start = OpenHeightField.TransformVectorToWorldPosition(Node.Position);
 		AreaGeneratorData->AddDebugPoint(Start);
-		for (const TTuple<int, float>& Neighbour : Node.Neighbours)
+		for (const TTuple<int32, FNNNodeEdge>& Neighbour : Node.Neighbours)
 		{
 			const FVector& End = OpenHeightField.TransformVectorToWorldPosition(OutGraph.Nodes[Neighbour.Key].Position);
 			AreaGeneratorData->AddDebugArrow(Start, End, FColor::Red);
@@ -72,42 +163,130 @@ void FNNPathfinding::CreateGraph(const FNNPolygonMesh& PolygonMesh, FNNGraph& Ou
 
 }
 
+int32 FNNPathfinding::FindNearestPolygon(const FNNPolygonMesh& PolygonMesh, const FVector& Point, const FVector& Extent,
+	const FNNQueryFilter& Filter, FVector& OutLocation, float& OutDistanceSqr) const
+{
+	const FBox QueryBox (Point - Extent, Point + Extent);
+	int32 BestPolygonIndex = INDEX_NONE;
+	OutDistanceSqr = TNumericLimits<float>::Max();
+	const auto VisitPolygon = [&](int32 PolygonIndex)
+	{
+		const FNNPolygon& Polygon = PolygonMesh.PolygonIndexes[PolygonIndex];
+		FVector ClosestPoint;
+		if (!Filter.PassFilter(Polygon)
+			|| !NNPathfindingHelpers::GetClosestPointInPolygon(PolygonMesh, Polygon, OpenHeightField, Point, QueryBox, ClosestPoint))
+		{
+			return;
+		}
+		const float DistanceSqr = FVector::DistSquared(ClosestPoint, Point);
+		if (DistanceSqr < OutDistanceSqr)
+		{
+			OutDistanceSqr = DistanceSqr;
+			OutLocation = ClosestPoint;
+			BestPolygonIndex = PolygonIndex;
+		}
+	};
+
+	if (!PolygonMesh.HasGrid())
+	{
+		for (int32 PolygonIndex = 0; PolygonIndex < PolygonMesh.PolygonIndexes.Num(); ++PolygonIndex)
+		{
+			VisitPolygon(PolygonIndex);
+		}
+		return BestPolygonIndex;
+	}
+
+	// Only the polygons of the grid squares overlapped by the Extent are visited
+	const FVector LocalMin = OpenHeightField.TransformToHeightFieldPosition(QueryBox.Min);
+	const FVector LocalMax = OpenHeightField.TransformToHeightFieldPosition(QueryBox.Max);
+	const FIntPoint& GridSize = PolygonMesh.GridSize;
+	if (LocalMax.X < 0.0f || LocalMax.Y < 0.0f
+		|| LocalMin.X >= GridSize.X * FNNPolygonMesh::GridCellSize || LocalMin.Y >= GridSize.Y * FNNPolygonMesh::GridCellSize)
+	{
+		return INDEX_NONE;
+	}
+	const int32 MinX = FMath::Clamp(FMath::FloorToInt(LocalMin.X / FNNPolygonMesh::GridCellSize), 0, GridSize.X - 1);
+	const int32 MinY = FMath::Clamp(FMath::FloorToInt(LocalMin.Y / FNNPolygonMesh::GridCellSize), 0, GridSize.Y - 1);
+	const int32 MaxX = FMath::Clamp(FMath::FloorToInt(LocalMax.X / FNNPolygonMesh::GridCellSize), 0, GridSize.X - 1);
+	const int32 MaxY = FMath::Clamp(FMath::FloorToInt(LocalMax.Y / FNNPolygonMesh::GridCellSize), 0, GridSize.Y - 1);
+	for (int32 Y = MinY; Y <= MaxY; ++Y)
+	{
+		for (int32 X = MinX; X <= MaxX; ++X)
+		{
+			const int32 Cell = X + Y * GridSize.X;
+			for (int32 i = PolygonMesh.GridCellStarts[Cell]; i < PolygonMesh.GridCellStarts[Cell + 1]; ++i)
+			{
+				VisitPolygon(PolygonMesh.GridPolygons[i]);
+			}
+		}
+	}
+	return BestPolygonIndex;
+}
+
 FNavPathSharedPtr FNNPathfinding::FindPath(const FNNGraph& Graph, const FNNPolygonMesh& PolygonMesh,
-	const FNavAgentProperties& AgentProperties, const FPathFindingQuery& Query) const
+	const FVector& StartLocation, const FVector& EndLocation, const FVector& Extent, const FNNQueryFilter& Filter) const
 {
-	TMap<int32, int32> CameFrom;
-	TMap<int32, float> CostSoFar;
+	FNNPathSearch Search;
+	if (!SearchPath(Graph, PolygonMesh, StartLocation, EndLocation, Extent, Filter, Search))
+	{
+		return nullptr;
+	}
+
+	TArray<FVector> Path = {Search.Goal};
+	int32 Current = Search.CameFrom[PATH_GOAL_INDEX];
+	while (Current != PATH_START_INDEX)
+	{
+		Path.Add(TransformToWorldSpace(Graph.Nodes[Current].Position));
+		Current = Search.CameFrom[Current];
+	}
+	Path.Add(Search.Start);
+	Algo::Reverse(Path);
+	FNavPathSharedPtr NavigationPath = MakeShared<FNavigationPath, ESPMode::ThreadSafe>(MoveTemp(Path));
+	return NavigationPath;
+}
+
+bool FNNPathfinding::SearchPath(const FNNGraph& Graph, const FNNPolygonMesh& PolygonMesh, const FVector& StartLocation,
+	const FVector& EndLocation, const FVector& Extent, const FNNQueryFilter& Filter, FNNPathSearch& OutSearch) const
+{
+	TMap<int32, int32>& CameFrom = OutSearch.CameFrom;
+	TMap<int32, float>& CostSoFar = OutSearch.CostSoFar;
 	FNNPriorityQueue<int32> Frontier;
 
-	UNavigationSystemV1* NavSys = UNavigationSystemV1::GetCurrent(Query.Owner->GetWorld());
-	FNavLocation NavGoal;
-	FNavLocation NavStart;
-	bool bProjected = NavSys->ProjectPointToNavigation(Query.EndLocation, NavGoal);
-	bProjected &= NavSys->ProjectPointToNavigation(Query.StartLocation, NavStart);
-	if (!bProjected)
+	// The projection only takes into account the polygons that pass the filter
+	FNavLocation& NavGoal = OutSearch.Goal;
+	FNavLocation& NavStart = OutSearch.Start;
+	float DistanceSqr;
+	const int32 GoalPolygonIndex = FindNearestPolygon(PolygonMesh, EndLocation, Extent, Filter, NavGoal.Location, DistanceSqr);
+	const int32 StartPolygonIndex = FindNearestPolygon(PolygonMesh, StartLocation, Extent, Filter, NavStart.Location, DistanceSqr);
+	if (GoalPolygonIndex == INDEX_NONE || StartPolygonIndex == INDEX_NONE)
 	{
-		return nullptr;
+		return false;
 	}
-	
-	ANNNavMesh* NavMesh = Cast<ANNNavMesh>(NavSys->GetMainNavData());
-	FNNPolygon PolyGoal;
-	FNNPolygon PolyStart;
-	bool bRetrieved = NavMesh->GetPolygonFromNavLocation(NavGoal, PolyGoal);
-	bRetrieved &= NavMesh->GetPolygonFromNavLocation(NavStart, PolyStart);
-	if (!bRetrieved)
+
+	const FNNPolygon& PolyGoal = PolygonMesh.PolygonIndexes[GoalPolygonIndex];
+	const FNNPolygon& PolyStart = PolygonMesh.PolygonIndexes[StartPolygonIndex];
+	NavGoal.NodeRef = PolyGoal.NodeRef;
+	NavStart.NodeRef = PolyStart.NodeRef;
+	if (PolyGoal.ComponentID != PolyStart.ComponentID)
 	{
-		return nullptr;
+		return false;
 	}
 
 	FVector Goal = OpenHeightField.TransformToHeightFieldPosition(NavGoal.Location);
 	FVector Start = OpenHeightField.TransformToHeightFieldPosition(NavStart.Location);
 
-	if (PolyGoal == PolyStart)
+	const float HeuristicScale = Filter.GetHeuristicScale();
+	const float GoalAreaCost = Filter.GetAreaCost(PolyGoal.AreaID);
+	const float StartAreaCost = Filter.GetAreaCost(PolyStart.AreaID);
+	OutSearch.GoalAreaCost = GoalAreaCost;
+	OutSearch.StartAreaCost = StartAreaCost;
+
+	if (GoalPolygonIndex == StartPolygonIndex)
 	{
 		// On the same polygon we can move directly to our goal
-		TArray<FVector> Path = {NavStart, NavGoal};
-		FNavPathSharedPtr NavigationPath = MakeShared<FNavigationPath, ESPMode::ThreadSafe>(MoveTemp(Path));
-		return NavigationPath;
+		CameFrom.Add(PATH_GOAL_INDEX, PATH_START_INDEX);
+		CostSoFar.Add(PATH_GOAL_INDEX, CalculateDistanceCost(Start, Goal) * StartAreaCost);
+		return true;
 	}
 
 	TMap<int32, float> GoalNeighbours;
@@ -119,16 +298,13 @@ FNavPathSharedPtr FNNPathfinding::FindPath(const FNNGraph& Graph, const FNNPolyg
 		const FNNNode& Node = Graph.Nodes[i];
 		for (int32 PolygonIndex : Node.PolygonIndexes)
 		{
-			const FNNPolygon& Polygon = PolygonMesh.PolygonIndexes[PolygonIndex];
-			if (Polygon == PolyGoal)
+			if (PolygonIndex == GoalPolygonIndex)
 			{
-				GoalNeighbours.Add(i, CalculateHeuristic(Node.Position, Goal));
-				break;
+				GoalNeighbours.Add(i, CalculateDistanceCost(Node.Position, Goal) * GoalAreaCost);
 			}
-			if (Polygon == PolyStart)
+			if (PolygonIndex == StartPolygonIndex)
 			{
-				StartNeighbours.Add(i, CalculateHeuristic(Node.Position, Start));
-				break;
+				StartNeighbours.Add(i, CalculateDistanceCost(Node.Position, Start) * StartAreaCost);
 			}
 		}
 	}
@@ -137,83 +313,526 @@ FNavPathSharedPtr FNNPathfinding::FindPath(const FNNGraph& Graph, const FNNPolyg
 	CameFrom.Add(PATH_START_INDEX, PATH_START_INDEX);
 	CostSoFar.Add(PATH_START_INDEX, 0.0f);
 
-	TMap<int32, float> WorkingNeighbours;
-	
+	const auto VisitNeighbour = [&](int32 CurrentIndex, int32 NeighbourIndex, float EdgeCost)
+	{
+		const float NewCost = CostSoFar[CurrentIndex] + EdgeCost;
+		const float* NeighbourCost = CostSoFar.Find(NeighbourIndex);
+		if (!NeighbourCost || NewCost < *NeighbourCost)
+		{
+			CostSoFar.Add(NeighbourIndex, NewCost);
+			float Priority = NewCost;
+			Priority += NeighbourIndex != PATH_GOAL_INDEX
+				? CalculateHeuristic(Graph.Nodes[NeighbourIndex].Position, Goal) * HeuristicScale
+				:  0.0f;
+			Frontier.Push(NeighbourIndex, Priority);
+			CameFrom.Add(NeighbourIndex, CurrentIndex);
+		}
+	};
+
 	while (!Frontier.IsEmpty())
 	{
-		int32 CurrentIndex = Frontier.Pop();
+		const int32 CurrentIndex = Frontier.Pop();
+		++OutSearch.VisitedNodes;
 
 		if (CurrentIndex == PATH_GOAL_INDEX)
 		{
-			break;
+			return true;
 		}
 		if (CurrentIndex == PATH_START_INDEX)
 		{
-			WorkingNeighbours = MoveTemp(StartNeighbours);
+			for (const TTuple<int32, float>& Neighbour : StartNeighbours)
+			{
+				VisitNeighbour(CurrentIndex, Neighbour.Key, Neighbour.Value);
+			}
+			continue;
+		}
+
+		const FNNNode& Current = Graph.Nodes[CurrentIndex];
+		for (const TTuple<int32, FNNNodeEdge>& Neighbour : Current.Neighbours)
+		{
+			const float EdgeCost = GetEdgeCost(Neighbour.Value, PolygonMesh, Filter);
+			if (EdgeCost >= 0.0f)
+			{
+				VisitNeighbour(CurrentIndex, Neighbour.Key, EdgeCost);
+			}
+		}
+		if (const float* Cost = GoalNeighbours.Find(CurrentIndex))
+		{
+			VisitNeighbour(CurrentIndex, PATH_GOAL_INDEX, *Cost);
+		}
+	}
+	return false;
+}
+
+float FNNPathfinding::GetPathCost(const FNNGraph& Graph, const FNNPolygonMesh& PolygonMesh, const FNNQueryFilter& Filter,
+	const FNNPathSearch& Search) const
+{
+	// Walks the search backwards. The last segment crosses the goal polygon
+	float Cost = 0.0f;
+	float SegmentAreaCost = Search.GoalAreaCost;
+	FVector Previous = Search.Goal.Location;
+	int32 Current = Search.CameFrom.FindRef(PATH_GOAL_INDEX);
+	while (Current != PATH_START_INDEX)
+	{
+		const FVector Position = TransformToWorldSpace(Graph.Nodes[Current].Position);
+		Cost += FVector::Dist(Previous, Position) * SegmentAreaCost;
+		Previous = Position;
+
+		const int32 Next = Search.CameFrom[Current];
+		if (Next != PATH_START_INDEX)
+		{
+			const FNNNodeEdge* Edge = Graph.Nodes[Next].Neighbours.Find(Current);
+			SegmentAreaCost = Edge ? FMath::Max(GetEdgeAreaCost(*Edge, PolygonMesh, Filter), 0.0f) : 1.0f;
 		}
 		else
 		{
-			const FNNNode& Current = Graph.Nodes[CurrentIndex];
-			WorkingNeighbours = Current.Neighbours;
-			if (float* Cost = GoalNeighbours.Find(CurrentIndex))
+			// The first segment crosses the start polygon
+			SegmentAreaCost = Search.StartAreaCost;
+		}
+		Current = Next;
+	}
+	return Cost + FVector::Dist(Previous, Search.Start.Location) * SegmentAreaCost;
+}
+
+float FNNPathfinding::GetPathLength(const FNNGraph& Graph, const FNNPathSearch& Search) const
+{
+	// Walks the search backwards without storing the path points
+	float Length = 0.0f;
+	FVector Previous = Search.Goal.Location;
+	int32 Current = Search.CameFrom.FindRef(PATH_GOAL_INDEX);
+	while (Current != PATH_START_INDEX)
+	{
+		const FVector Position = TransformToWorldSpace(Graph.Nodes[Current].Position);
+		Length += FVector::Dist(Previous, Position);
+		Previous = Position;
+		Current = Search.CameFrom[Current];
+	}
+	return Length + FVector::Dist(Previous, Search.Start.Location);
+}
+
+bool FNNPathfinding::Raycast(const FNNPolygonMesh& PolygonMesh, int32 StartPolygonIndex, const FVector& Start,
+	const FVector& End, const FNNQueryFilter& Filter, FNNRaycastResult& OutResult) const
+{
+	OutResult.CorridorPolygonsNum = 0;
+	OutResult.HitTime = TNumericLimits<float>::Max();
+	OutResult.HitLocation = End;
+	OutResult.HitNormal = FVector::ZeroVector;
+
+	// X and Y share the same scale so the ray can be clipped in the OpenHeightField space
+	const FVector LocalStart = OpenHeightField.TransformToHeightFieldPosition(Start);
+	const FVector LocalEnd = OpenHeightField.TransformToHeightFieldPosition(End);
+	const FVector2D RayOrigin (LocalStart);
+	const FVector2D RayDirection = FVector2D(LocalEnd) - RayOrigin;
+
+	int32 CurrentPolygonIndex = StartPolygonIndex;
+	// Every polygon can only be visited once because the ray moves forward through convex polygons
+	for (int32 Iteration = 0; Iteration < PolygonMesh.PolygonIndexes.Num(); ++Iteration)
+	{
+		const FNNPolygon& Polygon = PolygonMesh.PolygonIndexes[CurrentPolygonIndex];
+		const int32 VertCount = Polygon.Indexes.Num();
+
+		// The sign of the area makes the clipping independent of the polygon winding
+		float DoubleArea = 0.0f;
+		for (int32 i = 0; i < VertCount; ++i)
+		{
+			const FVector& A = PolygonMesh.Vertexes[Polygon.Indexes[i]];
+			const FVector& B = PolygonMesh.Vertexes[Polygon.Indexes[(i + 1) % VertCount]];
+			DoubleArea += A.X * B.Y - B.X * A.Y;
+		}
+		const float Winding = DoubleArea >= 0.0f ? 1.0f : -1.0f;
+
+		// Clip the ray against the half planes of the polygon edges
+		float MinTime = 0.0f;
+		float MaxTime = TNumericLimits<float>::Max();
+		int32 ExitEdge = INDEX_NONE;
+		bool bInside = true;
+		for (int32 Edge = 0; Edge < VertCount && bInside; ++Edge)
+		{
+			const FVector2D EdgeStart (PolygonMesh.Vertexes[Polygon.Indexes[Edge]]);
+			const FVector2D EdgeEnd (PolygonMesh.Vertexes[Polygon.Indexes[(Edge + 1) % VertCount]]);
+			const FVector2D EdgeDirection = EdgeEnd - EdgeStart;
+			const float Distance = FVector2D::CrossProduct(EdgeDirection, RayOrigin - EdgeStart) * Winding;
+			const float Speed = FVector2D::CrossProduct(EdgeDirection, RayDirection) * Winding;
+			if (FMath::IsNearlyZero(Speed))
 			{
-				WorkingNeighbours.Add(PATH_GOAL_INDEX, *Cost);
+				// Parallel to the edge
+				bInside = Distance >= 0.0f;
+				continue;
 			}
+			const float Time = -Distance / Speed;
+			if (Speed > 0.0f)
+			{
+				MinTime = FMath::Max(MinTime, Time);
+			}
+			else if (Time < MaxTime)
+			{
+				MaxTime = Time;
+				ExitEdge = Edge;
+			}
+			bInside = MinTime <= MaxTime;
+		}
+
+		if (!bInside || ExitEdge == INDEX_NONE)
+		{
+			// The ray starts outside the polygon
+			OutResult.HitTime = 0.0f;
+			OutResult.HitLocation = Start;
+			return true;
+		}
+
+		if (OutResult.CorridorPolygonsNum < FNNRaycastResult::MaxCorridorPolygons)
+		{
+			OutResult.CorridorPolygons[OutResult.CorridorPolygonsNum++] = Polygon.NodeRef;
+		}
+
+		if (MaxTime > 1.0f)
+		{
+			// The end is inside this polygon
+			return false;
+		}
+
+		const int32 NextPolygonIndex = Polygon.Neighbours.IsValidIndex(ExitEdge) ? Polygon.Neighbours[ExitEdge] : INDEX_NONE;
+		if (NextPolygonIndex == INDEX_NONE || !Filter.PassFilter(PolygonMesh.PolygonIndexes[NextPolygonIndex]))
+		{
+			// Hit a wall
+			const FVector& EdgeStart = PolygonMesh.Vertexes[Polygon.Indexes[ExitEdge]];
+			const FVector& EdgeEnd = PolygonMesh.Vertexes[Polygon.Indexes[(ExitEdge + 1) % VertCount]];
+			const FVector EdgeDirection = EdgeEnd - EdgeStart;
+			OutResult.HitTime = MaxTime;
+			OutResult.HitLocation = FMath::Lerp(Start, End, MaxTime);
+			OutResult.HitNormal = FVector(-EdgeDirection.Y, EdgeDirection.X, 0.0f).GetSafeNormal() * Winding;
+			return true;
 		}
-		
-		for (const auto& Neighbour : WorkingNeighbours)
+		CurrentPolygonIndex = NextPolygonIndex;
+	}
+
+	return false;
+}
+
+bool FNNPathfinding::FindPolygonPath(const FNNPolygonMesh& PolygonMesh, int32 StartPolygonIndex,
+	int32 EndPolygonIndex, const FNNQueryFilter& Filter, int32 MaxIterations, TArray<int32>& OutPath) const
+{
+	OutPath.Reset();
+
+	TMap<int32, int32> CameFrom;
+	TMap<int32, float> CostSoFar;
+	FNNPriorityQueue<int32> Frontier;
+
+	const float HeuristicScale = Filter.GetHeuristicScale();
+	const FVector EndCenter = TransformToWorldSpace(NNPathfindingHelpers::GetPolygonCenter(PolygonMesh, PolygonMesh.PolygonIndexes[EndPolygonIndex]));
+
+	Frontier.Push(StartPolygonIndex, 0.0f);
+	CameFrom.Add(StartPolygonIndex, INDEX_NONE);
+	CostSoFar.Add(StartPolygonIndex, 0.0f);
+
+	// The polygon nearest to the end. Used when the search is stopped before reaching it
+	int32 BestPolygonIndex = StartPolygonIndex;
+	float BestDistance = TNumericLimits<float>::Max();
+	bool bReached = false;
+	int32 Iterations = 0;
+	while (!Frontier.IsEmpty())
+	{
+		const int32 CurrentIndex = Frontier.Pop();
+		if (CurrentIndex == EndPolygonIndex)
+		{
+			BestPolygonIndex = CurrentIndex;
+			bReached = true;
+			break;
+		}
+		if (MaxIterations > 0 && Iterations >= MaxIterations)
 		{
-			const float NewCost = CostSoFar[CurrentIndex] + Neighbour.Value;
-			const float* NeighbourCost = CostSoFar.Find(Neighbour.Key);
+			break;
+		}
+		++Iterations;
+
+		const FNNPolygon& Current = PolygonMesh.PolygonIndexes[CurrentIndex];
+		const FVector CurrentCenter = TransformToWorldSpace(NNPathfindingHelpers::GetPolygonCenter(PolygonMesh, Current));
+		const float DistanceToEnd = FVector::Dist(CurrentCenter, EndCenter);
+		if (DistanceToEnd < BestDistance)
+		{
+			BestDistance = DistanceToEnd;
+			BestPolygonIndex = CurrentIndex;
+		}
+
+		const float CurrentCost = CostSoFar[CurrentIndex];
+		for (const int32 NeighbourIndex : Current.Neighbours)
+		{
+			if (NeighbourIndex == INDEX_NONE)
+			{
+				continue;
+			}
+			const FNNPolygon& Neighbour = PolygonMesh.PolygonIndexes[NeighbourIndex];
+			if (!Filter.PassFilter(Neighbour))
+			{
+				continue;
+			}
+
+			const FVector NeighbourCenter = TransformToWorldSpace(NNPathfindingHelpers::GetPolygonCenter(PolygonMesh, Neighbour));
+			float NewCost = CurrentCost + FVector::Dist(CurrentCenter, NeighbourCenter) * Filter.GetAreaCost(Neighbour.AreaID);
+			if (Neighbour.AreaID != Current.AreaID)
+			{
+				NewCost += Filter.GetFixedAreaEnteringCost(Neighbour.AreaID);
+			}
+
+			const float* NeighbourCost = CostSoFar.Find(NeighbourIndex);
 			if (!NeighbourCost || NewCost < *NeighbourCost)
 			{
-				CostSoFar.Add(Neighbour.Key, NewCost);
-				float Priority = NewCost;
-				Priority += Neighbour.Key != PATH_GOAL_INDEX
-					? CalculateHeuristic(Graph.Nodes[Neighbour.Key].Position, Goal)
-					:  0.0f;
-				Frontier.Push(Neighbour.Key, Priority);
-				CameFrom.Add(Neighbour.Key, CurrentIndex); 
+				CostSoFar.Add(NeighbourIndex, NewCost);
+				CameFrom.Add(NeighbourIndex, CurrentIndex);
+				Frontier.Push(NeighbourIndex, NewCost + FVector::Dist(NeighbourCenter, EndCenter) * HeuristicScale);
 			}
 		}
-		
-		WorkingNeighbours.Reset();
 	}
-	if (Frontier.IsEmpty())
+
+	for (int32 Current = BestPolygonIndex; Current != INDEX_NONE; Current = CameFrom[Current])
 	{
-		// TODO (ignacio) remove later
-		return nullptr;
+		OutPath.Add(Current);
 	}
-	TArray<FVector> Path = {NavGoal};
-	int32 Current = CameFrom[PATH_GOAL_INDEX];
-	while (Current != PATH_START_INDEX)
+	Algo::Reverse(OutPath);
+	return bReached;
+}
+
+void FNNPathfinding::MoveAlongSurface(const FNNPolygonMesh& PolygonMesh, int32 StartPolygonIndex, const FVector& Start,
+	const FVector& End, const FNNQueryFilter& Filter, FVector& OutLocation, TArray<int32>& OutVisited) const
+{
+	OutVisited.Reset();
+
+	const FVector LocalStart = OpenHeightField.TransformToHeightFieldPosition(Start);
+	const FVector LocalEnd = OpenHeightField.TransformToHeightFieldPosition(End);
+
+	// Only the polygons touching the circle around the movement are visited
+	const FVector SearchCenter = (LocalStart + LocalEnd) * 0.5f;
+	const float SearchRadiusSqr = FMath::Square(FVector::Dist2D(LocalStart, LocalEnd) * 0.5f + KINDA_SMALL_NUMBER);
+
+	// Breadth first search. Each node stores the polygon index and the index of its parent node
+	TArray<FIntPoint, TInlineAllocator<NNPathfindingHelpers::MaxMoveAlongSurfaceNodes>> Nodes;
+	Nodes.Emplace(StartPolygonIndex, INDEX_NONE);
+
+	int32 BestNode = 0;
+	FVector BestLocation = LocalStart;
+	float BestDistanceSqr = TNumericLimits<float>::Max();
+	for (int32 NodeIndex = 0; NodeIndex < Nodes.Num(); ++NodeIndex)
 	{
-		Path.Add(TransformToWorldSpace(Graph.Nodes[Current].Position));
-		Current = CameFrom[Current];
+		const FNNPolygon& Polygon = PolygonMesh.PolygonIndexes[Nodes[NodeIndex].X];
+		if (NNPathfindingHelpers::IsPointInPolygon2D(LocalEnd, PolygonMesh, Polygon))
+		{
+			BestNode = NodeIndex;
+			BestLocation = LocalEnd;
+			break;
+		}
+
+		const int32 VertCount = Polygon.Indexes.Num();
+		for (int32 Edge = 0; Edge < VertCount; ++Edge)
+		{
+			const FVector& EdgeStart = PolygonMesh.Vertexes[Polygon.Indexes[Edge]];
+			const FVector& EdgeEnd = PolygonMesh.Vertexes[Polygon.Indexes[(Edge + 1) % VertCount]];
+			const int32 NeighbourIndex = Polygon.Neighbours.IsValidIndex(Edge) ? Polygon.Neighbours[Edge] : INDEX_NONE;
+			if (NeighbourIndex == INDEX_NONE || !Filter.PassFilter(PolygonMesh.PolygonIndexes[NeighbourIndex]))
+			{
+				// The movement is blocked by this wall. Its nearest point to the end is a candidate
+				const FVector ClosestPoint = FMath::ClosestPointOnSegment2D(LocalEnd, EdgeStart, EdgeEnd);
+				const float DistanceSqr = FVector::DistSquared2D(ClosestPoint, LocalEnd);
+				if (DistanceSqr < BestDistanceSqr)
+				{
+					BestDistanceSqr = DistanceSqr;
+					BestLocation = ClosestPoint;
+					BestNode = NodeIndex;
+				}
+				continue;
+			}
+
+			if (Nodes.Num() >= NNPathfindingHelpers::MaxMoveAlongSurfaceNodes
+				|| Nodes.ContainsByPredicate([NeighbourIndex](const FIntPoint& Node) { return Node.X == NeighbourIndex; }))
+			{
+				continue;
+			}
+			const FVector ClosestToSearch = FMath::ClosestPointOnSegment2D(SearchCenter, EdgeStart, EdgeEnd);
+			if (FVector::DistSquared2D(ClosestToSearch, SearchCenter) > SearchRadiusSqr)
+			{
+				continue;
+			}
+			Nodes.Emplace(NeighbourIndex, NodeIndex);
+		}
 	}
-	Path.Add(NavStart);
-	Algo::Reverse(Path);
-	FNavPathSharedPtr NavigationPath = MakeShared<FNavigationPath, ESPMode::ThreadSafe>(MoveTemp(Path));
-	return NavigationPath;
+
+	for (int32 NodeIndex = BestNode; NodeIndex != INDEX_NONE; NodeIndex = Nodes[NodeIndex].Y)
+	{
+		OutVisited.Add(Nodes[NodeIndex].X);
+	}
+	Algo::Reverse(OutVisited);
+	OutLocation = TransformToWorldSpace(BestLocation);
 }
 
-void FNNPathfinding::AddNodeNeighbour(FNNNode& Node, const FVector& Neighbour, int32 NeighbourIndex) const
+int32 FNNPathfinding::SelectPolygonByArea(const FNNPolygonMesh& PolygonMesh, float Area)
 {
-	const float NewCost = CalculateHeuristic(Node.Position, Neighbour);
-	if (const float* Cost = Node.Neighbours.Find(NeighbourIndex))
+	const int32 PolygonIndex = Algo::UpperBound(PolygonMesh.PolygonAreaPrefixSum, Area);
+	return FMath::Min(PolygonIndex, PolygonMesh.PolygonAreaPrefixSum.Num() - 1);
+}
+
+FVector FNNPathfinding::GetRandomPointInPolygon(const FNNPolygonMesh& PolygonMesh, int32 PolygonIndex) const
+{
+	const FNNPolygon& Polygon = PolygonMesh.PolygonIndexes[PolygonIndex];
+	const int32 VertCount = Polygon.Indexes.Num();
+	const FVector& Origin = PolygonMesh.Vertexes[Polygon.Indexes[0]];
+
+	// Select a triangle of the fan weighted by its area
+	float TriangleAreas[NNNavAreas::MaxPolygonVertexes];
+	float TotalArea = 0.0f;
+	const int32 TrianglesNum = FMath::Min(VertCount, NNNavAreas::MaxPolygonVertexes) - 2;
+	for (int32 i = 0; i < TrianglesNum; ++i)
 	{
-		// TODO (ignacio) we might want to delete this. I think that the costs will always be the same
-		Node.Neighbours.Add(NeighbourIndex, FMath::Min(NewCost, *Cost));
+		const FVector& B = PolygonMesh.Vertexes[Polygon.Indexes[i + 1]];
+		const FVector& C = PolygonMesh.Vertexes[Polygon.Indexes[i + 2]];
+		TriangleAreas[i] = FMath::Abs((B.X - Origin.X) * (C.Y - Origin.Y) - (C.X - Origin.X) * (B.Y - Origin.Y));
+		TotalArea += TriangleAreas[i];
 	}
-	else
+
+	float RandomArea = FMath::FRand() * TotalArea;
+	int32 Triangle = FMath::Max(TrianglesNum - 1, 0);
+	for (int32 i = 0; i < TrianglesNum; ++i)
 	{
-		Node.Neighbours.Add(NeighbourIndex, NewCost);
+		if (RandomArea < TriangleAreas[i])
+		{
+			Triangle = i;
+			break;
+		}
+		RandomArea -= TriangleAreas[i];
 	}
+
+	// Uniform point inside the triangle
+	const FVector& B = PolygonMesh.Vertexes[Polygon.Indexes[FMath::Min(Triangle + 1, VertCount - 1)]];
+	const FVector& C = PolygonMesh.Vertexes[Polygon.Indexes[FMath::Min(Triangle + 2, VertCount - 1)]];
+	const float SqrtU = FMath::Sqrt(FMath::FRand());
+	const float V = FMath::FRand();
+	const FVector Point = Origin * (1.0f - SqrtU) + B * (SqrtU * (1.0f - V)) + C * (SqrtU * V);
+	return TransformToWorldSpace(Point);
+}
+
+int32 FNNPathfinding::GetRandomReachablePolygon(const FNNPolygonMesh& PolygonMesh, int32 StartPolygonIndex,
+	const FVector& Origin, float Radius, const FNNQueryFilter& Filter) const
+{
+	const FVector LocalOrigin = OpenHeightField.TransformToHeightFieldPosition(Origin);
+	const float LocalRadiusSqr = FMath::Square(Radius / OpenHeightField.CellSize);
+
+	TMap<int32, float> CostSoFar;
+	TSet<int32> Visited;
+	FNNPriorityQueue<int32> Frontier;
+	Frontier.Push(StartPolygonIndex, 0.0f);
+	CostSoFar.Add(StartPolygonIndex, 0.0f);
+
+	// Reservoir sampling weighted by the polygon area
+	int32 SelectedPolygonIndex = INDEX_NONE;
+	float VisitedArea = 0.0f;
+	while (!Frontier.IsEmpty())
+	{
+		const int32 CurrentIndex = Frontier.Pop();
+		bool bAlreadyVisited;
+		Visited.Add(CurrentIndex, &bAlreadyVisited);
+		if (bAlreadyVisited)
+		{
+			continue;
+		}
+
+		const float PolygonArea = PolygonMesh.GetPolygonArea(CurrentIndex);
+		VisitedArea += PolygonArea;
+		if (FMath::FRand() * VisitedArea <= PolygonArea)
+		{
+			SelectedPolygonIndex = CurrentIndex;
+		}
+
+		const FNNPolygon& Current = PolygonMesh.PolygonIndexes[CurrentIndex];
+		const FVector CurrentCenter = NNPathfindingHelpers::GetPolygonCenter(PolygonMesh, Current);
+		const int32 VertCount = Current.Indexes.Num();
+		for (int32 Edge = 0; Edge < VertCount; ++Edge)
+		{
+			const int32 NeighbourIndex = Current.Neighbours.IsValidIndex(Edge) ? Current.Neighbours[Edge] : INDEX_NONE;
+			if (NeighbourIndex == INDEX_NONE || Visited.Contains(NeighbourIndex))
+			{
+				continue;
+			}
+			const FNNPolygon& Neighbour = PolygonMesh.PolygonIndexes[NeighbourIndex];
+			if (!Filter.PassFilter(Neighbour))
+			{
+				continue;
+			}
+
+			// The shared edge needs to touch the circle
+			const FVector& EdgeStart = PolygonMesh.Vertexes[Current.Indexes[Edge]];
+			const FVector& EdgeEnd = PolygonMesh.Vertexes[Current.Indexes[(Edge + 1) % VertCount]];
+			const FVector ClosestPoint = FMath::ClosestPointOnSegment2D(LocalOrigin, EdgeStart, EdgeEnd);
+			if (FVector::DistSquared2D(ClosestPoint, LocalOrigin) > LocalRadiusSqr)
+			{
+				continue;
+			}
+
+			const FVector NeighbourCenter = NNPathfindingHelpers::GetPolygonCenter(PolygonMesh, Neighbour);
+			const float NewCost = CostSoFar[CurrentIndex] + FVector::Dist2D(CurrentCenter, NeighbourCenter);
+			const float* NeighbourCost = CostSoFar.Find(NeighbourIndex);
+			if (!NeighbourCost || NewCost < *NeighbourCost)
+			{
+				CostSoFar.Add(NeighbourIndex, NewCost);
+				Frontier.Push(NeighbourIndex, NewCost);
+			}
+		}
+	}
+	return SelectedPolygonIndex;
+}
+
+void FNNPathfinding::AddNodeNeighbour(FNNNode& Node, const FVector& Neighbour, int32 NeighbourIndex, int32 PolygonIndex) const
+{
+	FNNNodeEdge* Edge = Node.Neighbours.Find(NeighbourIndex);
+	if (!Edge)
+	{
+		Edge = &Node.Neighbours.Add(NeighbourIndex, FNNNodeEdge(CalculateDistanceCost(Node.Position, Neighbour)));
+	}
+
+	// An edge is shared at most by two polygons
+	if (Edge->Polygons[0] == INDEX_NONE)
+	{
+		Edge->Polygons[0] = PolygonIndex;
+	}
+	else if (Edge->Polygons[0] != PolygonIndex)
+	{
+		Edge->Polygons[1] = PolygonIndex;
+	}
+}
+
+float FNNPathfinding::GetEdgeCost(const FNNNodeEdge& Edge, const FNNPolygonMesh& PolygonMesh, const FNNQueryFilter& Filter)
+{
+	const float AreaCost = GetEdgeAreaCost(Edge, PolygonMesh, Filter);
+	return AreaCost >= 0.0f ? Edge.Cost * AreaCost : -1.0f;
+}
+
+float FNNPathfinding::GetEdgeAreaCost(const FNNNodeEdge& Edge, const FNNPolygonMesh& PolygonMesh, const FNNQueryFilter& Filter)
+{
+	float BestCost = -1.0f;
+	for (const int32 PolygonIndex : Edge.Polygons)
+	{
+		if (PolygonIndex == INDEX_NONE)
+		{
+			continue;
+		}
+		const FNNPolygon& Polygon = PolygonMesh.PolygonIndexes[PolygonIndex];
+		if (Filter.PassFilter(Polygon))
+		{
+			const float Cost = Filter.GetAreaCost(Polygon.AreaID);
+			if (BestCost < 0.0f || Cost < BestCost)
+			{
+				BestCost = Cost;
+			}
+		}
+	}
+	return BestCost;
+}
+
+float FNNPathfinding::CalculateDistanceCost(const FVector& Lhs, const FVector& Rhs)
+{
+	return FVector::Dist(Lhs, Rhs);
 }
 
 float FNNPathfinding::CalculateHeuristic(const FVector& Lhs, const FVector& Rhs)
 {
-	return FVector::DistSquared(Lhs, Rhs);
+	return FVector::Dist(Lhs, Rhs);
 }
 
 FVector FNNPathfinding::TransformToWorldSpace(const FVector& Position) const
@@ -0,0 +1,84 @@
+﻿#include "NavData/Pathfinding/NNQueryFilter.h"
+
+// NN Includes
+#include "NavData/ConvexPolygon/NNPolyMeshBuilder.h"
+
+void FNNQueryFilter::Reset()
+{
+	for (int32 i = 0; i < NNNavAreas::MaxAreas; ++i)
+	{
+		AreaCosts[i] = 1.0f;
+		AreaFixedCosts[i] = 0.0f;
+	}
+	HeuristicScale = 1.0f;
+	IncludeFlags = 0xffff;
+	ExcludeFlags = 0;
+	bIsBacktracking = false;
+}
+
+void FNNQueryFilter::SetAreaCost(uint8 AreaType, float Cost)
+{
+	if (AreaType < NNNavAreas::MaxAreas)
+	{
+		AreaCosts[AreaType] = Cost;
+	}
+}
+
+void FNNQueryFilter::SetFixedAreaEnteringCost(uint8 AreaType, float Cost)
+{
+	if (AreaType < NNNavAreas::MaxAreas)
+	{
+		AreaFixedCosts[AreaType] = Cost;
+	}
+}
+
+void FNNQueryFilter::SetExcludedArea(uint8 AreaType)
+{
+	SetAreaCost(AreaType, NNNavAreas::UnwalkableCost);
+}
+
+void FNNQueryFilter::SetAllAreaCosts(const float* CostArray, const int32 Count)
+{
+	const int32 AreasNum = FMath::Min(Count, NNNavAreas::MaxAreas);
+	for (int32 i = 0; i < AreasNum; ++i)
+	{
+		AreaCosts[i] = CostArray[i];
+	}
+}
+
+void FNNQueryFilter::GetAllAreaCosts(float* CostArray, float* FixedCostArray, const int32 Count) const
+{
+	const int32 AreasNum = FMath::Min(Count, NNNavAreas::MaxAreas);
+	for (int32 i = 0; i < AreasNum; ++i)
+	{
+		CostArray[i] = AreaCosts[i];
+		FixedCostArray[i] = AreaFixedCosts[i];
+	}
+}
+
+bool FNNQueryFilter::IsEqual(const INavigationQueryFilterInterface* Other) const
+{
+	if (!Other)
+	{
+		return false;
+	}
+
+	// The filters are only compared against filters created by the same navmesh
+	const FNNQueryFilter& OtherFilter = *static_cast<const FNNQueryFilter*>(Other);
+	for (int32 i = 0; i < NNNavAreas::MaxAreas; ++i)
+	{
+		if (AreaCosts[i] != OtherFilter.AreaCosts[i] || AreaFixedCosts[i] != OtherFilter.AreaFixedCosts[i])
+		{
+			return false;
+		}
+	}
+	return HeuristicScale == OtherFilter.HeuristicScale
+		&& IncludeFlags == OtherFilter.IncludeFlags
+		&& ExcludeFlags == OtherFilter.ExcludeFlags
+		&& bIsBacktracking == OtherFilter.bIsBacktracking;
+}
+
+bool FNNQueryFilter::PassFilter(const FNNPolygon& Polygon) const
+{
+	return PassFilter(Polygon.AreaID, Polygon.Flags);
+}
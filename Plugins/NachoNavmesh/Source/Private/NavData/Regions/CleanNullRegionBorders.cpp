@@ -26,9 +26,9 @@ void FNNCleanNullRegionBorders::CleanNullRegionBorders()
 			const bool bEncompassedNullRegion = ProcessNullRegion(*WorkingSpan, EdgeDirection);
 			if (bEncompassedNullRegion)
 			{
-				const int32 RegionIndex = OpenHeightField.GetRegionIndexByID(WorkingSpan->RegionID);
-				FNNRegion& NewRegion = OpenHeightField.Regions.Emplace_GetRef(FNNRegion::GenerateNewRegion());
-				PartialFloodRegion(*WorkingSpan, EdgeDirection, OpenHeightField.Regions[RegionIndex], NewRegion);
+				const int32 RegionID = WorkingSpan->RegionID;
+				FNNRegion& NewRegion = OpenHeightField.AddRegion();
+				PartialFloodRegion(*WorkingSpan, EdgeDirection, OpenHeightField.Regions[RegionID], NewRegion);
 			}
 		}
 	}
@@ -140,7 +140,7 @@ bool FNNCleanNullRegionBorders::ProcessOuterCorner(FNNOpenSpan& CurrentSpan, int
 	const int32 BackOneRegionID = BackOne ? BackOne->RegionID : INDEX_NONE;
 	FNNOpenSpan* BackTwo = CurrentSpan.Neighbours[BorderDirection];
 	const int32 BackTwoRegionID = BackTwo ? BackTwo->RegionID : INDEX_NONE;
-	if (BackOneRegionID != CurrentSpan.RegionID && BackTwoRegionID == CurrentSpan.RegionID)
+	if (BackOne && BackOneRegionID != CurrentSpan.RegionID && BackTwoRegionID == CurrentSpan.RegionID)
 	{
 		/*
 		* Dangerous corner configuration.
@@ -228,10 +228,12 @@ bool FNNCleanNullRegionBorders::ProcessOuterCorner(FNNOpenSpan& CurrentSpan, int
 
 void FNNCleanNullRegionBorders::ChangeRegion(FNNOpenSpan& ReferenceSpan, int32 NewRegionID) const
 {
-	const int32 OldRegionIndex = OpenHeightField.GetRegionIndexByID(ReferenceSpan.RegionID);
-	OpenHeightField.Regions[OldRegionIndex].Spans.Remove(&ReferenceSpan);
-	const int32 NewRegionIndex = OpenHeightField.GetRegionIndexByID(NewRegionID);
-	OpenHeightField.Regions[NewRegionIndex].Spans.Add(&ReferenceSpan);
+	if (!OpenHeightField.Regions.IsValidIndex(NewRegionID) || OpenHeightField.Regions[NewRegionID].AreaID != ReferenceSpan.AreaID)
+	{
+		// The span can't be moved to a region with a different area
+		return;
+	}
+	ReferenceSpan.RegionID = NewRegionID;
 }
 
 
@@ -240,8 +242,7 @@ void FNNCleanNullRegionBorders::PartialFloodRegion(FNNOpenSpan& StartSpan, int32
 	const int32 AntiBorderDirection = (BorderDirection + 2) % 4;
 
 	StartSpan.RegionID = NewRegion.ID;
-	StartSpanRegion.Spans.Remove(&StartSpan);
-	NewRegion.Spans.Add(&StartSpan);
+	NewRegion.AreaID = StartSpanRegion.AreaID;
 	TArray<FNNOpenSpan*> OpenSpans = {&StartSpan};
 	TArray<int32> BorderDistance = {0};
 
@@ -273,7 +274,6 @@ void FNNCleanNullRegionBorders::PartialFloodRegion(FNNOpenSpan& StartSpan, int32
 				++NeighbourDistance;
 			}
 			Neighbour->RegionID = NewRegion.ID;
-			NewRegion.Spans.Add(Neighbour);
 			OpenSpans.Add(MoveTemp(Neighbour));
 			BorderDistance.Add(NeighbourDistance);
 		}
@@ -3,16 +3,44 @@
 #include "NavData/Regions/CleanNullRegionBorders.h"
 #include "NavData/Voxelization/OpenHeightFieldGenerator.h"
 
+namespace NNRegionGeneratorHelpers
+{
+	/** A run of connected spans in the same row used by the monotone partitioning */
+	struct FNNSweep
+	{
+		/** The region assigned to the spans of the sweep */
+		int32 RegionIndex = INDEX_NONE;
+		/** The region of the previous row connected to the sweep */
+		int32 NeighbourRegion = INDEX_NONE;
+		/** Quantity of spans connected to the NeighbourRegion */
+		int32 SamplesNum = 0;
+		/** Whether the sweep is connected to more than one region of the previous row */
+		bool bMultipleNeighbours = false;
+	};
+}
 
 void FNNRegionGenerator::CreateRegions(FNNOpenHeightField& OpenHeightField, float MinRegionSize, int32 TraversableAreaBorderSize) const
 {
 	const int32 MinDist = TraversableAreaBorderSize + OpenHeightField.GetSpanMinEdgeDistance();
 	const int32 ExpandIterations = 4 + (TraversableAreaBorderSize * 2); // ???
 
-	// The current distance from the border that are we currently searching
-	// The distance starts at the maximum distance and moves towards 0
-	// It should always be divisible by 2
-	int32 Dist = (OpenHeightField.GetSpanMaxEdgeDistance()) & ~1;
+	// The distance from the border of the first "water level". The levels move towards 0 in steps of 2
+	const int32 MaxDist = (OpenHeightField.GetSpanMaxEdgeDistance()) & ~1;
+	const int32 LevelsNum = MaxDist > MinDist ? (MaxDist - MinDist + 1) / 2 : 0;
+
+	// Buckets the spans by the first level that floods them. The last bucket has the spans only used by the final expansion
+	TArray<TArray<FNNOpenSpan*>> LevelStacks;
+	LevelStacks.SetNum(LevelsNum + 1);
+	for (FNNOpenHeightFieldIterator It (OpenHeightField); It; ++It)
+	{
+		FNNOpenSpan* CurrentSpan = It.Get();
+		if (CurrentSpan->RegionID != INDEX_NONE || CurrentSpan->EdgeDistance < MinDist)
+		{
+			continue;
+		}
+		const int32 Level = CurrentSpan->EdgeDistance >= MaxDist ? 0 : (MaxDist - CurrentSpan->EdgeDistance + 1) / 2;
+		LevelStacks[FMath::Min(Level, LevelsNum)].Add(CurrentSpan);
+	}
 
 	// These spans are flooded and ready to be processed
 	TArray<FNNOpenSpan*> FloodedSpans;
@@ -21,27 +49,25 @@ void FNNRegionGenerator::CreateRegions(FNNOpenHeightField& OpenHeightField, floa
 	TArray<FNNOpenSpan*> WorkingStack;
 	WorkingStack.Reserve(1024);
 
-	FNNRegion NewRegion = FNNRegion::GenerateNewRegion();
-	TMap<int32, FNNRegion> RegionsByID;
-	RegionsByID.Add(NewRegion.ID, NewRegion);
+	// The region being flooded takes the next ID. It's only added when the flood succeeds
+	TArray<FNNRegion>& Regions = OpenHeightField.Regions;
+	FNNRegion NewRegion (Regions.Num());
+
+	const auto IsSpanProcessed = [](const FNNOpenSpan* Span) { return !Span || Span->RegionID != INDEX_NONE; };
 
 	// Iterates until the distance reached the minimum allowed distance
-	while (Dist > MinDist)
+	for (int32 Level = 0; Level < LevelsNum; ++Level)
 	{
-		FloodedSpans.Reset();
-		// Finds all the spans that are below the current "water level" and don't have a region assigned
-		for (FNNOpenHeightFieldIterator It (OpenHeightField); It; ++It)
-		{
-			FNNOpenSpan* CurrentSpan = It.Get();
-			if (CurrentSpan->RegionID == INDEX_NONE && CurrentSpan->EdgeDistance >= Dist)
-			{
-				FloodedSpans.Add(CurrentSpan);
-			}
-		}
+		const int32 Dist = MaxDist - Level * 2;
+
+		// The spans without region from the previous levels are still below the current "water level".
+		// The spans of this level might have been already assigned by the flooding of the previous levels
+		FloodedSpans.Append(LevelStacks[Level]);
+		FloodedSpans.RemoveAll(IsSpanProcessed);
 
-		if (RegionsByID.Num() > 1)
+		if (Regions.Num() > 0)
 		{
-			ExpandRegions(RegionsByID, FloodedSpans, Dist > 0 ? ExpandIterations : -1);
+			ExpandRegions(FloodedSpans, Dist > 0 ? ExpandIterations : -1);
 		}
 
 		for (FNNOpenSpan* FloodedSpan : FloodedSpans)
@@ -55,99 +81,295 @@ void FNNRegionGenerator::CreateRegions(FNNOpenHeightField& OpenHeightField, floa
 			const int32 FillTo = FMath::Max(Dist - 2, MinDist);
 			if (FloodNewRegion(FloodedSpan, FillTo, WorkingStack, NewRegion))
 			{
-				RegionsByID.Add(NewRegion.ID, MoveTemp(NewRegion));
-				NewRegion = FNNRegion::GenerateNewRegion();
+				Regions.Add(MoveTemp(NewRegion));
+				NewRegion = FNNRegion(Regions.Num());
 			}
 		}
-
-		Dist = FMath::Max(Dist - 2, 0);
 	}
 
 	// Find all the spans remaining without region
-	FloodedSpans.Reset();
-	for (FNNOpenHeightFieldIterator It (OpenHeightField); It; ++It)
-	{
-		if (It->EdgeDistance >= MinDist && It->RegionID == INDEX_NONE)
-		{
-			FloodedSpans.Add(*It);
-		}
-	}
+	FloodedSpans.Append(LevelStacks[LevelsNum]);
+	FloodedSpans.RemoveAll(IsSpanProcessed);
 
 	// Perform a final region expansion. Allow more iterations than the previous ones
-	ExpandRegions(RegionsByID, FloodedSpans, MinDist > 0 ? ExpandIterations * 8 : -1);
+	ExpandRegions(FloodedSpans, MinDist > 0 ? ExpandIterations * 8 : -1);
+
+	FilterAndCleanRegions(OpenHeightField, MinRegionSize);
+}
 
-	OpenHeightField.Regions.Reserve(RegionsByID.Num());
-	 for (auto& RegionByID : RegionsByID)
-	 {
-		 OpenHeightField.Regions.Add(MoveTemp(RegionByID.Value));
-	 }
+void FNNRegionGenerator::CreateMonotoneRegions(FNNOpenHeightField& OpenHeightField, float MinRegionSize, int32 TraversableAreaBorderSize) const
+{
+	const int32 MinDist = TraversableAreaBorderSize + OpenHeightField.GetSpanMinEdgeDistance();
+	SweepMonotoneRegions(OpenHeightField, MinDist, OpenHeightField.Regions);
+	FilterAndCleanRegions(OpenHeightField, MinRegionSize);
+}
+
+void FNNRegionGenerator::CreateLayerRegions(FNNOpenHeightField& OpenHeightField, float MinRegionSize, int32 TraversableAreaBorderSize) const
+{
+	const int32 MinDist = TraversableAreaBorderSize + OpenHeightField.GetSpanMinEdgeDistance();
+	SweepMonotoneRegions(OpenHeightField, MinDist, OpenHeightField.Regions);
+	MergeRegionLayers(OpenHeightField);
+	FilterAndCleanRegions(OpenHeightField, MinRegionSize);
+}
 
+void FNNRegionGenerator::FilterAndCleanRegions(FNNOpenHeightField& OpenHeightField, float MinRegionSize) const
+{
 	const int32 MinSpansForRegions = FMath::CeilToInt(MinRegionSize / OpenHeightField.CellSize);
 	// TODO (ignacio) we are creating the region mapping inside this function
-	FilterSmallRegions(OpenHeightField.Regions, MinSpansForRegions);
+	FilterSmallRegions(OpenHeightField, MinSpansForRegions);
 	FNNCleanNullRegionBorders CleanNullRegionBorders (OpenHeightField);
 	CleanNullRegionBorders.CleanNullRegionBorders();
+	OpenHeightField.UpdateRegionStats();
 }
 
-void FNNRegionGenerator::FilterSmallRegions(TArray<FNNRegion>& Regions, int32 MinSpansForRegions) const
+void FNNRegionGenerator::SweepMonotoneRegions(FNNOpenHeightField& OpenHeightField, int32 MinDist, TArray<FNNRegion>& OutRegions) const
 {
-	// Seems faster than saving the index in the spans and then remapping them
-	TMap<int32, int32> RegionIndexByRegionID;
-	for (int32 i = 0; i < Regions.Num(); ++i)
+	using namespace NNRegionGeneratorHelpers;
+
+	TArray<FNNSweep> Sweeps;
+	TArray<FNNOpenSpan*> RowSpans;
+	// Quantity of spans of the current row connected to each region of the previous row
+	TArray<int32> PreviousRowConnections;
+
+	const int32 Width = OpenHeightField.UnitsWidth;
+	const int32 RowsNum = Width > 0 ? OpenHeightField.Spans.Num() / Width : 0;
+	for (int32 Y = 0; Y < RowsNum; ++Y)
 	{
-		RegionIndexByRegionID.Add(Regions[i].ID, i);
+		Sweeps.Reset();
+		RowSpans.Reset();
+		PreviousRowConnections.SetNumZeroed(OutRegions.Num());
+
+		// While the row is processed the RegionID of its spans is the index of their sweep
+		for (int32 X = 0; X < Width; ++X)
+		{
+			for (FNNOpenSpan* Span = OpenHeightField.Spans[X + Y * Width].Get(); Span; Span = Span->NextOpenSpan.Get())
+			{
+				if (Span->EdgeDistance < MinDist)
+				{
+					continue;
+				}
+
+				// Continues the sweep of the previous span in the row
+				const FNNOpenSpan* Previous = Span->Neighbours[0];
+				const bool bContinuesSweep = Previous && Previous->RegionID != INDEX_NONE && Previous->AreaID == Span->AreaID;
+				const int32 SweepIndex = bContinuesSweep ? Previous->RegionID : Sweeps.AddDefaulted();
+				Span->RegionID = SweepIndex;
+				RowSpans.Add(Span);
+
+				// Checks the connection with the region of the previous row
+				const FNNOpenSpan* Below = Span->Neighbours[3];
+				if (!Below || Below->RegionID == INDEX_NONE || Below->AreaID != Span->AreaID)
+				{
+					continue;
+				}
+				FNNSweep& Sweep = Sweeps[SweepIndex];
+				if (Sweep.NeighbourRegion == INDEX_NONE || Sweep.NeighbourRegion == Below->RegionID)
+				{
+					Sweep.NeighbourRegion = Below->RegionID;
+					++Sweep.SamplesNum;
+					++PreviousRowConnections[Below->RegionID];
+				}
+				else
+				{
+					Sweep.bMultipleNeighbours = true;
+				}
+			}
+		}
+
+		// A sweep continues the region of the previous row only if no other sweep is connected to it
+		for (FNNSweep& Sweep : Sweeps)
+		{
+			if (!Sweep.bMultipleNeighbours && Sweep.NeighbourRegion != INDEX_NONE && PreviousRowConnections[Sweep.NeighbourRegion] == Sweep.SamplesNum)
+			{
+				Sweep.RegionIndex = Sweep.NeighbourRegion;
+			}
+			else
+			{
+				Sweep.RegionIndex = OutRegions.Emplace(OutRegions.Num());
+			}
+		}
+
+		for (FNNOpenSpan* Span : RowSpans)
+		{
+			const FNNOpenSpan* Below = Span->Neighbours[3];
+			if (Below && Below->RegionID != INDEX_NONE)
+			{
+				PreviousRowConnections[Below->RegionID] = 0;
+			}
+
+			Span->RegionID = Sweeps[Span->RegionID].RegionIndex;
+			OutRegions[Span->RegionID].AreaID = Span->AreaID;
+		}
+	}
+}
+
+void FNNRegionGenerator::MergeRegionLayers(FNNOpenHeightField& OpenHeightField) const
+{
+	TArray<FNNRegion>& Regions = OpenHeightField.Regions;
+	const int32 RegionsNum = Regions.Num();
+	OpenHeightField.UpdateRegionStats();
+
+	// The regions that have spans in the same column than each region
+	TArray<TArray<int32>> Overlaps;
+	Overlaps.SetNum(RegionsNum);
+	for (const TUniquePtr<FNNOpenSpan>& Column : OpenHeightField.Spans)
+	{
+		for (const FNNOpenSpan* Span = Column.Get(); Span; Span = Span->NextOpenSpan.Get())
+		{
+			if (Span->RegionID == INDEX_NONE)
+			{
+				continue;
+			}
+			for (const FNNOpenSpan* Above = Span->NextOpenSpan.Get(); Above; Above = Above->NextOpenSpan.Get())
+			{
+				if (Above->RegionID != INDEX_NONE && Above->RegionID != Span->RegionID)
+				{
+					Overlaps[Span->RegionID].AddUnique(Above->RegionID);
+					Overlaps[Above->RegionID].AddUnique(Span->RegionID);
+				}
+			}
+		}
 	}
 
-	for (int32 i = Regions.Num() -1; i >= 0; --i)
+	// Grows a layer from every region not yet assigned
+	TArray<int32> LayerByRegion;
+	LayerByRegion.Init(INDEX_NONE, RegionsNum);
+	TSet<int32> LayerOverlaps;
+	TArray<int32> Stack;
+	TArray<FNNRegion> Layers;
+	for (int32 Root = 0; Root < RegionsNum; ++Root)
 	{
-		FNNRegion& CurrentRegion = Regions[i];
-		// TODO (ignacio) if we are going to access the region neighbours in another place we might want to cache them in the region
-		if (CurrentRegion.Spans.Num() > MinSpansForRegions)
+		if (LayerByRegion[Root] != INDEX_NONE)
 		{
 			continue;
 		}
-		// We will need to merge it with another region or eliminate it
-		int32 SmallestRegionIndex = INDEX_NONE;
-		int32 SmallestRegionSpansQuantity = TNumericLimits<int32>::Max();
-		for (FNNOpenSpan* Span : CurrentRegion.Spans)
+		const int32 Layer = Layers.Emplace(Layers.Num());
+		Layers[Layer].AreaID = Regions[Root].AreaID;
+		LayerByRegion[Root] = Layer;
+		LayerOverlaps.Reset();
+		LayerOverlaps.Append(Overlaps[Root]);
+		Stack.Reset();
+		Stack.Add(Root);
+		while (Stack.Num() > 0)
 		{
-			for (FNNOpenSpan* Neighbour : Span->Neighbours)
+			const int32 Current = Stack.Pop(false);
+			for (const int32 Neighbour : Regions[Current].Neighbours)
 			{
-				if (Neighbour && Neighbour->RegionID != INDEX_NONE && Neighbour->RegionID != CurrentRegion.ID)
+				if (LayerByRegion[Neighbour] != INDEX_NONE || Regions[Neighbour].AreaID != Regions[Root].AreaID || LayerOverlaps.Contains(Neighbour))
 				{
-					const int32 RegionIndex = *RegionIndexByRegionID.Find(Neighbour->RegionID);
-					FNNRegion& NeighbourRegion = Regions[RegionIndex];
-					if (NeighbourRegion.Spans.Num() < SmallestRegionSpansQuantity)
-					{
-						SmallestRegionSpansQuantity = NeighbourRegion.Spans.Num();
-						SmallestRegionIndex = RegionIndex;
-					}
+					continue;
 				}
+				LayerByRegion[Neighbour] = Layer;
+				LayerOverlaps.Append(Overlaps[Neighbour]);
+				Stack.Add(Neighbour);
 			}
 		}
+	}
 
-		for (FNNOpenSpan* Span : CurrentRegion.Spans)
+	for (FNNOpenHeightFieldIterator It (OpenHeightField); It; ++It)
+	{
+		if (It->RegionID != INDEX_NONE)
+		{
+			It->RegionID = LayerByRegion[It->RegionID];
+		}
+	}
+	Regions = MoveTemp(Layers);
+}
+
+void FNNRegionGenerator::FilterSmallRegions(FNNOpenHeightField& OpenHeightField, int32 MinSpansForRegions) const
+{
+	TArray<FNNRegion>& Regions = OpenHeightField.Regions;
+	const int32 RegionsNum = Regions.Num();
+
+	OpenHeightField.UpdateRegionStats();
+	TArray<int32> SpansCount;
+	SpansCount.Reserve(RegionsNum);
+	TArray<TArray<int32>> Connections;
+	Connections.SetNum(RegionsNum);
+	for (int32 i = 0; i < RegionsNum; ++i)
+	{
+		SpansCount.Add(Regions[i].SpansCount);
+		// Regions from different areas can't be merged
+		for (const int32 Neighbour : Regions[i].Neighbours)
 		{
-			if (SmallestRegionIndex == INDEX_NONE)
+			if (Regions[Neighbour].AreaID == Regions[i].AreaID)
 			{
-				Span->RegionID = INDEX_NONE;
+				Connections[i].Add(Neighbour);
 			}
-			else
+		}
+	}
+
+	TArray<int32> Parents;
+	Parents.SetNumUninitialized(RegionsNum);
+	for (int32 i = 0; i < RegionsNum; ++i)
+	{
+		Parents[i] = i;
+	}
+	const auto FindRoot = [&Parents](int32 Index)
+	{
+		while (Parents[Index] != Index)
+		{
+			Parents[Index] = Parents[Parents[Index]];
+			Index = Parents[Index];
+		}
+		return Index;
+	};
+
+	// Small regions are merged with their smallest neighbour. The ones without neighbours are removed
+	TArray<bool> Removed;
+	Removed.Init(false, RegionsNum);
+	for (int32 i = RegionsNum - 1; i >= 0; --i)
+	{
+		if (Parents[i] != i || SpansCount[i] > MinSpansForRegions)
+		{
+			continue;
+		}
+
+		int32 SmallestRegion = INDEX_NONE;
+		for (const int32 Connection : Connections[i])
+		{
+			const int32 NeighbourRegion = FindRoot(Connection);
+			if (NeighbourRegion != i && !Removed[NeighbourRegion] &&
+				(SmallestRegion == INDEX_NONE || SpansCount[NeighbourRegion] < SpansCount[SmallestRegion]))
 			{
-				FNNRegion& NewRegion = Regions[SmallestRegionIndex];
-				Span->RegionID = NewRegion.ID;
-				NewRegion.Spans.Add(Span);
+				SmallestRegion = NeighbourRegion;
 			}
 		}
-		RegionIndexByRegionID.Remove(Regions[i].ID);
-		Regions.RemoveAt(i);
 
-		// Remap RegionIndexByRegionID
-		for (int32 RemapIndex = i; RemapIndex < Regions.Num(); ++RemapIndex)
+		if (SmallestRegion == INDEX_NONE)
+		{
+			Removed[i] = true;
+			continue;
+		}
+		Parents[i] = SmallestRegion;
+		SpansCount[SmallestRegion] += SpansCount[i];
+		Connections[SmallestRegion].Append(MoveTemp(Connections[i]));
+	}
+
+	// Compacts the remaining regions keeping the ID equal to the index
+	TArray<int32> RegionRemap;
+	RegionRemap.Init(INDEX_NONE, RegionsNum);
+	TArray<FNNRegion> FilteredRegions;
+	for (int32 i = 0; i < RegionsNum; ++i)
+	{
+		if (Parents[i] == i && !Removed[i])
+		{
+			RegionRemap[i] = FilteredRegions.Emplace(FilteredRegions.Num());
+			FilteredRegions.Last().AreaID = Regions[i].AreaID;
+		}
+	}
+	for (int32 i = 0; i < RegionsNum; ++i)
+	{
+		RegionRemap[i] = RegionRemap[FindRoot(i)];
+	}
+	for (FNNOpenHeightFieldIterator It (OpenHeightField); It; ++It)
+	{
+		if (It->RegionID != INDEX_NONE)
 		{
-			RegionIndexByRegionID[Regions[RemapIndex].ID] = RemapIndex;
+			It->RegionID = RegionRemap[It->RegionID];
 		}
 	}
+	Regions = MoveTemp(FilteredRegions);
 }
 
 bool FNNRegionGenerator::FloodNewRegion(FNNOpenSpan* RootSpan, int32 FillToDistance, TArray<FNNOpenSpan*>& WorkingStack, FNNRegion& NewRegion) const
@@ -155,7 +377,7 @@ bool FNNRegionGenerator::FloodNewRegion(FNNOpenSpan* RootSpan, int32 FillToDista
 	WorkingStack.Reset();
 
 	WorkingStack.Add(RootSpan);
-	NewRegion.Spans.Add(RootSpan);
+	NewRegion.AreaID = RootSpan->AreaID;
 	RootSpan->RegionID = NewRegion.ID;
 	RootSpan->DistanceToCore = 0;
 
@@ -168,7 +390,7 @@ bool FNNRegionGenerator::FloodNewRegion(FNNOpenSpan* RootSpan, int32 FillToDista
 		for (int32 Dir = 0; Dir < 4; ++Dir)
 		{
 			FNNOpenSpan* Neighbour = Span->Neighbours[Dir];
-			if (!Neighbour)
+			if (!Neighbour || Neighbour->AreaID != NewRegion.AreaID)
 			{
 				continue;
 			}
@@ -181,7 +403,7 @@ bool FNNRegionGenerator::FloodNewRegion(FNNOpenSpan* RootSpan, int32 FillToDista
 
 			// Check the diagonal neighbour
 			Neighbour = Neighbour->Neighbours[(Dir + 1) % 4];
-			if (Neighbour && Neighbour->RegionID != INDEX_NONE && Neighbour->RegionID != NewRegion.ID)
+			if (Neighbour && Neighbour->AreaID == NewRegion.AreaID && Neighbour->RegionID != INDEX_NONE && Neighbour->RegionID != NewRegion.ID)
 			{
 				bOnRegionBorder = true;
 				break;
@@ -190,7 +412,6 @@ bool FNNRegionGenerator::FloodNewRegion(FNNOpenSpan* RootSpan, int32 FillToDista
 
 		if (bOnRegionBorder)
 		{
-			NewRegion.Spans.Remove(Span);
 			Span->RegionID = INDEX_NONE;
 			continue;
 		}
@@ -201,11 +422,10 @@ bool FNNRegionGenerator::FloodNewRegion(FNNOpenSpan* RootSpan, int32 FillToDista
 		{
 			FNNOpenSpan* Neighbour = Span->Neighbours[Dir];
 
-			if (Neighbour && Neighbour->EdgeDistance >= FillToDistance && Neighbour->RegionID == INDEX_NONE)
+			if (Neighbour && Neighbour->EdgeDistance >= FillToDistance && Neighbour->RegionID == INDEX_NONE && Neighbour->AreaID == NewRegion.AreaID)
 			{
 				Neighbour->RegionID = NewRegion.ID;
 				Neighbour->DistanceToCore = 0;
-				NewRegion.Spans.Add(Neighbour);
 				WorkingStack.Add(Neighbour);
 			}
 		}
@@ -214,7 +434,7 @@ bool FNNRegionGenerator::FloodNewRegion(FNNOpenSpan* RootSpan, int32 FillToDista
 	return RegionSize > 0;
 }
 
-void FNNRegionGenerator::ExpandRegions(TMap<int32, FNNRegion>& RegionsByID, TArray<FNNOpenSpan*>& Spans, int32 MaxIterations) const
+void FNNRegionGenerator::ExpandRegions(TArray<FNNOpenSpan*>& Spans, int32 MaxIterations) const
 {
 	if (Spans.Num() == 0)
 	{
@@ -240,7 +460,8 @@ void FNNRegionGenerator::ExpandRegions(TMap<int32, FNNRegion>& RegionsByID, TArr
 			for (int32 Dir = 0; Dir < 4; ++Dir)
 			{
 				FNNOpenSpan* Neighbour = Span->Neighbours[Dir];
-				if (!Neighbour)
+				// Spans can only be expanded into regions of the same area
+				if (!Neighbour || Neighbour->AreaID != Span->AreaID)
 				{
 					continue;
 				}
@@ -276,7 +497,6 @@ void FNNRegionGenerator::ExpandRegions(TMap<int32, FNNRegion>& RegionsByID, TArr
 			}
 			if (SpanRegion != INDEX_NONE)
 			{
-				RegionsByID[SpanRegion].Spans.Add(Span);
 				Span->RegionID = SpanRegion;
 				Span->DistanceToCore = RegionCenterDistance;
 				Spans[i] = nullptr;
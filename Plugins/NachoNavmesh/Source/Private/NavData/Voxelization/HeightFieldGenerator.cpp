@@ -1,9 +1,9 @@
 ﻿#include "NavData/Voxelization/HeightFieldGenerator.h"
 
 // UE Includes
+#include "Async/ParallelFor.h"
 #include "Collision.h"
 #include "Chaos/AABB.h"
-#include "Kismet/KismetMathLibrary.h"
 
 // NN Includes
 #include "NavData/NNAreaGenerator.h"
@@ -11,6 +11,58 @@
 
 #define NN_LOG_SPAN_ATTACHMENT 0
 
+namespace NNHeightFieldCompression
+{
+	/** Walkable flag stored with the area ID of the span */
+	constexpr uint8 WalkableBit = 1 << 7;
+
+	/** Writes the Value using 7 bits per byte. The last bit of each byte marks whether more bytes follow */
+	void WriteVarInt(TArray<uint8>& Data, uint32 Value)
+	{
+		while (Value >= 0x80)
+		{
+			Data.Add(static_cast<uint8>(Value | 0x80));
+			Value >>= 7;
+		}
+		Data.Add(static_cast<uint8>(Value));
+	}
+
+	uint32 ReadVarInt(const TArray<uint8>& Data, int32& Offset)
+	{
+		uint32 Value = 0;
+		for (int32 Shift = 0; ; Shift += 7)
+		{
+			const uint8 Byte = Data[Offset++];
+			Value |= static_cast<uint32>(Byte & 0x7f) << Shift;
+			if ((Byte & 0x80) == 0)
+			{
+				return Value;
+			}
+		}
+	}
+
+	/** Encodes the spans of a column. The floor of each span is stored relative to the ceil of the previous one */
+	void EncodeColumn(const Span* ColumnSpan, TArray<uint8>& OutColumnData)
+	{
+		OutColumnData.Reset();
+		int32 SpansNum = 0;
+		for (const Span* CurrentSpan = ColumnSpan; CurrentSpan; CurrentSpan = CurrentSpan->NextSpan.Get())
+		{
+			++SpansNum;
+		}
+		WriteVarInt(OutColumnData, SpansNum);
+
+		int32 PreviousMaxHeight = 0;
+		for (const Span* CurrentSpan = ColumnSpan; CurrentSpan; CurrentSpan = CurrentSpan->NextSpan.Get())
+		{
+			WriteVarInt(OutColumnData, CurrentSpan->MinSpanHeight - PreviousMaxHeight);
+			WriteVarInt(OutColumnData, CurrentSpan->MaxSpanHeight - CurrentSpan->MinSpanHeight);
+			OutColumnData.Add(CurrentSpan->AreaID | (CurrentSpan->bWalkable ? WalkableBit : 0));
+			PreviousMaxHeight = CurrentSpan->MaxSpanHeight;
+		}
+	}
+}
+
 FString Span::ToString() const
 {
 	return FString::Printf(TEXT("(%d, %d, %s)%s"),
@@ -31,12 +83,88 @@ FNNHeightField::FNNHeightField(int32 InUnitsWidth, int32 InUnitsHeight, int32 In
 	}
 }
 
-void FHeightFieldGenerator::InitializeHeightField(FNNHeightField& OutHeightField, TArray<FNNRawGeometryElement>& RawGeometry, const FVector& BoundMinPoint, const FVector& BoundMaxPoint, float CellSize, float CellHeight, float WalkableAngle, float AgentHeight, float MinLedgeHeight) const
+void FNNCompressedHeightField::Compress(const FNNHeightField& HeightField)
 {
-	// https://en.wikipedia.org/wiki/Sutherland%E2%80%93Hodgman_algorithm
-	// Clip polygons in heightfields
+	using namespace NNHeightFieldCompression;
+
+	UnitsWidth = HeightField.UnitsWidth;
+	UnitsHeight = HeightField.UnitsHeight;
+	UnitsDepth = HeightField.UnitsDepth;
+	MinPoint = HeightField.MinPoint;
+	MaxPoint = HeightField.MaxPoint;
+	CellSize = HeightField.CellSize;
+	CellHeight = HeightField.CellHeight;
+	Data.Reset();
+
+	// Near columns usually have the same spans so they are written as a run
+	TArray<uint8> RunData;
+	TArray<uint8> ColumnData;
+	int32 RunLength = 0;
+	for (const TUniquePtr<Span>& Column : HeightField.Spans)
+	{
+		EncodeColumn(Column.Get(), ColumnData);
+		if (RunLength > 0 && ColumnData == RunData)
+		{
+			++RunLength;
+			continue;
+		}
+
+		if (RunLength > 0)
+		{
+			WriteVarInt(Data, RunLength);
+			Data.Append(RunData);
+		}
+		Swap(RunData, ColumnData);
+		RunLength = 1;
+	}
+
+	if (RunLength > 0)
+	{
+		WriteVarInt(Data, RunLength);
+		Data.Append(RunData);
+	}
+	Data.Shrink();
+}
+
+void FNNCompressedHeightField::Decompress(FNNHeightField& OutHeightField) const
+{
+	using namespace NNHeightFieldCompression;
+
+	OutHeightField = FNNHeightField(UnitsWidth, UnitsHeight, UnitsDepth);
+	OutHeightField.MinPoint = MinPoint;
+	OutHeightField.MaxPoint = MaxPoint;
+	OutHeightField.CellSize = CellSize;
+	OutHeightField.CellHeight = CellHeight;
+
+	int32 Offset = 0;
+	int32 ColumnIndex = 0;
+	while (Offset < Data.Num())
+	{
+		const int32 RunLength = ReadVarInt(Data, Offset);
+		const int32 SpansNum = ReadVarInt(Data, Offset);
+		const int32 RunStart = Offset;
+		for (int32 Run = 0; Run < RunLength; ++Run)
+		{
+			// Every column of the run reads the same spans
+			Offset = RunStart;
+			TUniquePtr<Span>* Link = &OutHeightField.Spans[ColumnIndex++];
+			int32 PreviousMaxHeight = 0;
+			for (int32 i = 0; i < SpansNum; ++i)
+			{
+				const int32 MinSpanHeight = PreviousMaxHeight + ReadVarInt(Data, Offset);
+				const int32 MaxSpanHeight = MinSpanHeight + ReadVarInt(Data, Offset);
+				const uint8 Flags = Data[Offset++];
+				*Link = MakeUnique<Span>(MaxSpanHeight, MinSpanHeight, (Flags & WalkableBit) != 0);
+				(*Link)->AreaID = Flags & ~WalkableBit;
+				Link = &(*Link)->NextSpan;
+				PreviousMaxHeight = MaxSpanHeight;
+			}
+		}
+	}
+}
 
-	const FBox Bounds (BoundMinPoint, BoundMaxPoint);
+void FHeightFieldGenerator::InitializeHeightField(FNNHeightField& OutHeightField, const FVector& BoundMinPoint, const FVector& BoundMaxPoint, float CellSize, float CellHeight) const
+{
 	const int32 XHeightFieldNum = FMath::CeilToInt((BoundMaxPoint.X - BoundMinPoint.X) / CellSize);
 	const int32 YHeightFieldNum = FMath::CeilToInt((BoundMaxPoint.Y - BoundMinPoint.Y) / CellSize);
 	const int32 ZHeightFieldNum = FMath::CeilToInt((BoundMaxPoint.Z - BoundMinPoint.Z) / CellHeight);
@@ -46,217 +174,331 @@ void FHeightFieldGenerator::InitializeHeightField(FNNHeightField& OutHeightField
 	OutHeightField.CellSize = CellSize;
 	OutHeightField.MaxPoint = BoundMaxPoint;
 	OutHeightField.MinPoint = BoundMinPoint;
+}
 
-	const float WalkableRadians = FMath::DegreesToRadians(WalkableAngle);
+void FHeightFieldGenerator::RasterizeGeometry(FNNHeightField& HeightField, const FNNRawGeometry& RawGeometry, const FNNRawGeometryRange& Range, float WalkableAngle) const
+{
+	// https://en.wikipedia.org/wiki/Sutherland%E2%80%93Hodgman_algorithm
+	// Clip polygons in heightfields
 
-	for (FNNRawGeometryElement& GeometryElement : RawGeometry)
-	{
-		const int32 PolygonsNum = GeometryElement.GeomIndices.Num() / 3;
-		for (int32 PolygonIndex = 0; PolygonIndex < PolygonsNum; ++PolygonIndex)
-		{
-			const FVector FirstPoint = GeometryElement.GetGeometryPosition(GeometryElement.GeomIndices[PolygonIndex * 3]);
-			const FVector SecondPoint = GeometryElement.GetGeometryPosition(GeometryElement.GeomIndices[PolygonIndex * 3 + 1]);
-			const FVector ThirdPoint = GeometryElement.GetGeometryPosition(GeometryElement.GeomIndices[PolygonIndex * 3 + 2]);
-			TArray<FVector> Polygon = {FirstPoint, SecondPoint, ThirdPoint};
-			FVector PolygonNormal = FNNNavMeshHelper::CalculatePolygonNormal(Polygon);
-
-			FVector PolygonCenter = UKismetMathLibrary::GetVectorArrayAverage(Polygon);
-			// AreaGeneratorData.AddDebugLine(PolygonCenter, PolygonCenter + PolygonNormal * 50.0f);
-
-			const bool bPolygonWalkable  = IsPolygonWalkable(PolygonNormal, WalkableRadians);
-
-			// Create a 2D bound box of the current polygon in the X and Y axis
-			FVector MinimumPoint;
-			FVector MaximumPoint;
-			Generate2DBoundingBoxForGeometry(Polygon, MinimumPoint, MaximumPoint, Bounds);
-
-			// Iterate through the necessary cells to check if the polygon intersects with them
-			const int32 StartingYSpan = FMath::FloorToInt((MinimumPoint.Y - BoundMinPoint.Y) / CellSize);
-			const int32 EndingYSpan = FMath::CeilToInt((MaximumPoint.Y - BoundMinPoint.Y) / CellSize);
-			const int32 StartingXSpan = FMath::FloorToInt((MinimumPoint.X - BoundMinPoint.X ) / CellSize);
-			const int32 EndingXSpan = FMath::CeilToInt((MaximumPoint.X - BoundMinPoint.X) / CellSize);
-			for (int32 j = StartingYSpan; j < EndingYSpan; ++j)
-			{
-				for (int32 i = StartingXSpan; i < EndingXSpan; ++i)
-				{
-					for (int32 k = 0; k < ZHeightFieldNum; ++k)
-					{
+	// A triangle is walkable when the Z of its normal is above the cosine of the walkable angle
+	const float WalkableCosine = FMath::Cos(FMath::DegreesToRadians(WalkableAngle));
+	FMemMark Mark(FMemStack::Get());
+	TArray<bool, TMemStackAllocator<>> WalkableTriangles;
+	ClassifyWalkableTriangles(RawGeometry, Range, WalkableCosine, WalkableTriangles);
 
-						FVector MinCellPoint = BoundMinPoint;
-						MinCellPoint += FVector(i * CellSize, j * CellSize, k * CellHeight);
-						FVector MaxCellPoint = MinCellPoint + FVector(CellSize, CellSize, CellHeight);
-						FBox Cell (MinCellPoint, MaxCellPoint);
-						const FSeparatingAxisPointCheck PointCheck (Polygon, Cell.GetCenter(), Cell.GetExtent());
+	// Reused by every triangle
+	TArray<FVector> Polygon;
+	Polygon.SetNumUninitialized(3);
 
-						// If the polygon intersects with the cell, create a new span
-						if (PointCheck.bHit)
-						{
-							Span NewSpan;
-							NewSpan.bWalkable = bPolygonWalkable;
-							NewSpan.MaxSpanHeight = k + 1;
-							NewSpan.MinSpanHeight = k;
+	for (int32 i = 0; i < Range.TrianglesNum; ++i)
+	{
+		const int32 PolygonIndex = Range.FirstTriangle + i;
+		Polygon[0] = RawGeometry.GetVertex(RawGeometry.Indices[PolygonIndex * 3]);
+		Polygon[1] = RawGeometry.GetVertex(RawGeometry.Indices[PolygonIndex * 3 + 1]);
+		Polygon[2] = RawGeometry.GetVertex(RawGeometry.Indices[PolygonIndex * 3 + 2]);
 
-							// Add the new span in the HeightField
-							Span* CurrentSpan = OutHeightField.Spans[i + j * XHeightFieldNum].Get();
-#if WITH_EDITOR && NN_LOG_SPAN_ATTACHMENT
-							UE_LOG(LogTemp, Warning, TEXT("----------"));
-							if (CurrentSpan)
-							{
-								UE_LOG(LogTemp, Warning, TEXT("Attaching %s with %s"), *CurrentSpan->ToString(), *NewSpan.ToString());
-							}
-#endif
-							if (CurrentSpan)
-							{
-								AttachNewSpan(CurrentSpan, &NewSpan);
-							}
-							else
-							{
-								OutHeightField.Spans[i + j * XHeightFieldNum] = MakeUnique<Span>(MoveTemp(NewSpan));
-							}
-							// AreaGeneratorData.AddDebugText(Cell.GetCenter(), FString::FromInt(i + j * XHeightFieldNum));
-							// AreaGeneratorData.AddDebugText(Cell.GetCenter(), FString::Printf(TEXT("(%d, %d)"), i , j));
-#if WITH_EDITOR && NN_LOG_SPAN_ATTACHMENT
-							UE_LOG(LogTemp, Warning, TEXT("Result: %s"), *Field->Spans[i + j * XHeightFieldNum]->ToString())
-#endif
-						}
-					}
-				}
-			}
-		}
+		RasterizeTriangle(HeightField, Polygon, WalkableTriangles[i]);
 	}
 
-	for (int32 i = 0; i < OutHeightField.Spans.Num(); ++i)
+	// The instanced meshes are transformed in batches, one instance at a time, instead of storing every instance triangle
+	TArray<FVector, TMemStackAllocator<>> InstanceVertexes;
+	for (int32 InstancedIndex = Range.FirstInstanced; InstancedIndex < Range.FirstInstanced + Range.InstancedNum; ++InstancedIndex)
 	{
-		Span* CurrentSpan = OutHeightField.Spans[i].Get();
-		while (CurrentSpan)
+		const FNNInstancedGeometry& InstancedGeometry = RawGeometry.InstancedGeometry[InstancedIndex];
+		const int32 VertexesNum = InstancedGeometry.GetVertexesNum();
+		const int32 TrianglesNum = InstancedGeometry.GetTrianglesNum();
+		InstanceVertexes.SetNumUninitialized(VertexesNum, false);
+		for (const FTransform& Transform : InstancedGeometry.Transforms)
 		{
-			const int32 Y = (i / OutHeightField.UnitsWidth);
-			const int32 X = (i % OutHeightField.UnitsWidth);
-			CurrentSpan->bWalkable = IsSpanWalkable(OutHeightField, X, Y, CurrentSpan, AgentHeight, MinLedgeHeight);
-			CurrentSpan = CurrentSpan->NextSpan.Get();
+			// A mirrored instance flips the winding of its triangles and the walkable test depends on it
+			const bool bMirrored = Transform.GetDeterminant() < 0.0f;
+			const int32 SecondVertex = bMirrored ? 2 : 1;
+			const int32 ThirdVertex = bMirrored ? 1 : 2;
+			for (int32 i = 0; i < VertexesNum; ++i)
+			{
+				InstanceVertexes[i] = Transform.TransformPosition(InstancedGeometry.GetLocalVertex(i));
+			}
+
+			for (int32 i = 0; i < TrianglesNum; ++i)
+			{
+				Polygon[0] = InstanceVertexes[InstancedGeometry.Indices[i * 3]];
+				Polygon[1] = InstanceVertexes[InstancedGeometry.Indices[i * 3 + SecondVertex]];
+				Polygon[2] = InstanceVertexes[InstancedGeometry.Indices[i * 3 + ThirdVertex]];
+				RasterizeTriangle(HeightField, Polygon, IsTriangleWalkable(Polygon[0], Polygon[1], Polygon[2], WalkableCosine));
+			}
 		}
 	}
 }
 
-bool FHeightFieldGenerator::IsPolygonWalkable(const FVector& PolygonNormal, float MaxWalkableRadians) const
-{
-	const float Rotation = FMath::Acos(FVector::DotProduct(PolygonNormal, FVector::UpVector));
-	return Rotation < MaxWalkableRadians;
-}
-
-bool FHeightFieldGenerator::IsSpanWalkable(const FNNHeightField& HeightField, int32 XIndex, int32 YIndex, const Span* InSpan, float  AgentHeight, float MinLedgeHeight) const
+void FHeightFieldGenerator::CacheSpans(const FNNHeightField& HeightField, const FIntPoint& ColumnOffset, int32 TileUnitsWidth,
+	FNNVoxelCache& OutVoxelCache)
 {
-	if (!InSpan->bWalkable)
+	OutVoxelCache.Spans.Reset();
+	for (int32 ColumnIndex = 0; ColumnIndex < HeightField.Spans.Num(); ++ColumnIndex)
 	{
-		return false;
-	}
-
-	// Check if there is enough space in top of span so the agent can step on it
-	if (InSpan->NextSpan)
-	{
-		const int32 MaxSpanHeight = InSpan->MaxSpanHeight;
-		const int32 MinNextSpanHeight = InSpan->NextSpan->MinSpanHeight;
-		const float SpaceBetweenSpans = (MinNextSpanHeight - MaxSpanHeight) * HeightField.CellHeight;
-		if (SpaceBetweenSpans < AgentHeight)
+		const int32 TileColumnIndex = ColumnIndex % HeightField.UnitsWidth + ColumnOffset.X
+			+ (ColumnIndex / HeightField.UnitsWidth + ColumnOffset.Y) * TileUnitsWidth;
+		for (const Span* CurrentSpan = HeightField.Spans[ColumnIndex].Get(); CurrentSpan; CurrentSpan = CurrentSpan->NextSpan.Get())
 		{
-			return false;
+			OutVoxelCache.Spans.Emplace(TileColumnIndex, *CurrentSpan);
 		}
 	}
+}
 
-	// Check if the span is a ledge by checking the height of its neighbours
-	const TArray<TUniquePtr<Span>>& Spans = HeightField.Spans;
-	TArray<Span*> Neighbours = GetSpanNeighbours(HeightField, XIndex, YIndex, InSpan);
-
-	// UE_LOG(LogTemp, Warning, TEXT("\n---------"));
-	// UE_LOG(LogTemp, Warning, TEXT("%d neighbours are: "), XIndex + YIndex * HeightField->UnitsWidth);
-
-	for (const Span* Neighbour : Neighbours)
+void FHeightFieldGenerator::MergeVoxelCache(FNNHeightField& HeightField, const FNNVoxelCache& VoxelCache) const
+{
+	for (const FNNVoxelCache::FCachedSpan& CachedSpan : VoxelCache.Spans)
 	{
-		// If its invalid it means the span is in the border of the HeightField
-		// Should we consider it as ledge?
-		float HeightDifference = 0.0f;
-		if (Neighbour)
+		Span NewSpan (CachedSpan.MaxSpanHeight, CachedSpan.MinSpanHeight, CachedSpan.bWalkable);
+		Span* CurrentSpan = HeightField.Spans[CachedSpan.ColumnIndex].Get();
+		if (CurrentSpan)
 		{
-			HeightDifference = FMath::Abs(Neighbour->MaxSpanHeight - InSpan->MaxSpanHeight) * HeightField.CellHeight;
+			AttachNewSpan(CurrentSpan, &NewSpan);
 		}
 		else
 		{
-			HeightDifference = InSpan->MaxSpanHeight * HeightField.CellHeight;
-		}
-		if (HeightDifference > MinLedgeHeight)
-		{
-			// UE_LOG(LogTemp, Warning, TEXT("%d - FALSE"), NeighbourIndex);
-			return false;
+			HeightField.Spans[CachedSpan.ColumnIndex] = MakeUnique<Span>(MoveTemp(NewSpan));
 		}
-		// UE_LOG(LogTemp, Warning, TEXT("%d - TRUE"), NeighbourIndex);
 	}
-
-	return true;
 }
 
-
-TArray<Span*> FHeightFieldGenerator::GetSpanNeighbours(const FNNHeightField& HeightField, int32 XIndex, int32 YIndex, const Span* CurrentSpan) const
+void FHeightFieldGenerator::RasterizeTriangle(FNNHeightField& HeightField, TArray<FVector>& Polygon, bool bWalkable) const
 {
-	TArray<int32> NeighboursIndexes;
-	NeighboursIndexes.Init(INDEX_NONE, 4);
-	if (XIndex < HeightField.UnitsDepth - 1)
+	const FVector& BoundMinPoint = HeightField.MinPoint;
+	const FBox Bounds (HeightField.MinPoint, HeightField.MaxPoint);
+	const float CellSize = HeightField.CellSize;
+	const float CellHeight = HeightField.CellHeight;
+	const int32 XHeightFieldNum = HeightField.UnitsWidth;
+	const int32 ZHeightFieldNum = HeightField.UnitsHeight;
+
+	// Create a 2D bound box of the current polygon in the X and Y axis
+	FVector MinimumPoint;
+	FVector MaximumPoint;
+	Generate2DBoundingBoxForGeometry(Polygon, MinimumPoint, MaximumPoint, Bounds);
+
+	// Iterate through the necessary cells to check if the polygon intersects with them
+	const int32 StartingYSpan = FMath::FloorToInt((MinimumPoint.Y - BoundMinPoint.Y) / CellSize);
+	const int32 EndingYSpan = FMath::CeilToInt((MaximumPoint.Y - BoundMinPoint.Y) / CellSize);
+	const int32 StartingXSpan = FMath::FloorToInt((MinimumPoint.X - BoundMinPoint.X ) / CellSize);
+	const int32 EndingXSpan = FMath::CeilToInt((MaximumPoint.X - BoundMinPoint.X) / CellSize);
+	for (int32 j = StartingYSpan; j < EndingYSpan; ++j)
 	{
-		NeighboursIndexes[0] = XIndex + 1 + YIndex * HeightField.UnitsWidth;
+		for (int32 i = StartingXSpan; i < EndingXSpan; ++i)
+		{
+			for (int32 k = 0; k < ZHeightFieldNum; ++k)
+			{
+
+				FVector MinCellPoint = BoundMinPoint;
+				MinCellPoint += FVector(i * CellSize, j * CellSize, k * CellHeight);
+				FVector MaxCellPoint = MinCellPoint + FVector(CellSize, CellSize, CellHeight);
+				FBox Cell (MinCellPoint, MaxCellPoint);
+				const FSeparatingAxisPointCheck PointCheck (Polygon, Cell.GetCenter(), Cell.GetExtent());
+
+				// If the polygon intersects with the cell, create a new span
+				if (PointCheck.bHit)
+				{
+					Span NewSpan;
+					NewSpan.bWalkable = bWalkable;
+					NewSpan.MaxSpanHeight = k + 1;
+					NewSpan.MinSpanHeight = k;
+
+					// Add the new span in the HeightField
+					Span* CurrentSpan = HeightField.Spans[i + j * XHeightFieldNum].Get();
+#if WITH_EDITOR && NN_LOG_SPAN_ATTACHMENT
+					UE_LOG(LogTemp, Warning, TEXT("----------"));
+					if (CurrentSpan)
+					{
+						UE_LOG(LogTemp, Warning, TEXT("Attaching %s with %s"), *CurrentSpan->ToString(), *NewSpan.ToString());
+					}
+#endif
+					if (CurrentSpan)
+					{
+						AttachNewSpan(CurrentSpan, &NewSpan);
+					}
+					else
+					{
+						HeightField.Spans[i + j * XHeightFieldNum] = MakeUnique<Span>(MoveTemp(NewSpan));
+					}
+					// AreaGeneratorData.AddDebugText(Cell.GetCenter(), FString::FromInt(i + j * XHeightFieldNum));
+					// AreaGeneratorData.AddDebugText(Cell.GetCenter(), FString::Printf(TEXT("(%d, %d)"), i , j));
+#if WITH_EDITOR && NN_LOG_SPAN_ATTACHMENT
+					UE_LOG(LogTemp, Warning, TEXT("Result: %s"), *Field->Spans[i + j * XHeightFieldNum]->ToString())
+#endif
+				}
+			}
+		}
 	}
-	if (XIndex >= 1)
+}
+
+void FHeightFieldGenerator::MarkAreaModifiers(FNNHeightField& HeightField, const TArray<FNNAreaModifier>& AreaModifiers) const
+{
+	const float CellSize = HeightField.CellSize;
+	for (const FNNAreaModifier& AreaModifier : AreaModifiers)
 	{
-		NeighboursIndexes[1] = XIndex - 1 + YIndex * HeightField.UnitsWidth;
+		// Only iterate the cells covered by the modifier bounds
+		const FVector MinOffset = AreaModifier.Bounds.Min - HeightField.MinPoint;
+		const FVector MaxOffset = AreaModifier.Bounds.Max - HeightField.MinPoint;
+		const int32 StartX = FMath::Max(FMath::FloorToInt(MinOffset.X / CellSize), 0);
+		const int32 StartY = FMath::Max(FMath::FloorToInt(MinOffset.Y / CellSize), 0);
+		const int32 EndX = FMath::Min(FMath::CeilToInt(MaxOffset.X / CellSize), HeightField.UnitsWidth);
+		const int32 EndY = FMath::Min(FMath::CeilToInt(MaxOffset.Y / CellSize), HeightField.UnitsDepth);
+
+		for (int32 Y = StartY; Y < EndY; ++Y)
+		{
+			for (int32 X = StartX; X < EndX; ++X)
+			{
+				Span* CurrentSpan = HeightField.Spans[X + Y * HeightField.UnitsWidth].Get();
+				while (CurrentSpan)
+				{
+					if (CurrentSpan->bWalkable)
+					{
+						// The area is tested against the center of the span's floor
+						const FVector SpanTop = HeightField.MinPoint + FVector((X + 0.5f) * CellSize, (Y + 0.5f) * CellSize,
+							CurrentSpan->MaxSpanHeight * HeightField.CellHeight);
+						if (AreaModifier.IsInside(SpanTop))
+						{
+							CurrentSpan->AreaID = AreaModifier.AreaID;
+							CurrentSpan->bWalkable = AreaModifier.AreaID != NNNavAreas::NullAreaID;
+						}
+					}
+					CurrentSpan = CurrentSpan->NextSpan.Get();
+				}
+			}
+		}
 	}
-	if (YIndex < HeightField.UnitsDepth - 1)
+}
+
+void FHeightFieldGenerator::ClassifyWalkableTriangles(const FNNRawGeometry& RawGeometry, const FNNRawGeometryRange& Range, float WalkableCosine, TArray<bool, TMemStackAllocator<>>& OutWalkableTriangles) const
+{
+	OutWalkableTriangles.SetNumUninitialized(Range.TrianglesNum, false);
+	for (int32 i = 0; i < Range.TrianglesNum; ++i)
 	{
-		NeighboursIndexes[2] = XIndex + (YIndex + 1) * HeightField.UnitsWidth;
+		// The origin is the same for every vertex so the tile local positions are enough
+		const int32 TriangleIndex = Range.FirstTriangle + i;
+		const int32 First = RawGeometry.Indices[TriangleIndex * 3];
+		const int32 Second = RawGeometry.Indices[TriangleIndex * 3 + 1];
+		const int32 Third = RawGeometry.Indices[TriangleIndex * 3 + 2];
+		const FVector FirstPoint (RawGeometry.VertexesX[First], RawGeometry.VertexesY[First], RawGeometry.VertexesZ[First]);
+		const FVector SecondPoint (RawGeometry.VertexesX[Second], RawGeometry.VertexesY[Second], RawGeometry.VertexesZ[Second]);
+		const FVector ThirdPoint (RawGeometry.VertexesX[Third], RawGeometry.VertexesY[Third], RawGeometry.VertexesZ[Third]);
+
+		OutWalkableTriangles[i] = IsTriangleWalkable(FirstPoint, SecondPoint, ThirdPoint, WalkableCosine);
 	}
-	if (YIndex >= 1)
+}
+
+void FHeightFieldGenerator::FilterWalkableSpans(const FNNHeightField& HeightField, float AgentHeight, float MinLedgeHeight,
+	TArray<bool>& OutWalkableSpans, TArray<int32>& OutColumnStarts)
+{
+	// Gives an index to the spans of each column
+	const int32 ColumnsNum = HeightField.Spans.Num();
+	OutColumnStarts.SetNumUninitialized(ColumnsNum + 1);
+	int32 SpansNum = 0;
+	for (int32 i = 0; i < ColumnsNum; ++i)
 	{
-		NeighboursIndexes[3] = XIndex + (YIndex - 1) * HeightField.UnitsWidth;
+		OutColumnStarts[i] = SpansNum;
+		for (const Span* CurrentSpan = HeightField.Spans[i].Get(); CurrentSpan; CurrentSpan = CurrentSpan->NextSpan.Get())
+		{
+			++SpansNum;
+		}
 	}
-	TArray<Span*> Neighbours;
-	Neighbours.Init(nullptr, 4);
-	for (int32 i = 0; i < 4; ++i)
-	{
-		int32 NeighbourIndex = NeighboursIndexes[i];
+	OutColumnStarts[ColumnsNum] = SpansNum;
+	OutWalkableSpans.SetNumUninitialized(SpansNum, false);
 
-		// If its invalid it means the span is in the border of the HeightField
-		// Should we consider it as ledge?
-		if (NeighbourIndex >= 0 && NeighbourIndex < HeightField.Spans.Num())
+	FilterLowHeightSpans(HeightField, AgentHeight, OutColumnStarts, OutWalkableSpans);
+	FilterLedgeSpans(HeightField, MinLedgeHeight, OutColumnStarts, OutWalkableSpans);
+}
+
+void FHeightFieldGenerator::FilterLowHeightSpans(const FNNHeightField& HeightField, float AgentHeight,
+	const TArray<int32>& ColumnStarts, TArray<bool>& WalkableSpans)
+{
+	// Each row only writes the flags of its own spans
+	ParallelFor(HeightField.UnitsDepth, [&HeightField, AgentHeight, &ColumnStarts, &WalkableSpans](int32 Y)
+	{
+		for (int32 X = 0; X < HeightField.UnitsWidth; ++X)
 		{
-			Span* BestNeighbourSpan = HeightField.Spans[NeighbourIndex].Get();
-			if (!BestNeighbourSpan)
+			const int32 Column = X + Y * HeightField.UnitsWidth;
+			int32 SpanIndex = ColumnStarts[Column];
+			for (const Span* CurrentSpan = HeightField.Spans[Column].Get(); CurrentSpan; CurrentSpan = CurrentSpan->NextSpan.Get())
 			{
-				continue;
+				// Check if there is enough space in top of span so the agent can step on it
+				bool bWalkable = CurrentSpan->bWalkable;
+				if (bWalkable && CurrentSpan->NextSpan)
+				{
+					const float SpaceBetweenSpans = (CurrentSpan->NextSpan->MinSpanHeight - CurrentSpan->MaxSpanHeight) * HeightField.CellHeight;
+					bWalkable = SpaceBetweenSpans >= AgentHeight;
+				}
+				WalkableSpans[SpanIndex++] = bWalkable;
 			}
+		}
+	});
+}
+
+void FHeightFieldGenerator::FilterLedgeSpans(const FNNHeightField& HeightField, float MinLedgeHeight,
+	const TArray<int32>& ColumnStarts, TArray<bool>& WalkableSpans)
+{
+	static const FIntPoint NeighbourOffsets[4] = {FIntPoint(1, 0), FIntPoint(-1, 0), FIntPoint(0, 1), FIntPoint(0, -1)};
 
-			int32 MinorDifference = FMath::Abs(BestNeighbourSpan->MaxSpanHeight - CurrentSpan->MaxSpanHeight);
-			Span* NextSpan = BestNeighbourSpan->NextSpan.Get();
-			// Search of the nearest span of the CurrentSpan
-			while (NextSpan)
+	// Each row only writes the flags of its own spans
+	ParallelFor(HeightField.UnitsDepth, [&HeightField, MinLedgeHeight, &ColumnStarts, &WalkableSpans](int32 Y)
+	{
+		for (int32 X = 0; X < HeightField.UnitsWidth; ++X)
+		{
+			const int32 Column = X + Y * HeightField.UnitsWidth;
+			int32 SpanIndex = ColumnStarts[Column];
+			for (const Span* CurrentSpan = HeightField.Spans[Column].Get(); CurrentSpan; CurrentSpan = CurrentSpan->NextSpan.Get(), ++SpanIndex)
 			{
-				const int32 NextDifference = FMath::Abs(NextSpan->MaxSpanHeight - CurrentSpan->MaxSpanHeight);
-				if (NextDifference < MinorDifference)
+				if (!WalkableSpans[SpanIndex])
 				{
-					BestNeighbourSpan = NextSpan;
-					MinorDifference = NextDifference;
-					NextSpan = NextSpan->NextSpan.Get();
+					continue;
 				}
-				else
+
+				// Check if the span is a ledge by checking the height of its neighbours
+				for (const FIntPoint& Offset : NeighbourOffsets)
 				{
-					// There is no need to continue checking, the difference will keep growing
-					break;
+					const int32 NeighbourX = X + Offset.X;
+					const int32 NeighbourY = Y + Offset.Y;
+					const bool bInside = NeighbourX >= 0 && NeighbourX < HeightField.UnitsWidth && NeighbourY >= 0 && NeighbourY < HeightField.UnitsDepth;
+					const Span* Neighbour = bInside ? GetNearestSpanInColumn(HeightField, NeighbourX, NeighbourY, CurrentSpan->MaxSpanHeight) : nullptr;
+
+					// If its invalid it means the span is in the border of the HeightField
+					// Should we consider it as ledge?
+					const int32 NeighbourHeight = Neighbour ? Neighbour->MaxSpanHeight : 0;
+					const float HeightDifference = FMath::Abs(NeighbourHeight - CurrentSpan->MaxSpanHeight) * HeightField.CellHeight;
+					if (HeightDifference > MinLedgeHeight)
+					{
+						WalkableSpans[SpanIndex] = false;
+						break;
+					}
 				}
 			}
-			Neighbours[i] = BestNeighbourSpan;
 		}
+	});
+}
+
+const Span* FHeightFieldGenerator::GetNearestSpanInColumn(const FNNHeightField& HeightField, int32 XIndex, int32 YIndex, int32 Height)
+{
+	const Span* BestSpan = HeightField.Spans[XIndex + YIndex * HeightField.UnitsWidth].Get();
+	if (!BestSpan)
+	{
+		return nullptr;
 	}
 
-	return Neighbours;
+	int32 MinorDifference = FMath::Abs(BestSpan->MaxSpanHeight - Height);
+	for (const Span* NextSpan = BestSpan->NextSpan.Get(); NextSpan; NextSpan = NextSpan->NextSpan.Get())
+	{
+		const int32 NextDifference = FMath::Abs(NextSpan->MaxSpanHeight - Height);
+		if (NextDifference >= MinorDifference)
+		{
+			// There is no need to continue checking, the difference will keep growing
+			break;
+		}
+		BestSpan = NextSpan;
+		MinorDifference = NextDifference;
+	}
+	return BestSpan;
 }
 
-
 bool FHeightFieldGenerator::Generate2DBoundingBoxForGeometry(TArray<FVector>& Polygon, FVector& OutMinimumPoint, FVector& OutMaximumPoint, const FBox& BoundBox)
 {
 	if (Polygon.Num() == 0)
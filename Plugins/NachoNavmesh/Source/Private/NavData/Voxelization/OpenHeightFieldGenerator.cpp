@@ -1,6 +1,7 @@
 ﻿#include "NavData/Voxelization/OpenHeightFieldGenerator.h"
 
 // NN Includes
+#include "NavData/NNAreaGenerator.h"
 #include "NavData/Voxelization/HeightFieldGenerator.h"
 
 #define DEBUG_OPENHEIGHTFIELD 0
@@ -17,9 +18,11 @@ namespace NNDistanceField
 	constexpr int32 AxisNeighbourDistance = 2;
 	constexpr int32 DiagonalNeighbourDistance = 3;
 
-	int32 GetDistanceFromNeighbourFirstPass(const FNNOpenSpan& Neighbour, int32 CurrentDistance, bool bIsDiagonal)
+	/** Spans with a lower distance are not smoothed by the blur */
+	constexpr int32 BlurThreshold = 2;
+
+	int32 GetDistanceFromNeighbourFirstPass(int32 NeighbourDistance, int32 CurrentDistance, bool bIsDiagonal)
 	{
-		int32 NeighbourDistance = Neighbour.EdgeDistance;
 		if (!bIsDiagonal)
 		{
 			NeighbourDistance =  NeighbourDistance == NeedsInitSpan ? DefaultDistance : NeighbourDistance + AxisNeighbourDistance;
@@ -31,11 +34,33 @@ namespace NNDistanceField
 		return FMath::Min(CurrentDistance, NeighbourDistance);
 	}
 
-	int32 GetDistanceFromNeighbourSecondPass(const FNNOpenSpan& Neighbour, int32 CurrentDistance, bool bIsDiagonal)
+	int32 GetDistanceFromNeighbourSecondPass(int32 NeighbourDistance, int32 CurrentDistance, bool bIsDiagonal)
 	{
 		const int32 ExtraDistance = bIsDiagonal ? DiagonalNeighbourDistance : AxisNeighbourDistance;
-		const int32 NeighbourDistance = Neighbour.EdgeDistance + ExtraDistance;
-		return FMath::Min(CurrentDistance, NeighbourDistance);
+		return FMath::Min(CurrentDistance, NeighbourDistance + ExtraDistance);
+	}
+
+	/** Updates the SpanDistance with the axis neighbour in the Direction and its diagonal in the DiagonalDirection */
+	template<bool bFirstPass>
+	void CheckNeighbours(const TArray<int32>& Distances, const TArray<int32>& NeighbourIndexes, int32 SpanIndex,
+		int32 Direction, int32 DiagonalDirection, int32& SpanDistance)
+	{
+		const int32 Neighbour = NeighbourIndexes[SpanIndex * 4 + Direction];
+		if (Neighbour == INDEX_NONE)
+		{
+			return;
+		}
+		SpanDistance = bFirstPass
+			? GetDistanceFromNeighbourFirstPass(Distances[Neighbour], SpanDistance, false)
+			: GetDistanceFromNeighbourSecondPass(Distances[Neighbour], SpanDistance, false);
+
+		const int32 Diagonal = NeighbourIndexes[Neighbour * 4 + DiagonalDirection];
+		if (Diagonal != INDEX_NONE)
+		{
+			SpanDistance = bFirstPass
+				? GetDistanceFromNeighbourFirstPass(Distances[Diagonal], SpanDistance, true)
+				: GetDistanceFromNeighbourSecondPass(Distances[Diagonal], SpanDistance, true);
+		}
 	}
 }
 
@@ -75,9 +100,39 @@ FNNOpenHeightField::FNNOpenHeightField(int32 InUnitsWidth, int32 InUnitsDepth, i
 	}
 }
 
-int32 FNNOpenHeightField::GetRegionIndexByID(int32 ID) const
+FNNRegion& FNNOpenHeightField::AddRegion()
 {
-	return Regions.IndexOfByPredicate([ID](const FNNRegion& Region) { return Region.ID == ID; });
+	return Regions.Emplace_GetRef(Regions.Num());
+}
+
+void FNNOpenHeightField::UpdateRegionStats()
+{
+	for (FNNRegion& Region : Regions)
+	{
+		Region.SpansCount = 0;
+		Region.Bounds = FIntRect(TNumericLimits<int32>::Max(), TNumericLimits<int32>::Max(), TNumericLimits<int32>::Min(), TNumericLimits<int32>::Min());
+		Region.Neighbours.Reset();
+	}
+
+	for (FNNOpenHeightFieldIterator It (*this); It; ++It)
+	{
+		const FNNOpenSpan* Span = It.Get();
+		if (Span->RegionID == INDEX_NONE)
+		{
+			continue;
+		}
+		FNNRegion& Region = Regions[Span->RegionID];
+		++Region.SpansCount;
+		Region.Bounds.Include(FIntPoint(Span->X, Span->Y));
+		Region.Bounds.Include(FIntPoint(Span->X + 1, Span->Y + 1));
+		for (const FNNOpenSpan* Neighbour : Span->Neighbours)
+		{
+			if (Neighbour && Neighbour->RegionID != INDEX_NONE && Neighbour->RegionID != Span->RegionID)
+			{
+				Region.Neighbours.AddUnique(Neighbour->RegionID);
+			}
+		}
+	}
 }
 
 int32 FNNOpenHeightField::GetSpanMaxEdgeDistance() const
@@ -163,14 +218,6 @@ FNNOpenSpan* FNNOpenHeightFieldIterator::GetNextValidOpenSpan()
 	return nullptr;
 }
 
-FNNRegion FNNRegion::GenerateNewRegion()
-{
-	static int32 UniqueIdentifier = 0;
-	FNNRegion Region (UniqueIdentifier);
-	++UniqueIdentifier;
-	return Region;
-}
-
 void FOpenHeightFieldGenerator::GenerateOpenHeightField(FNNOpenHeightField& OutOpenHeightField, const FNNHeightField& SolidHeightField, float MaxLedgeHeight, float AgentHeight) const
 {
 	OutOpenHeightField = FNNOpenHeightField(SolidHeightField.UnitsWidth, SolidHeightField.UnitsDepth, SolidHeightField.UnitsHeight);
@@ -178,6 +225,11 @@ void FOpenHeightFieldGenerator::GenerateOpenHeightField(FNNOpenHeightField& OutO
 	OutOpenHeightField.CellSize = SolidHeightField.CellSize;
 	OutOpenHeightField.Bounds = FBox(SolidHeightField.MinPoint, SolidHeightField.MaxPoint);
 
+	// The solid heightfield is shared by every agent so the agent size is checked here
+	TArray<bool> WalkableSpans;
+	TArray<int32> ColumnStarts;
+	FHeightFieldGenerator::FilterWalkableSpans(SolidHeightField, AgentHeight, MaxLedgeHeight, WalkableSpans, ColumnStarts);
+
 	// Create the open spans
 	for (int32 i = 0; i < SolidHeightField.Spans.Num(); ++i)
 	{
@@ -185,23 +237,26 @@ void FOpenHeightFieldGenerator::GenerateOpenHeightField(FNNOpenHeightField& OutO
 		const int32 Y = (i / SolidHeightField.UnitsWidth);
 		const int32 Index = X + Y * SolidHeightField.UnitsWidth;
 		FNNOpenSpan* LastOpenSpan = nullptr;
+		int32 SolidSpanIndex = ColumnStarts[i];
 		Span* Span = SolidHeightField.Spans[i].Get();
 		while (Span)
 		{
-			if (Span->bWalkable)
+			if (WalkableSpans[SolidSpanIndex++])
 			{
 				const int32 MinHeight = Span->MaxSpanHeight;
 				const int32 MaxHeight = Span->NextSpan ? Span->NextSpan->MinSpanHeight : TNumericLimits<int32>::Max();
 				if (LastOpenSpan)
 				{
-					LastOpenSpan->NextOpenSpan = MakeUnique<FNNOpenSpan>(MinHeight, MaxHeight, X, Y);
+					LastOpenSpan->NextOpenSpan = MakeUnique<FNNOpenSpan>(MinHeight, MaxHeight, X, Y, Span->AreaID);
 					LastOpenSpan = LastOpenSpan->NextOpenSpan.Get();
 				}
 				else
 				{
-					OutOpenHeightField.Spans[Index] = MakeUnique<FNNOpenSpan>(MinHeight, MaxHeight, X, Y);
+					OutOpenHeightField.Spans[Index] = MakeUnique<FNNOpenSpan>(MinHeight, MaxHeight, X, Y, Span->AreaID);
 					LastOpenSpan = OutOpenHeightField.Spans[Index].Get();
 				}
+				// The spans are created in the same order the FNNOpenHeightFieldIterator visits them
+				LastOpenSpan->SpanIndex = OutOpenHeightField.AmountOfSpans;
 				++OutOpenHeightField.AmountOfSpans;
 			}
 			Span = Span->NextSpan.Get();
@@ -293,109 +348,200 @@ void FOpenHeightFieldGenerator::SetOpenSpanNeighbours(FNNOpenHeightField& OutOpe
 	}
 }
 
-void FOpenHeightFieldGenerator::GenerateDistanceField(FNNOpenHeightField& OpenHeightField) const
+void FOpenHeightFieldGenerator::ErodeWalkableArea(FNNOpenHeightField& OpenHeightField, int32 ErodeRadius) const
 {
-	if (OpenHeightField.Spans.Num() == 0)
+	if (ErodeRadius <= 0 || OpenHeightField.AmountOfSpans == 0)
 	{
 		return;
 	}
 
-	// Initialization
-	for (TUniquePtr<FNNOpenSpan>& OpenSpan : OpenHeightField.Spans)
+	// The smoothing is skipped to erode with the exact distances to the borders
+	GenerateDistanceField(OpenHeightField, false);
+
+	// Each cell adds AxisNeighbourDistance to the distance field
+	const int32 MinEdgeDistance = ErodeRadius * NNDistanceField::AxisNeighbourDistance;
+
+	RemoveSpans(OpenHeightField, [MinEdgeDistance](const FNNOpenSpan& Span)
+	{
+		return Span.EdgeDistance < MinEdgeDistance;
+	});
+
+	// The borders moved so the distances need to be calculated again
+	GenerateDistanceField(OpenHeightField);
+}
+
+void FOpenHeightFieldGenerator::CarveObstacles(FNNOpenHeightField& OpenHeightField, const TArray<FNNAreaModifier>& Obstacles) const
+{
+	if (Obstacles.Num() == 0 || OpenHeightField.AmountOfSpans == 0)
 	{
-		for (FNNOpenSpan* CurrentSpan = OpenSpan.Get(); CurrentSpan; CurrentSpan = CurrentSpan->NextOpenSpan.Get())
+		return;
+	}
+
+	const int32 PreviousSpansNum = OpenHeightField.AmountOfSpans;
+	RemoveSpans(OpenHeightField, [&OpenHeightField, &Obstacles](const FNNOpenSpan& Span)
+	{
+		const FVector SpanFloor = Span.GetOpenSpanWorldPosition(OpenHeightField);
+		return Obstacles.ContainsByPredicate([&SpanFloor](const FNNAreaModifier& Obstacle) { return Obstacle.IsInside(SpanFloor); });
+	});
+
+	// The obstacles created new borders
+	if (OpenHeightField.AmountOfSpans != PreviousSpansNum)
+	{
+		GenerateDistanceField(OpenHeightField);
+	}
+}
+
+void FOpenHeightFieldGenerator::RemoveSpans(FNNOpenHeightField& OpenHeightField, TFunctionRef<bool(const FNNOpenSpan&)> Predicate)
+{
+	// Marks the spans to remove first because the predicate may read the neighbours
+	TArray<bool> RemovedSpans;
+	RemovedSpans.SetNumUninitialized(OpenHeightField.AmountOfSpans);
+	for (FNNOpenHeightFieldIterator It (OpenHeightField); It; ++It)
+	{
+		RemovedSpans[It->SpanIndex] = Predicate(*It.Get());
+	}
+
+	// Unlinks the removed spans from the remaining ones. The links can be one way so every remaining span is checked
+	// instead of following the links of the removed spans
+	for (FNNOpenHeightFieldIterator It (OpenHeightField); It; ++It)
+	{
+		FNNOpenSpan* Span = It.Get();
+		if (RemovedSpans[Span->SpanIndex])
+		{
+			continue;
+		}
+		for (FNNOpenSpan*& Neighbour : Span->Neighbours)
 		{
-			bool bIsBorder = false;
-			for (int32 i = 0; i < 4; ++i)
+			if (Neighbour && RemovedSpans[Neighbour->SpanIndex])
 			{
-				const FNNOpenSpan* Neighbour = CurrentSpan->Neighbours[i];
-				// If the axis neighbour or the diagonal neighbour is null then this is a border span
-				if (!Neighbour || !Neighbour->Neighbours[(i + 1) % 4])
-				{
-					bIsBorder = true;
-					break;
-				}
+				Neighbour = nullptr;
 			}
-			CurrentSpan->EdgeDistance = bIsBorder ? NNDistanceField::BorderSpan : NNDistanceField::NeedsInitSpan;
 		}
 	}
 
-	// Pass 1 the following neighbours will be checked: (-1, 0), (-1, -1), (0, -1), (1, -1)
-	for (TUniquePtr<FNNOpenSpan>& OpenSpan : OpenHeightField.Spans)
+	// Removes the spans from their columns and gives the remaining ones their new index
+	int32 SpanIndex = 0;
+	for (TUniquePtr<FNNOpenSpan>& Column : OpenHeightField.Spans)
 	{
-		for (FNNOpenSpan* CurrentSpan = OpenSpan.Get(); CurrentSpan; CurrentSpan = CurrentSpan->NextOpenSpan.Get())
+		TUniquePtr<FNNOpenSpan>* Link = &Column;
+		while (Link->IsValid())
 		{
-			int32 SpanDistance = CurrentSpan->EdgeDistance;
-			if (SpanDistance == NNDistanceField::BorderSpan)
+			if (RemovedSpans[(*Link)->SpanIndex])
 			{
-				continue;
+				TUniquePtr<FNNOpenSpan> Next = MoveTemp((*Link)->NextOpenSpan);
+				*Link = MoveTemp(Next);
 			}
-
-			// (-1, 0)
-			FNNOpenSpan* Neighbour = CurrentSpan->Neighbours[0];
-			SpanDistance = NNDistanceField::GetDistanceFromNeighbourFirstPass(*Neighbour, SpanDistance, false);
-
-			// (-1, -1)
-			Neighbour = Neighbour->Neighbours[3];
-			if (Neighbour)
+			else
 			{
-				SpanDistance = NNDistanceField::GetDistanceFromNeighbourFirstPass(*Neighbour, SpanDistance, true);
+				(*Link)->SpanIndex = SpanIndex++;
+				Link = &(*Link)->NextOpenSpan;
 			}
+		}
+	}
+	OpenHeightField.AmountOfSpans = SpanIndex;
+}
 
-			// (0, -1)
-			Neighbour = CurrentSpan->Neighbours[3];
-			SpanDistance = NNDistanceField::GetDistanceFromNeighbourFirstPass(*Neighbour, SpanDistance, false);
+void FOpenHeightFieldGenerator::GenerateDistanceField(FNNOpenHeightField& OpenHeightField, bool bSmooth) const
+{
+	using namespace NNDistanceField;
 
-			// (1, -1)
-			Neighbour = Neighbour->Neighbours[2];
-			if (Neighbour)
-			{
-				SpanDistance = NNDistanceField::GetDistanceFromNeighbourFirstPass(*Neighbour, SpanDistance, true);
-			}
+	const int32 SpansNum = OpenHeightField.AmountOfSpans;
+	if (SpansNum == 0)
+	{
+		return;
+	}
 
-			CurrentSpan->EdgeDistance = SpanDistance;
+	// Flat copy of the links between spans so the passes don't need to chase pointers
+	TArray<int32> NeighbourIndexes;
+	NeighbourIndexes.SetNumUninitialized(SpansNum * 4);
+	for (FNNOpenHeightFieldIterator It (OpenHeightField); It; ++It)
+	{
+		for (int32 Dir = 0; Dir < 4; ++Dir)
+		{
+			const FNNOpenSpan* Neighbour = It->Neighbours[Dir];
+			NeighbourIndexes[It->SpanIndex * 4 + Dir] = Neighbour ? Neighbour->SpanIndex : INDEX_NONE;
 		}
 	}
 
-	// Pass 2. Neighbours checked (1, 0), (1, 1), (0, 1), (-1, 1)
-	// Don't need to handle the NeedsInits special case
-	for (int32 i = OpenHeightField.Spans.Num() - 1; i >= 0; --i)
+	// Initialization
+	TArray<int32> Distances;
+	Distances.SetNumUninitialized(SpansNum);
+	for (int32 i = 0; i < SpansNum; ++i)
 	{
-		TUniquePtr<FNNOpenSpan>& OpenSpan = OpenHeightField.Spans[i];
-		for (FNNOpenSpan* CurrentSpan = OpenSpan.Get(); CurrentSpan; CurrentSpan = CurrentSpan->NextOpenSpan.Get())
+		bool bIsBorder = false;
+		for (int32 Dir = 0; Dir < 4 && !bIsBorder; ++Dir)
 		{
-			int32 SpanDistance = CurrentSpan->EdgeDistance;
-			if (SpanDistance == NNDistanceField::BorderSpan)
-			{
-				continue;
-			}
+			// If the axis neighbour or the diagonal neighbour is null then this is a border span
+			const int32 Neighbour = NeighbourIndexes[i * 4 + Dir];
+			bIsBorder = Neighbour == INDEX_NONE || NeighbourIndexes[Neighbour * 4 + (Dir + 1) % 4] == INDEX_NONE;
+		}
+		Distances[i] = bIsBorder ? BorderSpan : NeedsInitSpan;
+	}
 
-			// (1, 0)
-			FNNOpenSpan* Neighbour = CurrentSpan->Neighbours[2];
-			SpanDistance = NNDistanceField::GetDistanceFromNeighbourSecondPass(*Neighbour, SpanDistance, false);
+	// Pass 1 the following neighbours will be checked: (-1, 0), (-1, -1), (0, -1), (1, -1)
+	for (int32 i = 0; i < SpansNum; ++i)
+	{
+		int32 SpanDistance = Distances[i];
+		if (SpanDistance == BorderSpan)
+		{
+			continue;
+		}
+		CheckNeighbours<true>(Distances, NeighbourIndexes, i, 0, 3, SpanDistance);
+		CheckNeighbours<true>(Distances, NeighbourIndexes, i, 3, 2, SpanDistance);
+		Distances[i] = SpanDistance;
+	}
 
-			// (1, 1)
-			Neighbour = Neighbour->Neighbours[1];
-			if (Neighbour)
-			{
-				SpanDistance = NNDistanceField::GetDistanceFromNeighbourSecondPass(*Neighbour, SpanDistance, true);
-			}
+	// Pass 2. Neighbours checked (1, 0), (1, 1), (0, 1), (-1, 1)
+	// Don't need to handle the NeedsInits special case
+	for (int32 i = SpansNum - 1; i >= 0; --i)
+	{
+		int32 SpanDistance = Distances[i];
+		if (SpanDistance == BorderSpan)
+		{
+			continue;
+		}
+		CheckNeighbours<false>(Distances, NeighbourIndexes, i, 2, 1, SpanDistance);
+		CheckNeighbours<false>(Distances, NeighbourIndexes, i, 1, 0, SpanDistance);
+		Distances[i] = SpanDistance;
+	}
 
-			// (0, 1)
-			Neighbour = CurrentSpan->Neighbours[1];
-			SpanDistance = NNDistanceField::GetDistanceFromNeighbourSecondPass(*Neighbour, SpanDistance, false);
+	if (!bSmooth)
+	{
+		for (FNNOpenHeightFieldIterator It (OpenHeightField); It; ++It)
+		{
+			It->EdgeDistance = Distances[It->SpanIndex];
+		}
+		return;
+	}
 
-			// (-1, 1)
-			Neighbour = Neighbour->Neighbours[0];
-			if (Neighbour)
+	// Box blur of the 3x3 neighbourhood to smooth the distances used by the watershed
+	TArray<int32> BlurredDistances;
+	BlurredDistances.SetNumUninitialized(SpansNum);
+	for (int32 i = 0; i < SpansNum; ++i)
+	{
+		const int32 SpanDistance = Distances[i];
+		if (SpanDistance <= BlurThreshold)
+		{
+			BlurredDistances[i] = SpanDistance;
+			continue;
+		}
+		int32 Sum = SpanDistance;
+		for (int32 Dir = 0; Dir < 4; ++Dir)
+		{
+			const int32 Neighbour = NeighbourIndexes[i * 4 + Dir];
+			if (Neighbour == INDEX_NONE)
 			{
-				SpanDistance = NNDistanceField::GetDistanceFromNeighbourSecondPass(*Neighbour, SpanDistance, true);
+				Sum += SpanDistance * 2;
+				continue;
 			}
-
-			CurrentSpan->EdgeDistance = SpanDistance;
+			const int32 Diagonal = NeighbourIndexes[Neighbour * 4 + (Dir + 1) % 4];
+			Sum += Distances[Neighbour] + (Diagonal != INDEX_NONE ? Distances[Diagonal] : SpanDistance);
 		}
+		BlurredDistances[i] = (Sum + 5) / 9;
 	}
-}
-
-
 
+	for (FNNOpenHeightFieldIterator It (OpenHeightField); It; ++It)
+	{
+		It->EdgeDistance = BlurredDistances[It->SpanIndex];
+	}
+}
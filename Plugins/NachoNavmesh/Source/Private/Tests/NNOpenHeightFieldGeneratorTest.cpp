@@ -0,0 +1,52 @@
+﻿#include "Misc/AutomationTest.h"
+
+// NN Includes
+#include "NavData/Voxelization/OpenHeightFieldGenerator.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace NNOpenHeightFieldGeneratorTests
+{
+	/** Exposes the span removal used by the erosion and the obstacles */
+	class FGeneratorAccess : public FOpenHeightFieldGenerator
+	{
+	public:
+		using FOpenHeightFieldGenerator::RemoveSpans;
+	};
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FNNRemoveSpansOneWayLinkTest, "NachoNavmesh.OpenHeightField.RemoveSpansClearsOneWayLinks",
+                                 EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FNNRemoveSpansOneWayLinkTest::RunTest(const FString& Parameters)
+{
+	// Two columns. The first one has two stacked spans, the second one a single span
+	FNNOpenHeightField OpenHeightField(2, 1, 10);
+	OpenHeightField.Spans[0] = MakeUnique<FNNOpenSpan>(0, 2, 0, 0);
+	OpenHeightField.Spans[0]->NextOpenSpan = MakeUnique<FNNOpenSpan>(5, 10, 0, 0);
+	OpenHeightField.Spans[1] = MakeUnique<FNNOpenSpan>(4, 10, 1, 0);
+	OpenHeightField.AmountOfSpans = 3;
+
+	FNNOpenSpan* LowerSpan = OpenHeightField.Spans[0].Get();
+	FNNOpenSpan* UpperSpan = LowerSpan->NextOpenSpan.Get();
+	FNNOpenSpan* RemovedSpan = OpenHeightField.Spans[1].Get();
+	LowerSpan->SpanIndex = 0;
+	UpperSpan->SpanIndex = 1;
+	RemovedSpan->SpanIndex = 2;
+
+	// The lower span links to the removed span but the removed span links back to the upper one
+	LowerSpan->Neighbours[2] = RemovedSpan;
+	UpperSpan->Neighbours[2] = RemovedSpan;
+	RemovedSpan->Neighbours[0] = UpperSpan;
+
+	NNOpenHeightFieldGeneratorTests::FGeneratorAccess::RemoveSpans(OpenHeightField, [](const FNNOpenSpan& Span) { return Span.X == 1; });
+
+	TestFalse(TEXT("The removed span is no longer in its column"), OpenHeightField.Spans[1].IsValid());
+	TestEqual(TEXT("Amount of spans"), OpenHeightField.AmountOfSpans, 2);
+	TestNull(TEXT("The one way link to the removed span is cleared"), LowerSpan->Neighbours[2]);
+	TestNull(TEXT("The two way link to the removed span is cleared"), UpperSpan->Neighbours[2]);
+	TestEqual(TEXT("The remaining spans are indexed again"), UpperSpan->SpanIndex, 1);
+	return true;
+}
+
+#endif // WITH_DEV_AUTOMATION_TESTS
@@ -0,0 +1,125 @@
+﻿#include "Misc/AutomationTest.h"
+
+// UE Includes
+#include "NavigationPath.h"
+
+// NN Includes
+#include "NavData/NNAreaGenerator.h"
+#include "NavData/Pathfinding/NNPathfinding.h"
+#include "NavData/Pathfinding/NNQueryFilter.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace NNPathfindingTests
+{
+	/** Area of the polygons of the short route */
+	constexpr uint8 ExpensiveAreaID = 1;
+
+	struct FTestPolygon
+	{
+		TArray<int32> Indexes;
+		uint8 AreaID;
+	};
+
+	/** Builds a U shaped mesh. The start and the goal polygons are joined by a short route of expensive polygons and
+	 * by a longer route of default polygons going around a hole. All the polygons are axis aligned rectangles */
+	void BuildDetourMesh(FNNPolygonMesh& OutPolygonMesh)
+	{
+		OutPolygonMesh.Vertexes = {
+			FVector(0, 0, 0), FVector(10, 0, 0), FVector(20, 0, 0), FVector(30, 0, 0), FVector(40, 0, 0),
+			FVector(0, 10, 0), FVector(10, 10, 0), FVector(20, 10, 0), FVector(30, 10, 0), FVector(40, 10, 0),
+			FVector(0, 40, 0), FVector(10, 40, 0), FVector(30, 40, 0), FVector(40, 40, 0),
+			FVector(0, 50, 0), FVector(10, 50, 0), FVector(30, 50, 0), FVector(40, 50, 0),
+		};
+
+		const TArray<FTestPolygon> Polygons = {
+			{{0, 1, 6, 5}, NNNavAreas::DefaultAreaID},
+			{{1, 2, 7, 6}, ExpensiveAreaID},
+			{{2, 3, 8, 7}, ExpensiveAreaID},
+			{{3, 4, 9, 8}, NNNavAreas::DefaultAreaID},
+			{{5, 6, 11, 10}, NNNavAreas::DefaultAreaID},
+			{{8, 9, 13, 12}, NNNavAreas::DefaultAreaID},
+			{{10, 11, 15, 14}, NNNavAreas::DefaultAreaID},
+			{{11, 12, 16, 15}, NNNavAreas::DefaultAreaID},
+			{{12, 13, 17, 16}, NNNavAreas::DefaultAreaID},
+		};
+		for (int32 i = 0; i < Polygons.Num(); ++i)
+		{
+			FNNPolygon& Polygon = OutPolygonMesh.PolygonIndexes.AddDefaulted_GetRef();
+			Polygon.Indexes = Polygons[i].Indexes;
+			Polygon.AreaID = Polygons[i].AreaID;
+			Polygon.ComponentID = 0;
+			Polygon.NodeRef = i + 1;
+		}
+	}
+
+	/** Returns the cost of the path adding the length of each segment multiplied by the cheapest area it is on */
+	float GetPathPointsCost(const FNNPolygonMesh& PolygonMesh, const FNNQueryFilter& Filter, const TArray<FNavPathPoint>& Points)
+	{
+		float Cost = 0.0f;
+		for (int32 i = 1; i < Points.Num(); ++i)
+		{
+			const FVector Middle = (Points[i - 1].Location + Points[i].Location) * 0.5f;
+			float AreaCost = TNumericLimits<float>::Max();
+			for (const FNNPolygon& Polygon : PolygonMesh.PolygonIndexes)
+			{
+				const FVector& Min = PolygonMesh.Vertexes[Polygon.Indexes[0]];
+				const FVector& Max = PolygonMesh.Vertexes[Polygon.Indexes[2]];
+				if (Middle.X >= Min.X && Middle.X <= Max.X && Middle.Y >= Min.Y && Middle.Y <= Max.Y)
+				{
+					AreaCost = FMath::Min(AreaCost, Filter.GetAreaCost(Polygon.AreaID));
+				}
+			}
+			Cost += FVector::Dist(Points[i - 1].Location, Points[i].Location) * AreaCost;
+		}
+		return Cost;
+	}
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FNNPathCostMatchesPathTest, "NachoNavmesh.Pathfinding.PathCostMatchesFoundPath",
+                                 EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FNNPathCostMatchesPathTest::RunTest(const FString& Parameters)
+{
+	using namespace NNPathfindingTests;
+
+	// The local space matches the world space
+	FNNOpenHeightField OpenHeightField;
+	OpenHeightField.Bounds = FBox(FVector::ZeroVector, FVector(40.0f, 50.0f, 10.0f));
+	OpenHeightField.CellSize = 1.0f;
+	OpenHeightField.CellHeight = 1.0f;
+
+	FNNPolygonMesh PolygonMesh;
+	BuildDetourMesh(PolygonMesh);
+
+	FNNAreaGeneratorData AreaGeneratorData;
+	const FNNPathfinding Pathfinding (AreaGeneratorData, OpenHeightField);
+	FNNGraph Graph;
+	Pathfinding.CreateGraph(PolygonMesh, Graph);
+
+	FNNQueryFilter Filter;
+	Filter.SetAreaCost(ExpensiveAreaID, 100.0f);
+
+	const FVector Start (5.0f, 5.0f, 0.0f);
+	const FVector End (35.0f, 5.0f, 0.0f);
+	const FVector Extent (5.0f, 5.0f, 5.0f);
+	const FNavPathSharedPtr Path = Pathfinding.FindPath(Graph, PolygonMesh, Start, End, Extent, Filter);
+	FNNPathSearch Search;
+	const bool bFound = Pathfinding.SearchPath(Graph, PolygonMesh, Start, End, Extent, Filter, Search);
+	if (!TestTrue(TEXT("A path is found"), Path.IsValid() && bFound))
+	{
+		return false;
+	}
+
+	// The short route costs at least 20 * 100. Going around the hole costs 80 plus the diagonals of the end polygons
+	const float ExpectedCost = 80.0f + 2.0f * FMath::Sqrt(50.0f);
+	const float PathPointsCost = GetPathPointsCost(PolygonMesh, Filter, Path->GetPathPoints());
+	const float PathCost = Pathfinding.GetPathCost(Graph, PolygonMesh, Filter, Search);
+	TestEqual(TEXT("The found path goes around the expensive area"), PathPointsCost, ExpectedCost, KINDA_SMALL_NUMBER * 100.0f);
+	TestEqual(TEXT("The path cost matches the cost of the found path"), PathCost, PathPointsCost, KINDA_SMALL_NUMBER * 100.0f);
+	TestEqual(TEXT("The path length matches the length of the found path"), Pathfinding.GetPathLength(Graph, Search),
+		Path->GetLength(), KINDA_SMALL_NUMBER * 100.0f);
+	return true;
+}
+
+#endif // WITH_DEV_AUTOMATION_TESTS
@@ -5,14 +5,40 @@ struct FNNOpenSpan;
 struct FNNRegion;
 struct FNNOpenHeightField;
 
+/** A corner of a contour in OpenHeightField grid coordinates. Packed in int16, the heightfields with more than
+ * MaxCoordinate cells in any axis are not built */
+struct FNNContourVertex
+{
+	static constexpr int32 MaxCoordinate = MAX_int16;
+
+	FNNContourVertex() = default;
+	FNNContourVertex(int32 InX, int32 InY, int32 InZ)
+		: X(static_cast<int16>(InX)), Y(static_cast<int16>(InY)), Z(static_cast<int16>(InZ))
+	{
+		checkSlow(InX >= 0 && InX <= MaxCoordinate && InY >= 0 && InY <= MaxCoordinate && InZ >= 0 && InZ <= MaxCoordinate);
+	}
+
+	FORCEINLINE FVector ToVector() const { return FVector(X, Y, Z); }
+
+	/** Whether both vertexes are in the same column of the grid */
+	FORCEINLINE bool IsSameColumn(const FNNContourVertex& Other) const { return X == Other.X && Y == Other.Y; }
+
+	int16 X = 0;
+	int16 Y = 0;
+	int16 Z = 0;
+};
+
 /** Contains the vertexes of a contour */
 struct FNNContour
 {
-	FNNContour(int32 InRegionID, const TArray<FVector>& InRawVertexes, const TArray<FVector>& InSimplifiedVertexes)
-		: RegionID(InRegionID), RawVertexes(InRawVertexes), SimplifiedVertexes(InSimplifiedVertexes) {}
-	int32 RegionID;
-	TArray<FVector> RawVertexes;
-	TArray<FVector> SimplifiedVertexes;
+	FNNContour() = default;
+	FNNContour(int32 InRegionID, uint8 InAreaID, const TArray<FNNContourVertex>& InRawVertexes, TArray<FNNContourVertex>&& InSimplifiedVertexes)
+		: RegionID(InRegionID), AreaID(InAreaID), RawVertexes(InRawVertexes), SimplifiedVertexes(MoveTemp(InSimplifiedVertexes)) {}
+	int32 RegionID = INDEX_NONE;
+	/** The area of the region enclosed by the contour */
+	uint8 AreaID = 0;
+	TArray<FNNContourVertex> RawVertexes;
+	TArray<FNNContourVertex> SimplifiedVertexes;
 	TArray<FNNContour*> Neighbours;
 };
 
@@ -22,6 +48,19 @@ struct FNNContourMesh
 	TArray<TUniquePtr<FNNContour>> Contours;
 };
 
+/** Working buffers used to trace and simplify contours. Each worker reuses its own between the regions it traces */
+struct FNNContourScratch
+{
+	TArray<FNNContourVertex> Vertices;
+	TArray<int32> VerticesRegions;
+	TArray<int32> MandatoryIndexes;
+	TArray<int32> SimplifiedIndexes;
+	/** Pending segments of the Douglas-Peucker subdivision */
+	TArray<TPair<int32, int32>> SegmentStack;
+
+	void Reset();
+};
+
 /** Generates contours with a given OpenHeightField */
 class FNNContourGeneration
 {
@@ -30,39 +69,42 @@ public:
 	FNNContourGeneration(FNNAreaGeneratorData& InAreaGenerator, float InDeviationThreshold, float InMaxEdgeLength)
 		: AreaGeneratorData(InAreaGenerator), ContourDeviationThreshold(InDeviationThreshold), MaxEdgeLength(InMaxEdgeLength) {}
 
-	/** Calculates the contour of the OpenHeightField and inserts the contour in the height field */
+	/** Calculates the contour of the OpenHeightField and inserts the contour in the height field.
+	 * The region edges are flagged first and then every region is traced concurrently. The contours are sorted by region ID */
 	void CalculateContour(FNNOpenHeightField& OpenHeightField, TArray<FNNContour>& OutContours);
 
 protected:
+	/** Traces and simplifies the contour that starts in the StartSpan. Only reads the OpenHeightField */
+	void BuildContour(const FNNOpenSpan& StartSpan, FNNContourScratch& Scratch, FNNContour& OutContour) const;
+
 	/** Builds a basic contour for the region of the StartSpan */
-	void BuildRawContour(FNNOpenSpan* StartSpan, FPlatformTypes::int32 StartDir, TArray<FVector>&
-	                      OutContourVerts, TArray<int32>& OutVertsRegions);
+	void BuildRawContour(const FNNOpenSpan* StartSpan, int32 StartDir, TArray<FNNContourVertex>& OutContourVerts, TArray<int32>& OutVertsRegions) const;
 
-	/** Changes the vertexes from the region.
+	/** Fills OutSimplifiedIndexes with the source vertexes that must be kept.
 	 * For edges that connects non null regions it will remove all vertices except the start and the end vertex
 	 * */
-	void GenerateSimplifiedContour(const TArray<FVector>& SourceVertexes, const TArray<int32>& SourceRegions, TArray<FVector>& OutSimplifiedVertexes, TArray<int32>& OutSimplifiedVertexesIndexes) const;
+	void GenerateSimplifiedContour(const TArray<FNNContourVertex>& SourceVertexes, const TArray<int32>& SourceRegions, TArray<int32>& OutSimplifiedIndexes) const;
 
 	/** Returns the height that should be used for the parameter Span.
 	 * The vertex clockwise of the specified direction */
-	int32 GetCornerHeight(FNNOpenSpan& Span, int32 Direction) const;
-
-	/** Adds vertexes to the null-region edges. All these vertexes will be closer than the given Threshold from the
-	 * null region edges */
-	void MatchNullRegionEdges(const TArray<FVector>& SourceVertexes, const TArray<int32>& SourceRegions, TArray<FVector>& SimplifiedVertexes, TArray<int32>& SimplifiedVertexIndexes) const;
+	int32 GetCornerHeight(const FNNOpenSpan& Span, int32 Direction) const;
 
-	/** Add vertexes to a contour sucha that no null region edge segment exceeds the allowed edge length */
-	void NullRegionMaxEdge(const TArray<FVector>& SourceVertexes, const TArray<int32>& SourceRegions, TArray<FVector>& SimplifiedVertexes, TArray<int32>& SimplifiedVertexesIndexes) const;
+	/** Subdivides the null-region edges between the mandatory vertexes with Douglas-Peucker so every source vertex is
+	 * closer than ContourDeviationThreshold to the simplified contour and no edge exceeds MaxEdgeLength.
+	 * The vertexes are appended in contour order so no vertex is ever inserted in the middle of the array */
+	void SubdivideNullRegionEdges(const TArray<FNNContourVertex>& SourceVertexes, const TArray<int32>& SourceRegions,
+	                              const TArray<int32>& MandatoryIndexes, TArray<TPair<int32, int32>>& SegmentStack,
+	                              TArray<int32>& OutSimplifiedIndexes) const;
 
 	/** Merges segments with the same X and Y coordinates */
-	void RemoveVerticalSegments(TArray<FVector>& Vertexes, TArray<int32>& Indexes) const;
+	void RemoveVerticalSegments(const TArray<FNNContourVertex>& SourceVertexes, TArray<int32>& Indexes) const;
 
 	/** Removes segments that intersects with region portal segments */
-	void RemoveIntersectionSegments(TArray<FVector>& Vertexes, TArray<int32>& SimplifiedIndexes, const TArray<int32>& SourceRegions) const;
+	void RemoveIntersectionSegments(const TArray<FNNContourVertex>& SourceVertexes, TArray<int32>& SimplifiedIndexes, const TArray<int32>& SourceRegions) const;
 	
 	/** Remove any null region that intersects with the specified edge.
 	 * Returns the offset that the start vertex needs to move. The value will always be <= 0 */
-	int32 RemoveIntersectionSegments(int32 StartVertexIndex, int32 EndVertexIndex, TArray<FVector>& Vertexes,
+	int32 RemoveIntersectionSegments(int32 StartVertexIndex, int32 EndVertexIndex, const TArray<FNNContourVertex>& SourceVertexes,
 	                                 TArray<int32>& SimplifiedIndexes, const TArray<int32>& SourceRegions) const;
 
 private:
@@ -1,6 +1,10 @@
 ﻿#pragma once
 
+// NN Includes
+#include "NavData/NNNavMeshTypes.h"
+
 struct FNNContour;
+struct FNNContourVertex;
 
 struct FNNPolygon
 {
@@ -8,7 +12,16 @@ struct FNNPolygon
 	*  then (1, 3, 4, 8) defines the polygon. */
 	FNNPolygon(int32 IndexesNum = 0) { Indexes.Reserve(IndexesNum); }
 	TArray<int32> Indexes;
+	/** The polygon connected through each edge. The edge i goes from Indexes[i] to Indexes[i + 1].
+	 * INDEX_NONE represents a wall */
+	TArray<int32> Neighbours;
 	int32 RegionID = INDEX_NONE;
+	/** The nav area of the polygon. Used by the query filters */
+	uint8 AreaID = NNNavAreas::DefaultAreaID;
+	/** The flags of the nav area */
+	uint16 Flags = NNNavAreas::DefaultAreaFlags;
+	/** Polygons with different components can't reach each other */
+	int32 ComponentID = INDEX_NONE;
 	NavNodeRef NodeRef = INVALID_NAVNODEREF;
 	friend bool operator==(const FNNPolygon& Lhs, const FNNPolygon& Rhs) { return Lhs.NodeRef == Rhs.NodeRef; }
 };
@@ -19,6 +32,29 @@ struct FNNPolygonMesh
 	TArray<FNNPolygon> PolygonIndexes;
 	/** These indices are only used for drawing the mesh */
 	TArray<FNNPolygon> TriangleIndexes;
+	/** Accumulated 2D area of the polygons in OpenHeightField space. Used to select polygons weighted by their area */
+	TArray<float> PolygonAreaPrefixSum;
+
+	/** Size in OpenHeightField cells of each square of the polygon grid */
+	static constexpr int32 GridCellSize = 16;
+	/** Quantity of squares of the polygon grid in the X and Y axis. The grid starts at the OpenHeightField origin */
+	FIntPoint GridSize = FIntPoint::ZeroValue;
+	/** Index in GridPolygons of the first polygon of each grid square. The last element is the end of the last square */
+	TArray<int32> GridCellStarts;
+	/** The polygons that overlap each grid square. Used to find the polygons near a point without visiting all of them */
+	TArray<int32> GridPolygons;
+
+	/** Whether the polygons were bucketed in the grid */
+	bool HasGrid() const { return GridCellStarts.Num() > 0; }
+
+	/** Returns the 2D area of the polygon */
+	float GetPolygonArea(int32 PolygonIndex) const
+	{
+		return PolygonAreaPrefixSum[PolygonIndex] - (PolygonIndex > 0 ? PolygonAreaPrefixSum[PolygonIndex - 1] : 0.0f);
+	}
+
+	/** Returns the 2D area of all the polygons */
+	float GetTotalArea() const { return PolygonAreaPrefixSum.Num() > 0 ? PolygonAreaPrefixSum.Last() : 0.0f; }
 };
 
 struct FNNOpenHeightField;
@@ -34,6 +70,37 @@ protected:
 	static bool GetPolyMergeInfo(const FNNPolygon& PolyA, const FNNPolygon& PolyB, const FNNPolygonMesh& PolygonMesh,
 	                             int32& VertexToMergeA, int32& VertexToMergeB, float& DistanceSqrOfEdge);
 
-	/** Attempts to triangulate a polygon */
-	int32 Triangulate(const TArray<FVector>& ContourVertexes, TArray<int32>& VertexesIndexes, FNNPolygonMesh& PolygonMesh);
+	/** Merges the polygons from FirstPolygon onwards into convex polygons. Candidates come from the shared edges and
+	 * the longest edge is merged first. Only the candidates of the merged polygon are updated after each merge */
+	static void MergeContourPolygons(FNNPolygonMesh& PolygonMesh, int32 FirstPolygon);
+
+	/** Links the polygons that share an edge */
+	static void BuildPolygonNeighbours(FNNPolygonMesh& PolygonMesh);
+
+	/** Assigns the same ComponentID to the polygons connected through their vertexes */
+	static void BuildPolygonComponents(FNNPolygonMesh& PolygonMesh);
+
+	/** Fills the PolygonAreaPrefixSum of the mesh */
+	static void BuildPolygonAreas(FNNPolygonMesh& PolygonMesh);
+
+	/** Buckets the polygons in the grid squares their 2D bounds overlap */
+	static void BuildPolygonGrid(FNNPolygonMesh& PolygonMesh);
+
+	/** Triangulates the contour cutting the ear with the shortest diagonal first. Uses exact orientation tests on the
+	 * grid coordinates. Appends the contour indexes of each triangle to OutTriangles.
+	 * Returns false if the contour is degenerated and could only be partially triangulated */
+	static bool Triangulate(const TArray<FNNContourVertex>& ContourVertexes, TArray<int32>& VertexesIndexes, TArray<int32>& OutTriangles);
+
+	/** Returns the index of the ear with the shortest diagonal or INDEX_NONE if there is no valid ear.
+	 * When bLoose is false it uses the ears flagged in VertexesIndexes */
+	static int32 FindShortestDiagonal(const TArray<FNNContourVertex>& ContourVertexes, const TArray<int32>& VertexesIndexes, bool bLoose);
+
+	/** Returns whether the segment between the vertexes IndexA and IndexB is a valid internal diagonal */
+	static bool IsDiagonal(int32 IndexA, int32 IndexB, const TArray<FNNContourVertex>& ContourVertexes, const TArray<int32>& VertexesIndexes, bool bLoose);
+
+	/** Returns whether the diagonal IndexA->IndexB lies within the internal angle of the vertex IndexA */
+	static bool LiesWithinInternalAngle(int32 IndexA, int32 IndexB, const TArray<FNNContourVertex>& ContourVertexes, const TArray<int32>& VertexesIndexes, bool bLoose);
+
+	/** Returns whether the diagonal IndexA->IndexB intersects any edge of the contour not connected to it */
+	static bool HasIllegalEdgeIntersection(int32 IndexA, int32 IndexB, const TArray<FNNContourVertex>& ContourVertexes, const TArray<int32>& VertexesIndexes, bool bLoose);
 };
@@ -1,8 +1,12 @@
 ﻿#pragma once
 
+// UE Includes
+#include "UObject/ObjectKey.h"
+
 // NN Includes
 #include "Contour/NNContourGeneration.h"
 #include "ConvexPolygon/NNPolyMeshBuilder.h"
+#include "NavData/NNNavMesh.h"
 #include "NNNavMeshRenderingComp.h"
 #include "NavData/Voxelization/HeightFieldGenerator.h"
 #include "Pathfinding/NNPathfinding.h"
@@ -10,20 +14,102 @@
 
 class UNavigationSystemV1;
 class FNNNavMeshGenerator;
+struct FNNRawGeometryRange;
+
+/** A mesh shared by several instances. Its vertexes are stored once in the mesh local space */
+struct FNNInstancedGeometry
+{
+	/** The coordinates of the vertexes stored as a structure of arrays */
+	TArray<float> VertexesX;
+	TArray<float> VertexesY;
+	TArray<float> VertexesZ;
+
+	/** Three vertex indexes for each triangle */
+	TArray<int32> Indices;
+
+	/** The transforms of the instances that overlap the tile */
+	TArray<FTransform> Transforms;
+
+	/** Returns the vertex in the mesh local space */
+	FORCEINLINE FVector GetLocalVertex(int32 Index) const
+	{
+		return FVector(VertexesX[Index], VertexesY[Index], VertexesZ[Index]);
+	}
+
+	int32 GetVertexesNum() const { return VertexesX.Num(); }
+
+	int32 GetTrianglesNum() const { return Indices.Num() / 3; }
+};
+
+/** The geometry of a tile. The vertexes are converted once from recast coordinates and stored relative to the Origin */
+struct FNNRawGeometry
+{
+	/** The vertexes are stored relative to this point. Usually the minimum point of the tile */
+	FVector Origin = FVector::ZeroVector;
+
+	/** The coordinates of the vertexes stored as a structure of arrays */
+	TArray<float> VertexesX;
+	TArray<float> VertexesY;
+	TArray<float> VertexesZ;
+
+	/** Three vertex indexes for each triangle */
+	TArray<int32> Indices;
+
+	/** Meshes that are rasterized once for each of their transforms */
+	TArray<FNNInstancedGeometry> InstancedGeometry;
+
+	/** Converts the recast vertexes and appends them with their triangles */
+	void Append(const float* RecastCoords, int32 VertexesNum, const int32* RecastIndices, int32 TrianglesNum);
+
+	/** Converts the recast vertexes into a new instanced mesh with the given transforms */
+	void AppendInstanced(const float* RecastCoords, int32 VertexesNum, const int32* RecastIndices, int32 TrianglesNum,
+		TArray<FTransform>&& Transforms);
+
+	/** Returns the world bounds of the triangles and instances inside the Range. Invalid if the Range is empty */
+	FBox GetRangeBounds(const FNNRawGeometryRange& Range) const;
+
+	/** Whether there is any triangle to rasterize */
+	bool HasGeometry() const { return Indices.Num() > 0 || InstancedGeometry.Num() > 0; }
+
+	/** Returns the vertex in world space */
+	FORCEINLINE FVector GetVertex(int32 Index) const
+	{
+		return Origin + FVector(VertexesX[Index], VertexesY[Index], VertexesZ[Index]);
+	}
+
+	int32 GetVertexesNum() const { return VertexesX.Num(); }
+
+	int32 GetTrianglesNum() const { return Indices.Num() / 3; }
+};
+
+/** The triangles and instanced meshes of the FNNRawGeometry that belong to a single navigation element */
+struct FNNRawGeometryRange
+{
+	int32 FirstTriangle = 0;
+	int32 TrianglesNum = 0;
+	int32 FirstInstanced = 0;
+	int32 InstancedNum = 0;
+};
+
+/** The rasterized spans of a navigation element inside a tile */
+struct FNNVoxelCacheEntry
+{
+	/** Hash of the element geometry, its instance transforms and the tile settings used to rasterize the Voxels */
+	uint32 GeometryHash = 0;
+
+	TSharedPtr<const FNNVoxelCache, ESPMode::ThreadSafe> Voxels;
+};
 
-/** A geometry element representation */
-struct FNNRawGeometryElement
+/** A navigation element that wasn't found in the voxel cache and needs to be rasterized */
+struct FNNUncachedElement
 {
-	// Instance geometry
-	TArray<float> GeomCoords;
-	TArray<int32> GeomIndices;
+	/** Invalid when the element can't be cached */
+	FObjectKey ElementKey;
 
-	// Per instance transformations in unreal coords
-	// When empty geometry is in world space
-	TArray<FTransform>	PerInstanceTransform;
+	uint32 GeometryHash = 0;
 
-	/** Returns the geometry position for the given Index */
-	FVector GetGeometryPosition(int32 Index) const;
+	/** The geometry of the element inside the tile RawGeometry */
+	FNNRawGeometryRange Range;
 };
 
 /** Caches a geometry element */
@@ -53,14 +139,33 @@ struct FNNGeometryCache
 	FNNGeometryCache(const uint8* Memory);
 };
 
-/** The result of the FNNAreaGenerator */
-struct FNNAreaGeneratorData
+/** A nav modifier volume that changes the area of the spans inside it */
+struct FNNAreaModifier
 {
-	// tile's geometry: without voxel cache
-	TArray<FNNRawGeometryElement> RawGeometry;
+	/** Returns whether the Location is inside the modifier volume */
+	bool IsInside(const FVector& Location) const;
 
-	FNNHeightField HeightField;
+	ENavigationShapeType::Type ShapeType = ENavigationShapeType::Unknown;
+
+	/** The bounds of the volume */
+	FBox Bounds = FBox(ForceInit);
+
+	/** Used by the cylinder shape */
+	FVector Center = FVector::ZeroVector;
+	float Radius = 0.0f;
+
+	/** Used by the convex shape. The points of the convex hull in world space */
+	TArray<FVector> ConvexPoints;
+	float MinZ = 0.0f;
+	float MaxZ = 0.0f;
+
+	/** The area applied to the spans inside the volume */
+	uint8 AreaID = NNNavAreas::DefaultAreaID;
+};
 
+/** The navmesh of a single agent profile built from the shared HeightField */
+struct FNNAgentNavData
+{
 	FNNOpenHeightField OpenHeightField;
 
 	TArray<FNNContour> Contours;
@@ -68,6 +173,31 @@ struct FNNAreaGeneratorData
 	FNNPolygonMesh PolygonMesh;
 
 	FNNGraph PathfindingGraph;
+};
+
+/** The result of the FNNAreaGenerator */
+struct FNNAreaGeneratorData
+{
+	// tile's geometry: without voxel cache
+	FNNRawGeometry RawGeometry;
+
+	/** The spans of every element that overlaps the tile. Merged into the HeightField */
+	TArray<TSharedPtr<const FNNVoxelCache, ESPMode::ThreadSafe>> ElementsVoxels;
+
+	/** The nav modifiers that overlap the tile */
+	TArray<FNNAreaModifier> AreaModifiers;
+
+	/** Rasterized once and shared by every agent profile. Emptied once the build finishes */
+	FNNHeightField HeightField;
+
+	/** The HeightField kept between builds. The obstacle and agent changes rebuild the navmesh from it */
+	FNNCompressedHeightField CompressedHeightField;
+
+	/** The navmesh of each agent profile. Indexed by the profile index */
+	TArray<FNNAgentNavData> AgentsNavData;
+
+	/** Identifies the build that generated this data. Changes every time the area is rebuilt */
+	uint32 BuildID = 0;
 
 	/** BoxSpheres used for debugging */
 	TArray<FBoxSphereBounds> TemporaryBoxSpheres;
@@ -95,6 +225,10 @@ class NACHONAVMESH_API FNNAreaGenerator : public FNonAbandonableTask
 public:
 	FNNAreaGenerator(const FNNNavMeshGenerator* InParentGenerator, const FNavigationBounds& Bounds);
 
+	/** Rebuilds the agents navmesh from the compressed HeightField of the PreviousData, skipping the gathering and
+	 * rasterization. Used to apply the obstacles and agent changes. The geometry is moved out of the PreviousData */
+	FNNAreaGenerator(const FNNNavMeshGenerator* InParentGenerator, const FNavigationBounds& Bounds, FNNAreaGeneratorData& PreviousData);
+
 	/** Gathers the geometry inside the AreaBounds */
 	void DoWork();
 
@@ -116,12 +250,23 @@ public:
 	FNNAreaGeneratorData* RetrieveGeneratorData() { return AreaGeneratorData.Release(); }
 
 protected:
+	/** Gathers the geometry inside the AreaBounds and rasterizes it in the HeightField. Returns false if there was no geometry */
+	bool BuildHeightField();
 	/** Gathers the geometry inside the AreaBounds */
 	void GatherGeometry( bool bGeometryChanged);
 	/** Gather geometry from a specified Navigation Data */
 	void GatherNavigationDataGeometry(const TSharedRef<FNavigationRelevantData, ESPMode::ThreadSafe>& ElementData, UNavigationSystemV1& NavSys, const FNavDataConfig& OwnerNavDataConfig, bool bGeometryChanged);
-	/** Appends specified geometry to the AreaGeneratorData */
-	void AppendGeometry(const FNavigationRelevantData& DataRef, const FCompositeNavModifier& InModifier, const FNavDataPerInstanceTransformDelegate& InTransformsDelegate);
+	/** Appends specified geometry to the AreaGeneratorData. Instanced meshes are only added with the PerInstanceTransform */
+	void AppendGeometry(const FNavigationRelevantData& DataRef, const FCompositeNavModifier& InModifier, TArray<FTransform>&& PerInstanceTransform);
+	/** Returns a hash of the element geometry inside this tile. Changes when the element or the voxel settings change */
+	uint32 CalculateGeometryHash(const FNavigationRelevantData& DataRef, const TArray<FTransform>& PerInstanceTransform) const;
+	/** Rasterizes the elements that were not found in the voxel cache and stores their voxels in the parent generator */
+	void RasterizeUncachedElements();
+	/** Appends the areas of the modifier to the AreaGeneratorData. The areas of instanced elements are in local space
+	 * and are placed with the LocalToWorld of each instance */
+	void AppendModifier(const FCompositeNavModifier& Modifier, const FTransform& LocalToWorld);
+	/** Builds the navmesh of the agent profile from the shared HeightField */
+	void BuildAgentNavData(int32 ProfileIndex);
 
 private:
 	/** The bounds assigned to the AreaGenerator */
@@ -133,4 +278,28 @@ private:
 
 	/** The resulting data */
 	TUniquePtr<FNNAreaGeneratorData> AreaGeneratorData;
+
+	/** The area ID of each nav area class supported by the navmesh. Cached in the game thread */
+	TMap<const UClass*, uint8> AreaClassToID;
+
+	/** The flags of each area, indexed by its area ID */
+	uint16 AreaFlags[NNNavAreas::MaxAreas];
+
+	/** The agents that need a navmesh. Cached in the game thread */
+	TArray<FNNAgentProfile> AgentProfiles;
+
+	/** The elements gathered that need to be rasterized in this build */
+	TArray<FNNUncachedElement> UncachedElements;
+
+	/** The voxel cache of the elements that overlap the tile */
+	TMap<FObjectKey, FNNVoxelCacheEntry> TileVoxelCache;
+
+	/** Hash of the settings that change the rasterization of the whole tile */
+	uint32 VoxelSettingsHash = 0;
+
+	/** The obstacles that overlap the AreaBounds. Cached in the game thread */
+	TArray<FNNAreaModifier> Obstacles;
+
+	/** Whether the HeightField was taken from a previous build */
+	bool bReuseHeightField = false;
 };
@@ -6,10 +6,47 @@
 
 #include "NNNavMesh.generated.h"
 
+/** How the open heightfield is divided into regions before building the contours */
+UENUM()
+enum class ENNPartitionMode : uint8
+{
+	/** Best quality regions but the slowest partitioning */
+	Watershed,
+	/** Sweeps the rows of spans. The fastest partitioning but creates long and thin polygons */
+	Monotone,
+	/** Monotone regions merged while they don't overlap vertically. Fast and keeps the floors apart */
+	Layers
+};
+
+/** The size of an agent that paths with the navmesh */
+USTRUCT()
+struct FNNAgentProfile
+{
+	GENERATED_BODY()
+
+	FNNAgentProfile() {}
+	FNNAgentProfile(float InAgentRadius, float InAgentHeight, float InMaxLedgeHeight)
+		: AgentRadius(InAgentRadius), AgentHeight(InAgentHeight), MaxLedgeHeight(InMaxLedgeHeight) {}
+
+	/** Radius of the agent. The walkable area is eroded by it */
+	UPROPERTY(EditAnywhere, Category = "NN")
+	float AgentRadius = 30.0f;
+
+	/** Height of the agent */
+	UPROPERTY(EditAnywhere, Category = "NN")
+	float AgentHeight = 144.0f;
+
+	/** The maximum ledge the agent can walk */
+	UPROPERTY(EditAnywhere, Category = "NN")
+	float MaxLedgeHeight = 50.0f;
+};
+
 struct FNNNavMeshDebuggingInfo;
 struct FNNPolygon;
+struct FNNRaycastResult;
 
 class FNNNavMeshGenerator;
+class FNNQueryFilter;
 
 UCLASS()
 class NACHONAVMESH_API ANNNavMesh : public ANavigationData
@@ -19,17 +56,96 @@ class NACHONAVMESH_API ANNNavMesh : public ANavigationData
 friend FNNNavMeshGenerator;
 
 public:
+	/** Maximum quantity of agent profiles, including the default one. Limited by the bits of the NavNodeRef */
+	static constexpr int32 MaxAgentProfiles = 256;
+
 	ANNNavMesh();
 
 	/** Searches for a path for the given query */
 	static FPathFindingResult FindPath(const FNavAgentProperties& AgentProperties, const FPathFindingQuery& Query);
 
+	/** Checks whether a path exists for the given query without building it */
+	static bool TestPath(const FNavAgentProperties& AgentProperties, const FPathFindingQuery& Query, int32* NumVisitedNodes);
+
+	/** Raycast used by the navigation system. Returns whether the ray hit a wall */
+	static bool NavMeshRaycast(const ANavigationData* Self, const FVector& RayStart, const FVector& RayEnd, FVector& HitLocation, FSharedConstNavQueryFilter QueryFilter, const UObject* Querier);
+
+	/** Casts a ray along the navmesh surface until it hits a wall or reaches RayEnd.
+	 * Fills the hit location, normal and the polygons crossed. Returns whether the ray hit a wall */
+	bool RaycastWithResult(const FVector& RayStart, const FVector& RayEnd, FNNRaycastResult& OutResult, FSharedConstNavQueryFilter QueryFilter, const UObject* Querier = nullptr) const;
+
+	/** Same as RaycastWithResult but starts in the polygon of the RayStart, skipping the search of the start polygon */
+	bool RaycastWithResult(const FNavLocation& RayStart, const FVector& RayEnd, FNNRaycastResult& OutResult, FSharedConstNavQueryFilter QueryFilter, const UObject* Querier = nullptr) const;
+
+	/** Calculates the cost of the path without building it */
+	virtual ENavigationQueryResult::Type CalcPathCost(const FVector& PathStart, const FVector& PathEnd, float& OutPathCost, FSharedConstNavQueryFilter QueryFilter = nullptr, const UObject* Querier = nullptr) const override;
+
+	/** Calculates the length of the path without building it */
+	virtual ENavigationQueryResult::Type CalcPathLength(const FVector& PathStart, const FVector& PathEnd, float& OutPathLength, FSharedConstNavQueryFilter QueryFilter = nullptr, const UObject* Querier = nullptr) const override;
+
+	/** Calculates the length and cost of the path without building it */
+	virtual ENavigationQueryResult::Type CalcPathLengthAndCost(const FVector& PathStart, const FVector& PathEnd, float& OutPathLength, float& OutPathCost, FSharedConstNavQueryFilter QueryFilter = nullptr, const UObject* Querier = nullptr) const override;
+
 	/** Searches for the nearest point in the navmesh inside the given Extent */
 	virtual bool ProjectPoint(const FVector& Point, FNavLocation& OutLocation, const FVector& Extent, FSharedConstNavQueryFilter Filter, const UObject* Querier) const override;
 
+	/** Returns a random point of the navmesh. Polygons are selected weighted by their area */
+	virtual FNavLocation GetRandomPoint(FSharedConstNavQueryFilter Filter = nullptr, const UObject* Querier = nullptr) const override;
+
+	/** Returns a random point reachable from the Origin walking through the polygons inside the Radius */
+	virtual bool GetRandomReachablePointInRadius(const FVector& Origin, float Radius, FNavLocation& OutResult, FSharedConstNavQueryFilter Filter = nullptr, const UObject* Querier = nullptr) const override;
+
 	/** Retrieves the polygon containing the NavLocation. Returns whether it was found */
 	bool GetPolygonFromNavLocation(const FNavLocation& NavLocation, FNNPolygon& OutPolygon) const;
 
+	/** Searches the polygons between Start and End. When MaxIterations is positive the search is stopped after
+	 * expanding that quantity of polygons. Returns whether End was reached */
+	bool FindPolygonPath(const FNavLocation& Start, const FNavLocation& End, TArray<NavNodeRef>& OutPath, FSharedConstNavQueryFilter Filter, int32 MaxIterations = INDEX_NONE) const;
+
+	/** Moves from Start towards Target constrained to the navmesh surface. OutVisited contains the polygons
+	 * crossed, from the start polygon to the polygon of OutLocation. Returns whether Start was valid */
+	bool MoveAlongSurface(const FNavLocation& Start, const FVector& Target, FNavLocation& OutLocation, TArray<NavNodeRef>& OutVisited, FSharedConstNavQueryFilter Filter) const;
+
+	/** Returns an ID that changes every time the area containing the polygon is rebuilt. 0 if the polygon doesn't exist */
+	uint32 GetPolygonBuildID(NavNodeRef NodeRef) const;
+
+	/** Adds a cylinder obstacle. The obstacles carve the navmesh without gathering the geometry again.
+	 * Returns the obstacle ID or INDEX_NONE if the navmesh can't be generated */
+	int32 AddCylinderObstacle(const FVector& Base, float Radius, float Height);
+
+	/** Adds a box obstacle. Returns the obstacle ID or INDEX_NONE if the navmesh can't be generated */
+	int32 AddBoxObstacle(const FBox& Box);
+
+	/** Adds a convex obstacle from the hull Points between MinZ and MaxZ. Returns the obstacle ID or INDEX_NONE if
+	 * the navmesh can't be generated */
+	int32 AddConvexObstacle(const TArray<FVector>& Points, float MinZ, float MaxZ);
+
+	/** Removes the obstacle with the given ID. Returns whether it existed */
+	bool RemoveObstacle(int32 ObstacleID);
+
+	/** Returns the quantity of agent profiles. The first one is the default agent of the navmesh */
+	int32 GetAgentProfilesNum() const { return FMath::Min(AdditionalAgentProfiles.Num() + 1, MaxAgentProfiles); }
+
+	/** Returns the agent profile of the given index. The index 0 is the default agent of the navmesh */
+	FNNAgentProfile GetAgentProfile(int32 ProfileIndex) const;
+
+	/** Returns the index of the smallest profile that fits the agent. The default profile when none fits */
+	int32 GetAgentProfileIndex(const FNavAgentProperties& AgentProperties) const;
+
+	/** Returns the index of the profile used by the agent of the Querier */
+	int32 GetAgentProfileIndex(const UObject* Querier) const;
+
+	/** Returns the filter implementation of the given Filter. Uses the default filter if it's not valid */
+	const FNNQueryFilter& GetQueryFilterImplementation(FSharedConstNavQueryFilter Filter) const;
+
+	// ~ Begin ANavigationData
+	/** Sets the default costs of the new area in the default query filter */
+	virtual void OnNavAreaAdded(const UClass* NavAreaClass, int32 AgentIndex) override;
+	/** The null and default walkable areas have fixed IDs */
+	virtual int32 GetNewAreaID(const UClass* AreaClass) const override;
+	virtual int32 GetMaxSupportedAreas() const override;
+	// ~ End ANavigationData
+
 	/**
 	 * Constructs and sets the generator which generates the navmesh. This function is called at the start of the game
 	 * or editor or whenever the generator needs to be refreshed. It is conditional because sometimes there is no
@@ -118,9 +234,18 @@ public:
 	UPROPERTY(EditAnywhere, Category = "NN|Config")
 	float MaxLedgeHeight = 50.0f;
 
+	/** Other agents built from the same voxelization than the default agent. Each one gets its own polygons.
+	 * At most MaxAgentProfiles - 1 entries are kept */
+	UPROPERTY(EditAnywhere, Category = "NN|Config")
+	TArray<FNNAgentProfile> AdditionalAgentProfiles;
+
 	UPROPERTY(EditAnywhere, Category = "NN|Config")
 	float MinRegionSize = 50.0f;
 
+	/** The algorithm used to divide the walkable spans into regions */
+	UPROPERTY(EditAnywhere, Category = "NN|Config|Region")
+	ENNPartitionMode PartitionMode = ENNPartitionMode::Watershed;
+
 	/** The maximum distance the edge may deviate from the geometry */
 	UPROPERTY(EditAnywhere, Category = "NN|Config|Contour")
 	float ContourDeviationThreshold = 0.5f;
@@ -129,6 +254,13 @@ public:
 	UPROPERTY(EditAnywhere, Category = "NN|Config|Contour")
 	float MaxEdgeLength = 100.0f;
 
+	/** The maximum quantity of nav bounds built at the same time when the navigation is only generated around the
+	 * navigation invokers. The nearest bounds to the invokers are built first.
+	 * The limit is per nav bound: a bound near an invoker is rebuilt whole, it isn't clipped to the invoker radius.
+	 * Split big nav bounds to keep the memory and CPU of each build bounded */
+	UPROPERTY(EditAnywhere, Category = "NN|Config|Runtime", meta = (ClampMin = "1"))
+	int32 MaxSimultaneousInvokerBuilds = 4;
+
 protected:
 	virtual void PostEditChangeChainProperty(FPropertyChangedChainEvent& PropertyChangedEvent) override;
 };
@@ -39,6 +39,10 @@ public:
 	/** Marks all the nav bounds dirty */
 	virtual bool RebuildAll() override;
 
+	/** Rebuilds the navmesh of every generated nav bound from its compressed HeightField, without gathering the
+	 * geometry again. Used when the settings that don't change the voxelization are modified */
+	void RebuildFromCompressedLayers();
+
 	/** Marks the DirtyAreas dirty */
 	virtual void RebuildDirtyAreas(const TArray<FNavigationDirtyArea>& DirtyAreas) override;
 
@@ -50,12 +54,41 @@ public:
 	/** Searches for a path with the parameters provided by the Query */
 	FPathFindingResult FindPath(const FNavAgentProperties& AgentProperties, const FPathFindingQuery& Query) const;
 
+	/** Searches a path for the Query without building it. Fills the length and cost that are not null */
+	ENavigationQueryResult::Type CalcPathLengthAndCost(const FPathFindingQuery& Query, float* OutPathLength, float* OutPathCost) const;
+
+	/** Returns whether a path exists for the Query */
+	bool TestPath(const FPathFindingQuery& Query, int32* NumVisitedNodes) const;
+
 	/** Searches for the nearest point in the navmesh inside the given Extent */
 	bool ProjectPoint(const FVector& Point, FNavLocation& OutLocation, const FVector& Extent, FSharedConstNavQueryFilter Filter, const UObject* Querier) const;
 
 	/** Retrieves the polygon containing the NavLocation. Returns whether it was found */
 	bool GetPolygonFromNavLocation(const FNavLocation& NavLocation, FNNPolygon& OutPolygon) const;
 
+	/** Searches the polygons between Start and End. Both need to be in the same nav bound.
+	 * Returns whether End was reached. When it's not, OutPath ends in the polygon nearest to End */
+	bool FindPolygonPath(const FNavLocation& Start, const FNavLocation& End, TArray<NavNodeRef>& OutPath, FSharedConstNavQueryFilter Filter, int32 MaxIterations) const;
+
+	/** Moves from Start towards Target constrained to the navmesh surface. Returns whether Start was valid */
+	bool MoveAlongSurface(const FNavLocation& Start, const FVector& Target, FNavLocation& OutLocation, TArray<NavNodeRef>& OutVisited, FSharedConstNavQueryFilter Filter) const;
+
+	/** Returns a random point of the navmesh. Polygons are selected weighted by their area */
+	bool GetRandomPoint(FNavLocation& OutLocation, FSharedConstNavQueryFilter Filter, const UObject* Querier) const;
+
+	/** Returns a random point of the navmesh reachable from the Origin inside the Radius */
+	bool GetRandomReachablePointInRadius(const FVector& Origin, float Radius, FNavLocation& OutLocation, FSharedConstNavQueryFilter Filter, const UObject* Querier) const;
+
+	/** Returns the build ID of the area containing the polygon. 0 if the polygon doesn't exist */
+	uint32 GetPolygonBuildID(NavNodeRef NodeRef) const;
+
+	/** Casts a ray along the navmesh surface. Returns whether the ray hit a wall */
+	bool Raycast(const FVector& RayStart, const FVector& RayEnd, FNNRaycastResult& OutResult, FSharedConstNavQueryFilter Filter, const UObject* Querier) const;
+
+	/** Casts a ray along the navmesh surface starting in the polygon of the RayStart. The polygon is looked up near the
+	 * location when the RayStart doesn't have one. Doesn't allocate memory. Returns whether the ray hit a wall */
+	bool Raycast(const FNavLocation& RayStart, const FVector& RayEnd, FNNRaycastResult& OutResult, FSharedConstNavQueryFilter Filter, const UObject* Querier) const;
+
 	/** Returns a FBox with the sum of BBox, BBoxGrowth and the AgentHeight */
 	FBox GrowBoundingBox(const FBox& BBox, bool bUseAgentHeight) const;
 
@@ -65,6 +98,21 @@ public:
 	/** Returns the NavMesh owner */
 	const TWeakObjectPtr<ANNNavMesh>& GetOwner() const { return NavMesh; }
 
+	/** Registers an obstacle that carves the navmesh of the nav bounds it overlaps. Returns its ID */
+	int32 AddObstacle(FNNAreaModifier&& Obstacle);
+
+	/** Removes the obstacle with the given ID. Returns whether it existed */
+	bool RemoveObstacle(int32 ObstacleID);
+
+	/** Fills the obstacles that overlap the Bounds */
+	void GetObstaclesInBounds(const FBox& Bounds, TArray<FNNAreaModifier>& OutObstacles) const;
+
+	/** Returns the voxels of the element inside the nav bound. Nullptr if they were not cached or the hash doesn't match */
+	TSharedPtr<const FNNVoxelCache, ESPMode::ThreadSafe> FindVoxelCache(uint32 NavBoundID, const FObjectKey& ElementKey, uint32 GeometryHash) const;
+
+	/** Replaces the voxel cache of the nav bound. The elements that are no longer in the nav bound are discarded */
+	void UpdateVoxelCache(uint32 NavBoundID, TMap<FObjectKey, FNNVoxelCacheEntry>&& TileVoxelCache) const;
+
 	/** Fills the DebuggingInfo with the result of the FNNAreaGenerators */
 	void GrabDebuggingInfo(FNNNavMeshDebuggingInfo& DebuggingInfo) const;
 
@@ -80,6 +128,24 @@ protected:
 	/** Creates a FNNAreaGenerator for every dirty area and makes them calculates it */
 	void ProcessDirtyAreas();
 
+	/** Marks dirty the nav bounds that get near the navigation invokers and removes the ones they left */
+	void UpdateInvokerAreas();
+
+	/** Removes the data, tasks and caches of the nav bound */
+	void RemoveAreaData(uint32 NavBoundID);
+
+	/** Returns the squared distance from the Box to the nearest navigation invoker */
+	float GetDistanceSquaredToInvokers(const FBox& Box) const;
+
+	/** Returns the nav bound with the given ID. Nullptr if it was removed */
+	const FNavigationBounds* FindNavBound(uint32 NavBoundID) const;
+
+	/** Marks the nav bounds that overlap the obstacle bounds to apply the obstacles */
+	void MarkObstacleDirty(const FBox& ObstacleBounds);
+
+	/** Rebuilds the navmesh of the areas with obstacle or agent changes from their compressed HeightField */
+	void ProcessLayerDirtyAreas();
+
 	/** Returns a new FNNAreaGenerator */
 	FNNAreaGenerator* CreateAreaGenerator(const FNavigationBounds& DirtyArea);
 
@@ -89,8 +155,18 @@ protected:
 	/** Retrieves the bound ID which contains the Start vector. Returns whether the nav bound was found. */
 	bool GetNavBoundIDForLocation(const FVector& Start, int32& OutBoundID) const;
 
-	/** Returns an unique ID for the given NavBound and PolygonIndex */
-	static NavNodeRef GeneratePolygonNodeRef(int32 NavBoundID, int32 PolygonIndex);
+	/** Returns the data of the bound that contains the Location. Nullptr if it was not generated yet */
+	FNNAreaGeneratorData* GetGeneratorDataForLocation(const FVector& Location) const;
+
+	/** Returns the agent profile used by the Query. Uses the agent of the querier when the query doesn't have one */
+	int32 GetQueryProfileIndex(const FPathFindingQuery& Query) const;
+
+	/** Returns an unique ID for the given NavBound, agent profile and PolygonIndex */
+	static NavNodeRef GeneratePolygonNodeRef(uint32 NavBoundID, int32 ProfileIndex, int32 PolygonIndex);
+
+	/** Returns the data of the bound that contains the polygon of the NodeRef. Fills the polygon index and the
+	 * agent profile that built it */
+	FNNAreaGeneratorData* GetGeneratorDataFromNodeRef(NavNodeRef NodeRef, int32& OutPolygonIndex, int32& OutProfileIndex) const;
 
 private:
 	/** The NavMesh owner of this generator */
@@ -102,6 +178,21 @@ private:
 	/** The areas that need to be calculated next tick */
 	TArray<uint32> DirtyAreas;
 
+	/** The areas whose obstacles or agents changed. They only need to rebuild the navmesh from the compressed HeightField */
+	TArray<uint32> LayerDirtyAreas;
+
+	/** The obstacles registered at runtime by their ID */
+	TMap<int32, FNNAreaModifier> Obstacles;
+
+	/** The ID given to the next obstacle */
+	int32 NextObstacleID = 1;
+
+	/** Whether only the nav bounds near the navigation invokers are generated */
+	bool bGenerateAroundInvokers = false;
+
+	/** The nav bounds inside the radius of any navigation invoker */
+	TSet<uint32> InvokerAreas;
+
 	/** The saved data for each area */
 	TMap<uint32, FNNAreaGeneratorData*> GeneratorsData;
 
@@ -111,10 +202,19 @@ private:
 	/** The tasks that need to be canceled and deleted */
 	TArray<FAsyncTask<FNNAreaGenerator>*> CanceledTasks;
 
+	/** The voxels of each navigation element for every nav bound. Updated from the FNNAreaGenerators worker threads */
+	mutable TMap<uint32, TMap<FObjectKey, FNNVoxelCacheEntry>> VoxelCache;
+
+	/** Guards the VoxelCache */
+	mutable FCriticalSection VoxelCacheLock;
+
 	/** Used to grow generic element bounds to match this generator's properties
 	 *	(most notably Config.borderSize) */
 	FVector BBoxGrowth = FVector::ZeroVector;
 
 	/** The time that a task needs to wait before starting */
 	float WaitTimeToStartWorkingTask = 1.0f;
+
+	/** The build ID given to the next area generated */
+	uint32 NextBuildID = 1;
 };
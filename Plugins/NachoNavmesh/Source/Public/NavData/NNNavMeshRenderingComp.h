@@ -8,7 +8,7 @@
 
 #include "NNNavMeshRenderingComp.generated.h"
 
-struct FNNRawGeometryElement;
+struct FNNRawGeometry;
 struct FNNRegion;
 
 class ANNNavMesh;
@@ -144,7 +144,7 @@ struct FNNNavMeshDebuggingInfo
 	};
 
 	/** The geometry vertices */
-	TArray<FNNRawGeometryElement> RawGeometryToDraw;
+	TArray<FNNRawGeometry> RawGeometryToDraw;
 	/** The HeightField spans represented as boxes */
 	TArray<HeightFieldDebugBox> HeightField;
 	/** The OpenHeightField spans represented as boxes */
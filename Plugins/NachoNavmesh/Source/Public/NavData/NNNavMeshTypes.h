@@ -0,0 +1,23 @@
+﻿#pragma once
+
+/** Area identifiers shared by every step of the navmesh generation */
+namespace NNNavAreas
+{
+	/** The maximum quantity of areas the navmesh supports */
+	constexpr int32 MaxAreas = 64;
+
+	/** Area that can not be walked. Spans stamped with it are discarded */
+	constexpr uint8 NullAreaID = 0;
+
+	/** Area given to the geometry that is not affected by any modifier */
+	constexpr uint8 DefaultAreaID = MaxAreas - 1;
+
+	/** Flags given to the polygons when their area does not provide any */
+	constexpr uint16 DefaultAreaFlags = 1;
+
+	/** The maximum quantity of vertexes a polygon of the navmesh can have */
+	constexpr int32 MaxPolygonVertexes = 5;
+
+	/** Travel cost used for the areas that are excluded by a filter */
+	constexpr float UnwalkableCost = TNumericLimits<float>::Max();
+}
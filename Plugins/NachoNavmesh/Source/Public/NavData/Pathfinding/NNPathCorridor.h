@@ -0,0 +1,63 @@
+﻿#pragma once
+
+// UE Includes
+#include "NavigationSystemTypes.h"
+
+class ANNNavMesh;
+
+/** A polygon of the corridor and the build of the area it belonged to when it was added */
+struct FNNCorridorPolygon
+{
+	FNNCorridorPolygon(NavNodeRef InNodeRef, uint32 InBuildID) : NodeRef(InNodeRef), BuildID(InBuildID) {}
+
+	NavNodeRef NodeRef = INVALID_NAVNODEREF;
+	uint32 BuildID = 0;
+};
+
+/** Keeps the polygons an agent needs to cross to reach its target.
+ * The agent moves along the corridor and it is trimmed as the agent advances. When an area is rebuilt only the
+ * invalidated part of the corridor is searched again */
+class NACHONAVMESH_API FNNPathCorridor
+{
+public:
+	/** Clears the corridor and places the agent in the given Location */
+	void Reset(const ANNNavMesh& NavMesh, const FNavLocation& Location);
+
+	/** Searches the corridor from the current position to the Target. Returns whether the target was reached.
+	 * When it's not, the corridor ends in the polygon nearest to the target */
+	bool SetTarget(const ANNNavMesh& NavMesh, const FVector& InTarget, FSharedConstNavQueryFilter Filter);
+
+	/** Moves the agent position along the navmesh surface and trims the polygons left behind */
+	bool MovePosition(const ANNNavMesh& NavMesh, const FVector& NewPosition, FSharedConstNavQueryFilter Filter);
+
+	/** Searches for a shorter route at the start of the corridor expanding at most MaxIterations polygons */
+	bool OptimizePathTopology(const ANNNavMesh& NavMesh, FSharedConstNavQueryFilter Filter, int32 MaxIterations = 32);
+
+	/** Checks that the first MaxLookAhead polygons were not invalidated by a rebuild */
+	bool IsValid(const ANNNavMesh& NavMesh, int32 MaxLookAhead) const;
+
+	/** Keeps the valid start of the corridor and searches again from the first invalidated polygon.
+	 * The search expands at most MaxIterations polygons. Returns whether the target was reached */
+	bool Replan(const ANNNavMesh& NavMesh, FSharedConstNavQueryFilter Filter, int32 MaxIterations = 256);
+
+	const FVector& GetPosition() const { return Position; }
+	const FVector& GetTarget() const { return Target; }
+	const TArray<FNNCorridorPolygon>& GetPath() const { return Path; }
+	NavNodeRef GetFirstPolygon() const { return Path.Num() > 0 ? Path[0].NodeRef : INVALID_NAVNODEREF; }
+	NavNodeRef GetLastPolygon() const { return Path.Num() > 0 ? Path.Last().NodeRef : INVALID_NAVNODEREF; }
+
+protected:
+	/** Replaces the start of the corridor with the polygons visited while moving the agent */
+	void MergeCorridorStartMoved(const ANNNavMesh& NavMesh, const TArray<NavNodeRef>& Visited);
+
+	/** Replaces the start of the corridor with a shortcut that rejoins it */
+	bool MergeCorridorStartShortcut(const ANNNavMesh& NavMesh, const TArray<NavNodeRef>& Shortcut);
+
+	/** Appends the polygons to the corridor with the current build ID of their area */
+	void AppendPolygons(const ANNNavMesh& NavMesh, const TArray<NavNodeRef>& Polygons);
+
+private:
+	FVector Position = FVector::ZeroVector;
+	FVector Target = FVector::ZeroVector;
+	TArray<FNNCorridorPolygon> Path;
+};
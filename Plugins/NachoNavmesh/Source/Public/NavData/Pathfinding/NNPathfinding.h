@@ -4,15 +4,27 @@
 
 #include "NavData/Voxelization/OpenHeightFieldGenerator.h"
 
+class FNNQueryFilter;
 struct FNNAreaGeneratorData;
 struct FNNPolygonMesh;
 
+/** Connection between two nodes of the graph */
+struct FNNNodeEdge
+{
+	FNNNodeEdge(float InCost) : Cost(InCost) {}
+
+	/** The cost of traversing the edge without taking into account the areas */
+	float Cost = 0.0f;
+	/** The polygons that share the edge. The second one is INDEX_NONE in the navmesh borders */
+	int32 Polygons[2] = {INDEX_NONE, INDEX_NONE};
+};
+
 struct FNNNode
 {
 	FNNNode(const FVector& InPosition) : Position(InPosition) {}
 
 	FVector Position;
-	TMap<int32, float> Neighbours;
+	TMap<int32, FNNNodeEdge> Neighbours;
 	/** To which polygons this node belongs */
 	TArray<int32> PolygonIndexes;
 };
@@ -22,6 +34,48 @@ struct FNNGraph
 	TArray<FNNNode> Nodes;
 };
 
+/** The result of a raycast along the navmesh surface */
+struct FNNRaycastResult
+{
+	/** The maximum quantity of polygons stored in the corridor */
+	static constexpr int32 MaxCorridorPolygons = 64;
+
+	/** The polygons visited by the ray, in order */
+	NavNodeRef CorridorPolygons[MaxCorridorPolygons];
+	int32 CorridorPolygonsNum = 0;
+
+	/** Normalized distance along the ray where the hit happened. Max float if nothing was hit */
+	float HitTime = TNumericLimits<float>::Max();
+
+	/** Where the ray stopped. The end of the ray if nothing was hit */
+	FVector HitLocation = FVector::ZeroVector;
+
+	/** The normal of the hit wall, pointing towards the inside of the navmesh */
+	FVector HitNormal = FVector::ZeroVector;
+
+	bool HasHit() const { return HitTime != TNumericLimits<float>::Max(); }
+};
+
+/** The state of a finished A* search. Allows retrieving the cost and length without building the path */
+struct FNNPathSearch
+{
+	/** The projected start and goal of the search */
+	FNavLocation Start;
+	FNavLocation Goal;
+
+	/** The area cost multipliers of the polygons containing the start and the goal */
+	float StartAreaCost = 1.0f;
+	float GoalAreaCost = 1.0f;
+
+	/** The node from where each visited node was reached */
+	TMap<int32, int32> CameFrom;
+	/** The cost of reaching each visited node */
+	TMap<int32, float> CostSoFar;
+
+	/** Quantity of nodes expanded by the search */
+	int32 VisitedNodes = 0;
+};
+
 class FNNPathfinding
 {
 public:
@@ -31,15 +85,74 @@ public:
 	/** Created a Graph for pathfinding with the given PolygonMesh */
 	void CreateGraph(const FNNPolygonMesh& PolygonMesh, FNNGraph& OutGraph) const;
 
-	/** Uses A* to find a path between the StartLocation and EndLocation of the given Query */
-	FNavPathSharedPtr FindPath(const FNNGraph& Graph, const FNNPolygonMesh& PolygonMesh, const FNavAgentProperties& AgentProperties, const
-	                           FPathFindingQuery& Query) const;
+	/** Walks the polygons from StartPolygonIndex crossing the edges shared with other polygons until the ray reaches
+	 * a wall or the End. Start and End are in world space. Returns whether a wall was hit */
+	bool Raycast(const FNNPolygonMesh& PolygonMesh, int32 StartPolygonIndex, const FVector& Start, const FVector& End,
+		const FNNQueryFilter& Filter, FNNRaycastResult& OutResult) const;
+
+	/** Uses A* over the polygons adjacency to find the polygons between StartPolygonIndex and EndPolygonIndex.
+	 * When MaxIterations is positive the search stops after expanding that quantity of polygons.
+	 * OutPath is filled up to the polygon nearest to the end. Returns whether the end polygon was reached */
+	bool FindPolygonPath(const FNNPolygonMesh& PolygonMesh, int32 StartPolygonIndex, int32 EndPolygonIndex,
+		const FNNQueryFilter& Filter, int32 MaxIterations, TArray<int32>& OutPath) const;
+
+	/** Moves from Start towards End constrained to the navmesh surface. Only the polygons near the movement are visited.
+	 * Start and End are in world space. OutVisited contains the polygons from the start one to the one containing OutLocation */
+	void MoveAlongSurface(const FNNPolygonMesh& PolygonMesh, int32 StartPolygonIndex, const FVector& Start,
+		const FVector& End, const FNNQueryFilter& Filter, FVector& OutLocation, TArray<int32>& OutVisited) const;
+
+	/** Returns the polygon that contains the given accumulated Area. Selecting a random area between 0 and the total
+	 * area of the mesh returns polygons weighted by their area */
+	static int32 SelectPolygonByArea(const FNNPolygonMesh& PolygonMesh, float Area);
+
+	/** Returns a uniformly distributed random point inside the polygon in world space */
+	FVector GetRandomPointInPolygon(const FNNPolygonMesh& PolygonMesh, int32 PolygonIndex) const;
+
+	/** Visits the polygons reachable from StartPolygonIndex whose edges are inside the Radius around the Origin.
+	 * Returns one of them randomly weighted by its area */
+	int32 GetRandomReachablePolygon(const FNNPolygonMesh& PolygonMesh, int32 StartPolygonIndex, const FVector& Origin,
+		float Radius, const FNNQueryFilter& Filter) const;
+
+	/** Returns the index of the polygon nearest to the Point that passes the Filter and is inside the Extent around it.
+	 * Point and OutLocation are in world space. Returns INDEX_NONE if there is none. Doesn't allocate memory */
+	int32 FindNearestPolygon(const FNNPolygonMesh& PolygonMesh, const FVector& Point, const FVector& Extent,
+		const FNNQueryFilter& Filter, FVector& OutLocation, float& OutDistanceSqr) const;
+
+	/** Uses A* to find a path between the StartLocation and EndLocation. Both are projected on the PolygonMesh */
+	FNavPathSharedPtr FindPath(const FNNGraph& Graph, const FNNPolygonMesh& PolygonMesh, const FVector& StartLocation,
+		const FVector& EndLocation, const FVector& Extent, const FNNQueryFilter& Filter) const;
+
+	/** Runs the A* between the StartLocation and EndLocation without building the path. Both are projected on the
+	 * PolygonMesh so the search uses the same agent profile than the projection.
+	 * Returns whether the goal was reached. Fails without searching when they are in different components */
+	bool SearchPath(const FNNGraph& Graph, const FNNPolygonMesh& PolygonMesh, const FVector& StartLocation,
+		const FVector& EndLocation, const FVector& Extent, const FNNQueryFilter& Filter, FNNPathSearch& OutSearch) const;
+
+	/** Returns the cost of the path found by a successful Search. Each segment adds its world length multiplied by
+	 * the cost of the area it crosses */
+	float GetPathCost(const FNNGraph& Graph, const FNNPolygonMesh& PolygonMesh, const FNNQueryFilter& Filter, const FNNPathSearch& Search) const;
+
+	/** Returns the world length of the path found by a successful Search */
+	float GetPathLength(const FNNGraph& Graph, const FNNPathSearch& Search) const;
 
 protected:
-	/** Adds a new neighbours to the Node */
-	void AddNodeNeighbour(FNNNode& Node, const FVector& Neighbour, int32 NeighbourIndex) const;
+	/** Adds a new neighbours to the Node. PolygonIndex is the polygon that contains the edge */
+	void AddNodeNeighbour(FNNNode& Node, const FVector& Neighbour, int32 NeighbourIndex, int32 PolygonIndex) const;
+
+	/** Returns the cost of traversing the Edge through the cheapest polygon that passes the Filter.
+	 * Returns a negative value if the edge can't be traversed */
+	static float GetEdgeCost(const FNNNodeEdge& Edge, const FNNPolygonMesh& PolygonMesh, const FNNQueryFilter& Filter);
+
+	/** Returns the cost multiplier of the cheapest polygon of the Edge that passes the Filter.
+	 * Returns a negative value if the edge can't be traversed */
+	static float GetEdgeAreaCost(const FNNNodeEdge& Edge, const FNNPolygonMesh& PolygonMesh, const FNNQueryFilter& Filter);
+
+	/** Returns the cost of moving between Lhs and Rhs before applying the area costs. Linear so the area costs scale
+	 * proportionally with the distance */
+	static float CalculateDistanceCost(const FVector& Lhs, const FVector& Rhs);
 
-	/** Calculates the distance squared between Lhs and Rhs. Used for the A* algorithm */
+	/** Calculates the distance between Lhs and Rhs. Used for the A* algorithm. Measured in the same space as the
+	 * edge costs so it doesn't overestimate the remaining cost */
 	static float CalculateHeuristic(const FVector& Lhs, const FVector& Rhs);
 
 	/** Transforms the Position in OpenHeightField space into world space */
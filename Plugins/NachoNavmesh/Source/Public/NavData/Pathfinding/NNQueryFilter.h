@@ -0,0 +1,66 @@
+﻿#pragma once
+
+// UE Includes
+#include "NavFilters/NavigationQueryFilter.h"
+
+// NN Includes
+#include "NavData/NNNavMeshTypes.h"
+
+struct FNNPolygon;
+
+/** Filter applied to the navmesh queries. The costs are stored in flat tables indexed by the area ID */
+class NACHONAVMESH_API FNNQueryFilter : public INavigationQueryFilterInterface
+{
+public:
+	FNNQueryFilter() { FNNQueryFilter::Reset(); }
+
+	// ~ Begin INavigationQueryFilterInterface
+	virtual void Reset() override;
+	virtual void SetAreaCost(uint8 AreaType, float Cost) override;
+	virtual void SetFixedAreaEnteringCost(uint8 AreaType, float Cost) override;
+	virtual void SetExcludedArea(uint8 AreaType) override;
+	virtual void SetAllAreaCosts(const float* CostArray, const int32 Count) override;
+	virtual void GetAllAreaCosts(float* CostArray, float* FixedCostArray, const int32 Count) const override;
+	virtual void SetBacktrackingEnabled(const bool bBacktracking) override { bIsBacktracking = bBacktracking; }
+	virtual bool IsBacktrackingEnabled() const override { return bIsBacktracking; }
+	virtual float GetHeuristicScale() const override { return HeuristicScale; }
+	virtual bool IsEqual(const INavigationQueryFilterInterface* Other) const override;
+	virtual void SetIncludeFlags(uint16 Flags) override { IncludeFlags = Flags; }
+	virtual uint16 GetIncludeFlags() const override { return IncludeFlags; }
+	virtual void SetExcludeFlags(uint16 Flags) override { ExcludeFlags = Flags; }
+	virtual uint16 GetExcludeFlags() const override { return ExcludeFlags; }
+	virtual INavigationQueryFilterInterface* CreateCopy() const override { return new FNNQueryFilter(*this); }
+	// ~ End INavigationQueryFilterInterface
+
+	/** Returns whether a polygon with the given area and flags can be traversed */
+	FORCEINLINE bool PassFilter(uint8 AreaID, uint16 Flags) const
+	{
+		return (Flags & IncludeFlags) != 0 && (Flags & ExcludeFlags) == 0 && AreaCosts[AreaID] < NNNavAreas::UnwalkableCost;
+	}
+
+	/** Returns whether the Polygon can be traversed */
+	bool PassFilter(const FNNPolygon& Polygon) const;
+
+	/** Returns the travel cost multiplier of the area */
+	FORCEINLINE float GetAreaCost(uint8 AreaID) const { return AreaCosts[AreaID]; }
+
+	/** Returns the cost of entering the area */
+	FORCEINLINE float GetFixedAreaEnteringCost(uint8 AreaID) const { return AreaFixedCosts[AreaID]; }
+
+private:
+	/** Travel cost multiplier for each area */
+	float AreaCosts[NNNavAreas::MaxAreas];
+
+	/** Cost added when entering each area */
+	float AreaFixedCosts[NNNavAreas::MaxAreas];
+
+	float HeuristicScale = 1.0f;
+
+	/** A polygon needs to have at least one of these flags to pass the filter */
+	uint16 IncludeFlags = 0;
+
+	/** A polygon with any of these flags will not pass the filter */
+	uint16 ExcludeFlags = 0;
+
+	bool bIsBacktracking = false;
+};
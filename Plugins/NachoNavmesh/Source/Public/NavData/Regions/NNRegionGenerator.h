@@ -7,14 +7,35 @@ struct FNNRegion;
 class FNNRegionGenerator
 {
 public:
+	/** Watershed partitioning. Floods the spans starting from the ones furthest from the borders */
 	void CreateRegions(FNNOpenHeightField& OpenHeightField, float MinRegionSize, int32 TraversableAreaBorderSize) const;
 
+	/** Sweeps the rows of spans joining each run of spans with the region of the previous row.
+	 * Much faster than the watershed but creates long and thin regions */
+	void CreateMonotoneRegions(FNNOpenHeightField& OpenHeightField, float MinRegionSize, int32 TraversableAreaBorderSize) const;
+
+	/** Creates monotone regions and merges the connected ones that don't overlap vertically.
+	 * Keeps the floors of multi-floor areas in different regions */
+	void CreateLayerRegions(FNNOpenHeightField& OpenHeightField, float MinRegionSize, int32 TraversableAreaBorderSize) const;
+
 protected:
-	void FilterSmallRegions(TArray<FNNRegion>& Regions, int32 MinSpansForRegions) const;
+	/** Removes the small regions and fixes the borders with the null region */
+	void FilterAndCleanRegions(FNNOpenHeightField& OpenHeightField, float MinRegionSize) const;
+
+	/** Assigns a monotone region to every span at least MinDist away from the borders.
+	 * The ID of every region is its index in OutRegions */
+	void SweepMonotoneRegions(FNNOpenHeightField& OpenHeightField, int32 MinDist, TArray<FNNRegion>& OutRegions) const;
+
+	/** Merges the connected regions of the same area that don't share any column of spans */
+	void MergeRegionLayers(FNNOpenHeightField& OpenHeightField) const;
+
+	/** Merges the regions with less than MinSpansForRegions spans into their smallest neighbour of the same area.
+	 * Removes them if they don't have any. The remaining regions are renumbered from 0 */
+	void FilterSmallRegions(FNNOpenHeightField& OpenHeightField, int32 MinSpansForRegions) const;
 
 	bool FloodNewRegion(FNNOpenSpan* RootSpan, int32 FillToDistance, TArray<FNNOpenSpan*>& WorkingStack, FNNRegion& NewRegion) const;
 
 	/** Tries to find the most appropriate regions to attach spans to. Any span successfully assigned a region will
 	 * be set to null in the Spans array */
-	void ExpandRegions(TMap<int32, FNNRegion>& RegionsByID, TArray<FNNOpenSpan*>& Spans, int32 MaxIterations) const;
+	void ExpandRegions(TArray<FNNOpenSpan*>& Spans, int32 MaxIterations) const;
 };
@@ -1,7 +1,15 @@
 ﻿#pragma once
 
+// UE Includes
+#include "Misc/MemStack.h"
+
+// NN Includes
+#include "NavData/NNNavMeshTypes.h"
+
 struct FNNAreaGeneratorData;
-struct FNNRawGeometryElement;
+struct FNNAreaModifier;
+struct FNNRawGeometry;
+struct FNNRawGeometryRange;
 
 /** Represents a cell that collides with a polygon */
 struct Span
@@ -14,11 +22,13 @@ struct Span
 	Span(int32 InMaxSpanHeight, int32 InMinSpanHeight, bool bInWalkable)
 		: MaxSpanHeight(InMaxSpanHeight), MinSpanHeight(InMinSpanHeight), bWalkable(bInWalkable) {}
 	Span (Span&& InSpan) noexcept
-		: MaxSpanHeight(InSpan.MaxSpanHeight), MinSpanHeight(InSpan.MinSpanHeight), bWalkable(InSpan.bWalkable), NextSpan(MoveTemp(InSpan.NextSpan)) {}
+		: MaxSpanHeight(InSpan.MaxSpanHeight), MinSpanHeight(InSpan.MinSpanHeight), bWalkable(InSpan.bWalkable), AreaID(InSpan.AreaID), NextSpan(MoveTemp(InSpan.NextSpan)) {}
 
 	int32 MaxSpanHeight = INDEX_NONE;
 	int32 MinSpanHeight = INDEX_NONE;
 	bool bWalkable = false;
+	/** The area of the top of the span. Set by the nav modifiers */
+	uint8 AreaID = NNNavAreas::DefaultAreaID;
 	TUniquePtr<Span> NextSpan = nullptr;
 
 	/** Returns a readable representation of this Span */
@@ -29,6 +39,7 @@ struct Span
 		MaxSpanHeight = InSpan.MaxSpanHeight;
 		MinSpanHeight = InSpan.MinSpanHeight;
 		bWalkable = InSpan.bWalkable;
+		AreaID = InSpan.AreaID;
 		if (InSpan.NextSpan)
 		{
 			NextSpan = MakeUnique<Span>(*InSpan.NextSpan.Release());
@@ -58,37 +69,116 @@ struct FNNHeightField
 	TArray<TUniquePtr<Span>> Spans; // 2D array, UnitsWidth * UnitsDepth
 };
 
+/** A FNNHeightField compressed with run length encoding. Consecutive columns with the same spans are stored once
+ * and the heights are stored as variable length deltas */
+struct FNNCompressedHeightField
+{
+	/** Compresses the spans and the dimensions of the HeightField */
+	void Compress(const FNNHeightField& HeightField);
+
+	/** Rebuilds the compressed HeightField into OutHeightField */
+	void Decompress(FNNHeightField& OutHeightField) const;
+
+	bool IsValid() const { return Data.Num() > 0; }
+
+	/** The dimensions of the compressed HeightField */
+	int32 UnitsWidth = 0;
+	int32 UnitsHeight = 0;
+	int32 UnitsDepth = 0;
+	FVector MinPoint = FVector::ZeroVector;
+	FVector MaxPoint = FVector::ZeroVector;
+	float CellSize = 0.0f;
+	float CellHeight = 0.0f;
+
+	/** The encoded columns. Each run is the quantity of columns, the quantity of spans and the spans */
+	TArray<uint8> Data;
+};
+
+/** The spans rasterized from the geometry of a single navigation element inside a tile */
+struct FNNVoxelCache
+{
+	struct FCachedSpan
+	{
+		FCachedSpan(int32 InColumnIndex, const Span& InSpan)
+			: ColumnIndex(InColumnIndex), MinSpanHeight(InSpan.MinSpanHeight), MaxSpanHeight(InSpan.MaxSpanHeight), bWalkable(InSpan.bWalkable) {}
+
+		/** The index of the column in the FNNHeightField::Spans of the whole tile */
+		int32 ColumnIndex = INDEX_NONE;
+		int32 MinSpanHeight = INDEX_NONE;
+		int32 MaxSpanHeight = INDEX_NONE;
+		bool bWalkable = false;
+	};
+
+	/** The spans of every column, from bottom to top */
+	TArray<FCachedSpan> Spans;
+};
+
 /** Generates a HeightField withing given bounds */
 class FHeightFieldGenerator
 {
 public:
 	FHeightFieldGenerator(FNNAreaGeneratorData& InAreaGeneratorData) : AreaGeneratorData(InAreaGeneratorData) {}
 
-	/** Creates a new HeightField with the given parameters */
-	void InitializeHeightField(FNNHeightField& OutHeightField, TArray<FNNRawGeometryElement>& RawGeometry,
-		const FVector& BoundMinPoint, const  FVector& BoundMaxPoint, float CellSize, float CellHeight,
-		float WalkableAngle, float AgentHeight, float MinLedgeHeight) const;
+	/** Creates a new empty HeightField with the given parameters. It doesn't depend on the agent size so it can be
+	 * shared by every agent profile */
+	void InitializeHeightField(FNNHeightField& OutHeightField, const FVector& BoundMinPoint, const  FVector& BoundMaxPoint,
+		float CellSize, float CellHeight) const;
+
+	/** Rasterizes the triangles and instanced meshes of the RawGeometry inside the Range */
+	void RasterizeGeometry(FNNHeightField& HeightField, const FNNRawGeometry& RawGeometry, const FNNRawGeometryRange& Range,
+		float WalkableAngle) const;
+
+	/** Copies the spans of the HeightField into the VoxelCache. The HeightField covers part of the tile starting at
+	 * the ColumnOffset. The cached columns are indexed in the tile, which is TileUnitsWidth columns wide */
+	static void CacheSpans(const FNNHeightField& HeightField, const FIntPoint& ColumnOffset, int32 TileUnitsWidth,
+		FNNVoxelCache& OutVoxelCache);
+
+	/** Adds the cached spans into the HeightField, combining them with the spans already there */
+	void MergeVoxelCache(FNNHeightField& HeightField, const FNNVoxelCache& VoxelCache) const;
+
+	/** Stamps the area of the modifiers in the walkable spans that are inside them */
+	void MarkAreaModifiers(FNNHeightField& HeightField, const TArray<FNNAreaModifier>& AreaModifiers) const;
+
+	/** Fills whether an agent of the given size can stand on each span. The spans are indexed column by column,
+	 * from bottom to top, starting at the OutColumnStarts of its column. Doesn't modify the HeightField */
+	static void FilterWalkableSpans(const FNNHeightField& HeightField, float AgentHeight, float MinLedgeHeight,
+		TArray<bool>& OutWalkableSpans, TArray<int32>& OutColumnStarts);
 
 protected:
 	/** Creates a 2D bounding box that contains the Polygon */
 	static bool Generate2DBoundingBoxForGeometry(TArray<FVector>& Polygon, FVector& OutMinimumPoint, FVector& OutMaximumPoint, const FBox& BoundBox);
 
+	/** Adds a span in every cell of the HeightField that intersects with the triangle Polygon */
+	void RasterizeTriangle(FNNHeightField& HeightField, TArray<FVector>& Polygon, bool bWalkable) const;
+
 	/** Attaches the new span into the CurrentSpan */
 	void AttachNewSpan(Span* CurrentSpan, Span* NewSpan) const;
 
 	/** Combines the two Spans */
 	Span* CombineSpans(Span* LowerSpan, Span* HigherSpan) const;
 
-	/** Returns whether the Polygon provided is walkable */
-	bool IsPolygonWalkable(const FVector& PolygonNormal, float MaxWalkableRadians) const;
+	/** Returns whether the triangle is flat enough to be walked */
+	static FORCEINLINE bool IsTriangleWalkable(const FVector& FirstPoint, const FVector& SecondPoint, const FVector& ThirdPoint, float WalkableCosine)
+	{
+		// Same winding than FNNNavMeshHelper::CalculatePolygonNormal. Compares against the length instead of normalizing
+		const FVector Normal = FVector::CrossProduct(FirstPoint - SecondPoint, ThirdPoint - FirstPoint);
+		return Normal.Z > WalkableCosine * Normal.Size();
+	}
+
+	/** Fills whether each triangle of the RawGeometry inside the Range is flat enough to be walked */
+	void ClassifyWalkableTriangles(const FNNRawGeometry& RawGeometry, const FNNRawGeometryRange& Range, float WalkableCosine,
+		TArray<bool, TMemStackAllocator<>>& OutWalkableTriangles) const;
+
+	/** Marks as not walkable the spans without enough space above them for the agent */
+	static void FilterLowHeightSpans(const FNNHeightField& HeightField, float AgentHeight, const TArray<int32>& ColumnStarts,
+		TArray<bool>& WalkableSpans);
 
-	/** Returns whether the span provided is walkable */
-	bool IsSpanWalkable(const FNNHeightField& HeightField, int32 XIndex, int32 YIndex, const Span* InSpan,
-		float AgentHeight, float MinLedgeHeight) const;
+	/** Marks as not walkable the spans with a neighbour that is more than MinLedgeHeight above or below them */
+	static void FilterLedgeSpans(const FNNHeightField& HeightField, float MinLedgeHeight, const TArray<int32>& ColumnStarts,
+		TArray<bool>& WalkableSpans);
 
-	/** Returns the neighbours of the Span provided */
-	TArray<Span*> GetSpanNeighbours(const FNNHeightField& HeightField, int32 XIndex, int32 YIndex,
-		const Span* CurrentSpan) const;
+	/** Returns the span of the column whose floor is nearest to the Height. Nullptr if the column is empty */
+	static const Span* GetNearestSpanInColumn(const FNNHeightField& HeightField, int32 XIndex, int32 YIndex, int32 Height);
 private:
 	/** Data from the AreaGenerator that created this class. Used to debug points and texts in the world */
 	FNNAreaGeneratorData& AreaGeneratorData;
@@ -1,7 +1,11 @@
 ﻿#pragma once
 
+// NN Includes
+#include "NavData/NNNavMeshTypes.h"
+
 struct FNNOpenHeightField;
 struct FNNAreaGeneratorData;
+struct FNNAreaModifier;
 struct FNNContour;
 struct FNNHeightField;
 struct FNNRegion;
@@ -17,8 +21,8 @@ ENUM_CLASS_FLAGS(ENNOpenSpanFlags);
 /** A cell representing a open space */
 struct FNNOpenSpan
 {
-	FNNOpenSpan(int32 InMinHeight, int32 InMaxHeight, int32 InX, int32 InY)
-		: MinHeight(InMinHeight), MaxHeight(InMaxHeight), X(InX), Y(InY)
+	FNNOpenSpan(int32 InMinHeight, int32 InMaxHeight, int32 InX, int32 InY, uint8 InAreaID = NNNavAreas::DefaultAreaID)
+		: MinHeight(InMinHeight), MaxHeight(InMaxHeight), X(InX), Y(InY), AreaID(InAreaID)
 	{
 		Neighbours.Init(nullptr, 4);
 	}
@@ -30,6 +34,8 @@ struct FNNOpenSpan
 	int32 X = INDEX_NONE;
 	/** Y coordinate in the Spans array of the FNNOpenHeightField. Width */
 	int32 Y = INDEX_NONE;
+	/** Position of the span in the iteration order of the FNNOpenHeightField. Used to index flat per span arrays */
+	int32 SpanIndex = INDEX_NONE;
 	/** The OpenSpan in top of this one */
 	TUniquePtr<FNNOpenSpan> NextOpenSpan = nullptr;
 	/** The distance of this span to an edge */
@@ -38,6 +44,8 @@ struct FNNOpenSpan
 	int32 DistanceToCore = INDEX_NONE;
 	/** The region identifier this span belongs to */
 	int32 RegionID = INDEX_NONE;
+	/** The area of the floor of the span */
+	uint8 AreaID = NNNavAreas::DefaultAreaID;
 	int32 Flags = ENNOpenSpanFlags::None;
 	/** Each bit represents whether the OpenSpan is connected to another region
 	* 0 represents the neighbour is in the same region, 1 is that is not in the same region
@@ -73,10 +81,14 @@ struct FNNOpenHeightField
 	int32 AmountOfSpans = 0;
 	TArray<TUniquePtr<FNNOpenSpan>> Spans;
 
-	/** The regions that this OpenHeightFieldContains */
+	/** The regions that this OpenHeightFieldContains. The ID of each region is its index in the array */
 	TArray<FNNRegion> Regions;
 
-	int32 GetRegionIndexByID(int32 ID) const;
+	/** Adds an empty region with the next ID of this build */
+	FNNRegion& AddRegion();
+
+	/** Recalculates the spans count, bounds and neighbours of every region in a single pass over the spans */
+	void UpdateRegionStats();
 	int32 GetSpanMaxEdgeDistance() const;
 	int32 GetSpanMinEdgeDistance() const;
 
@@ -122,9 +134,14 @@ struct FNNRegion
 {
 	FNNRegion(int32 InID) : ID(InID) {}
 	int32 ID = INDEX_NONE;
-	// TODO (ignacio) check if we can remove this array
-	TArray<FNNOpenSpan*> Spans;
-	static FNNRegion GenerateNewRegion();
+	/** The area shared by all the spans of the region */
+	uint8 AreaID = NNNavAreas::DefaultAreaID;
+	/** Quantity of spans in the region */
+	int32 SpansCount = 0;
+	/** The X and Y coordinates covered by the spans. The max is exclusive */
+	FIntRect Bounds = FIntRect(TNumericLimits<int32>::Max(), TNumericLimits<int32>::Max(), TNumericLimits<int32>::Min(), TNumericLimits<int32>::Min());
+	/** The regions with spans next to the spans of this region */
+	TArray<int32> Neighbours;
 };
 
 class FOpenHeightFieldGenerator
@@ -135,11 +152,21 @@ public:
 	/** Generates a HeightField with the open spaces */
 	void GenerateOpenHeightField(FNNOpenHeightField& OutOpenHeightField, const FNNHeightField& SolidHeightField, float MaxLedgeHeight, float AgentHeight) const;
 
+	/** Removes the spans closer than ErodeRadius cells to a border so the agent fits in all the remaining ones */
+	void ErodeWalkableArea(FNNOpenHeightField& OpenHeightField, int32 ErodeRadius) const;
+
+	/** Removes the spans whose floor is inside any of the Obstacles */
+	void CarveObstacles(FNNOpenHeightField& OpenHeightField, const TArray<FNNAreaModifier>& Obstacles) const;
+
 protected:
+	/** Unlinks and removes the spans that pass the Predicate. The remaining spans get their new SpanIndex */
+	static void RemoveSpans(FNNOpenHeightField& OpenHeightField, TFunctionRef<bool(const FNNOpenSpan&)> Predicate);
+
 	/** Sets the OpenSpan neighbours */
 	void SetOpenSpanNeighbours(FNNOpenHeightField& OutOpenHeightField, const TArray<FVector2D>& PossibleNeighbours, FNNOpenSpan* OpenSpan, float MaxLedgeHeight, float AgentHeight) const;
 
-	void GenerateDistanceField(FNNOpenHeightField& OpenHeightField) const;
+	/** Calculates the EdgeDistance of the spans. The smoothing blurs the distances used by the watershed */
+	void GenerateDistanceField(FNNOpenHeightField& OpenHeightField, bool bSmooth = true) const;
 private:
 	FNNAreaGeneratorData& AreaGeneratorData;
 };